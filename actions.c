@@ -1,23 +1,63 @@
+#include <arpa/inet.h>
 #include <errno.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netpacket/packet.h>
+#ifndef SRD_NO_SYSTEMD
 #include <systemd/sd-bus.h>
+#endif
+#include <pthread.h>
 #include <pwd.h>
-#include <netinet/in.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/epoll.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "srd.h"
 #include "actions.h"
-#include "perf_metric.h"
+#include "http.h"
+#include "mqtt.h"
+#include "netlink.h"
 #include "printing.h"
 #include "util.h"
 
+/* increased to make the log actions reopen their files */
+static _Atomic uint32_t files_generation = 0;
+
+struct jsonl_file_t {
+    char* path;
+
+    // owner of the file if it is created; may be NULL
+    char* username;
+
+    // protects the fields below; the actions of several checks write at once
+    pthread_mutex_t mut;
+
+    // NULL until the first line is written and after it was reopened
+    FILE* file;
+
+    // generation of the files (see actions_reopen_files) when file was opened
+    uint32_t generation;
+
+    // 1 if lines were written since the latest flush
+    int dirty;
+
+    struct jsonl_file_t* next;
+};
+
+static jsonl_file_t* jsonl_files = NULL;
+
+#ifndef SRD_NO_SYSTEMD
+/* Time systemd has to answer a call instead of the default of 25 s; it only queues a job */
+#define SD_BUS_TIMEOUT_MS 5000
+
 int restart_system(const logger_t* logger)
 {
 #ifdef DEBUG
@@ -36,6 +76,7 @@ int restart_system(const logger_t* logger)
         sprint_error(logger, "Failed to connect to system bus: %s\n", strerror(-r));
         goto finish;
     }
+    sd_bus_set_method_call_timeout(bus, SD_BUS_TIMEOUT_MS * 1000ULL);
 
     r = sd_bus_call_method(
         bus,
@@ -85,6 +126,7 @@ int restart_service(const logger_t* logger, const char *name)
         sprint_error(logger, "Failed to connect to system bus: %s\n", strerror(-r));
         goto finish;
     }
+    sd_bus_set_method_call_timeout(bus, SD_BUS_TIMEOUT_MS * 1000ULL);
     char *prefix = "/org/freedesktop/systemd1/unit/";
     int prefix_len = strlen(prefix);
     char *service_name = malloc(prefix_len + strlen(name) + 1);
@@ -130,6 +172,8 @@ finish:
     return r >= 0;
 }
 
+#endif
+
 int run_command(const logger_t* logger, const action_cmd_t *cmd, const uint32_t timeout_ms, const char* actual_command)
 {
     int stdin[2];
@@ -178,7 +222,12 @@ int run_command(const logger_t* logger, const action_cmd_t *cmd, const uint32_t
         clock_gettime(CLOCK, &start);
         struct timespec now;
 
-        const uint32_t delta_ms = 1e5; // 100ms
+        // becomes readable once the command exited; without pidfd we poll every 100ms
+        int pidfd = -1;
+#ifdef SYS_pidfd_open
+        pidfd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+        const uint32_t delta_ms = 100;
         uint32_t diff_ms = 0;
 
         while ((res = waitpid(pid, NULL, WNOHANG)) == 0) {
@@ -187,7 +236,19 @@ int run_command(const logger_t* logger, const action_cmd_t *cmd, const uint32_t
 
                 return 0;
             }
-            usleep(delta_ms); // sleep 100ms
+
+            // ends right away once we're stopping
+            if (wait_fd(pidfd, POLLIN, pidfd >= 0 ? (int) (timeout_ms - diff_ms) : (int) delta_ms) < 0 && !running) {
+                sprint_info(logger, "Stopping: killing command %s\n", actual_command);
+
+                kill(pid, SIGKILL);
+                waitpid(pid, NULL, 0);
+                if (pidfd >= 0) {
+                    close(pidfd);
+                }
+                close(stdin[0]);
+                return 0;
+            }
 
             clock_gettime(CLOCK, &now);
 
@@ -198,9 +259,15 @@ int run_command(const logger_t* logger, const action_cmd_t *cmd, const uint32_t
 
                 kill(pid, SIGTERM);
                 waitpid(pid, NULL, WUNTRACED);
+                if (pidfd >= 0) {
+                    close(pidfd);
+                }
                 return 0;
             }
         }
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
 
         int bytes_read;
         sprint_debug(logger, "Command output: ");
@@ -219,6 +286,11 @@ int run_command(const logger_t* logger, const action_cmd_t *cmd, const uint32_t
     return 1;
 }
 
+void actions_reopen_files()
+{
+    files_generation++;
+}
+
 int log_to_file(const logger_t* logger, action_log_t* action_log, const char* actual_line)
 {
     // check if the file is beeing created
@@ -227,9 +299,18 @@ int log_to_file(const logger_t* logger, action_log_t* action_log, const char* ac
         is_new = 1;
     }
 
+    // the file may have been rotated (SIGHUP)
+    uint32_t generation = files_generation;
+    if (action_log->file != NULL && action_log->generation != generation) {
+        sprint_debug(logger, "Reopening file %s\n", action_log->path);
+        fclose(action_log->file);
+        action_log->file = NULL;
+    }
+
     if (action_log->file == NULL) {
         sprint_debug(logger, "Opening file %s\n", action_log->path);
         action_log->file = fopen(action_log->path, "a");
+        action_log->generation = generation;
     }
 
     if (action_log->file == NULL)
@@ -262,335 +343,757 @@ int log_to_file(const logger_t* logger, action_log_t* action_log, const char* ac
     return 1;
 }
 
-int influx_db(const logger_t* logger, action_influx_t* action, const char* actual_line) {
-    ssize_t num_ready;
-    ssize_t written_bytes;
-    float timeout_left = action->timeout;
+/*
+ * Appends lines to the backup file of action.
+ */
+static int influx_backup(const logger_t* logger, const action_influx_t* action, const char* lines) {
+    // check if the file is beeing created
+    int is_new = 0;
+    if (access(action->backup_path, F_OK) != 0) {
+        is_new = 1;
+    }
 
-    MEASURE_INIT(measure);
-    if (action->conn_socket <= 0) {
-        // calculate address
-        if (action->flags & FLAG_IS_HOSTNAME) {
-            MEASURE_START(measure);
+    FILE *f = fopen(action->backup_path, "a");
 
-            if (!resolve_hostname(logger, action->host, action->sockaddr, timeout_left)) {
-                sprint_error(logger, "Unable to get an IP for: %s\n", action->host);
+    if (f == NULL)
+    {
+        sprint_error(logger, "Unable to open file: %s (Reason: %s)\n", action->backup_path, strerror(errno));
+        return 0;
+    }
 
-                return 0;
-            }
-            char duration[32];
-            MEASURE_GET_SINCE_STR(measure, duration)
-            float resolve_duration = MEASURE_GET_SINCE(measure);
+    fputs(lines, f);
 
-            timeout_left -= resolve_duration;
-            if (timeout_left <= 0.0) {
-                sprint_error(logger, "Timeout after %ds when resolving %s\n", action->timeout, action->host);
-                return 0;
-            }
+    // set permissions for the file when 
+    // it's newly created
+    if (is_new && action->backup_username != NULL) {
+        struct passwd *user_passwd = getpwnam(action->backup_username);
 
-            sprint_debug(logger, "Resolving hostname %s took: %s\n", action->host, duration);
+        int r = chown(action->backup_path, user_passwd->pw_uid, user_passwd->pw_gid);
 
-            // set the port accordingly
-            if (action->sockaddr->ss_family == AF_INET) {
-                ((struct sockaddr_in*)action->sockaddr)->sin_port = htons(action->port);
-            } else {
-                ((struct sockaddr_in6*)action->sockaddr)->sin6_port = htons(action->port);
-            }
+        if (r < 0) {
+            sprint_error(logger, "Unable to chown log file %s: %s\n", action->backup_path, strerror(errno));
         }
+    }
+
+    fclose(f);
+
+    sprint_error(logger, "Succesfully written to backup file: %s\n", action->backup_path);
+
+    return 1;
+}
+
+/*
+ * Called by the HTTP client once the line was sent.
+ */
+static void influx_done(const logger_t* logger, void* arg, const char* body, int status) {
+    action_influx_t* action = arg;
+
+    if (status >= 200 && status < 300) {
+        sprint_debug(logger, "[Influx]: Success (%d)\n", status);
+        return;
+    }
+
+    if (status > 0) {
+        sprint_error(logger, "[Influx] Failed wo send to influxdb. Received status %d\n", status);
+    }
+
+    if (action->backup_path != NULL) {
+        influx_backup(logger, action, body);
+    }
+}
 
-        action->conn_socket = socket(action->sockaddr->ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+int influx(const logger_t* logger, action_influx_t* action, const char* actual_line) {
+    size_t length = strlen(actual_line) + 2;
+    char body[length];
+
+    // create body
+    snprintf(body, length, "%s\n", actual_line);
+
+    if (http_post(logger, action->server, action->endpoint, action->authorization, body,
+                  action->timeout * 1000, action->retries, influx_done, action)) {
+        return 1;
+    }
+
+    // Return 0 if no backup path is defined
+    if (action->backup_path == NULL) return 0;
+
+    return influx_backup(logger, action, body);
+}
+
+/*
+ * Called by the HTTP client once the body was sent.
+ */
+static void webhook_done(const logger_t* logger, void* arg, const char* body, int status) {
+    action_webhook_t* action = arg;
+    (void) body;
+
+    if (status >= 200 && status < 300) {
+        sprint_debug(logger, "[Webhook]: %s:%d%s answered with %d\n", action->host, action->port, action->path, status);
+    } else if (status > 0) {
+        sprint_error(logger, "[Webhook]: %s:%d%s answered with %d\n", action->host, action->port, action->path, status);
+    } else {
+        sprint_error(logger, "[Webhook]: Unable to send to %s:%d%s\n", action->host, action->port, action->path);
+    }
+}
+
+int webhook(const logger_t* logger, action_webhook_t* action, const char* body) {
+    return http_post(logger, action->server, action->path, action->headers, body,
+                     action->timeout * 1000, action->retries, webhook_done, action);
+}
+
+int mqtt(const logger_t* logger, action_mqtt_t* action, const char* topic, const char* message) {
+    return mqtt_publish(logger, action->broker, topic, message, action->qos, action->retain);
+}
+
+int wake_on_lan(const logger_t* logger, const action_wol_t* action) {
+    int fd;
+    struct sockaddr_storage destination;
+    socklen_t destination_len;
 
-        if (action->conn_socket < 0) {
-            sprint_error(logger, "[Influx]: Unable to create socket.\n");
+    if (action->raw) {
+        // the kernel adds the ethernet header with the MAC of the interface as source
+        fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, htons(WOL_ETHERTYPE));
+        if (fd < 0) {
+            sprint_error(logger, "[WoL]: Unable to create raw socket: %s\n", strerror(errno));
             return 0;
         }
-        action->conn_epoll_write_fd = epoll_create(1);
-        action->conn_epoll_read_fd = epoll_create(1);
 
-        // create epoll fd for writiting
-        struct epoll_event event;
-        event.events = EPOLLOUT;
-        event.data.fd = action->conn_socket;
+        // looked up for each wake-up as the interface may come and go
+        struct sockaddr_ll* ll = (struct sockaddr_ll*) &destination;
+        memset(ll, 0, sizeof(struct sockaddr_ll));
+        ll->sll_family = AF_PACKET;
+        ll->sll_protocol = htons(WOL_ETHERTYPE);
+        ll->sll_ifindex = if_nametoindex(action->interface);
+        ll->sll_halen = 6;
+        memcpy(ll->sll_addr, action->packet + 6, 6);
+        destination_len = sizeof(struct sockaddr_ll);
+
+        if (ll->sll_ifindex == 0) {
+            sprint_error(logger, "[WoL]: Unknown interface %s\n", action->interface);
+            close(fd);
+            return 0;
+        }
+    } else {
+        fd = socket(action->address.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            sprint_error(logger, "[WoL]: Unable to create socket: %s\n", strerror(errno));
+            return 0;
+        }
 
-        epoll_ctl(action->conn_epoll_write_fd, EPOLL_CTL_ADD, action->conn_socket, &event);
+        int enable = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable)) < 0) {
+            sprint_error(logger, "[WoL]: Unable to enable broadcasts: %s\n", strerror(errno));
+        }
+        if (action->interface != NULL &&
+            setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, action->interface, strlen(action->interface)) < 0) {
+            sprint_error(logger, "[WoL]: Unable to bind to interface %s: %s\n", action->interface, strerror(errno));
+            close(fd);
+            return 0;
+        }
 
-        // create epoll fd for reading
-        event.events = EPOLLIN | EPOLLET;
-        event.data.fd = action->conn_socket;
+        destination = action->address;
+        destination_len = destination.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    }
 
-        epoll_ctl(action->conn_epoll_read_fd, EPOLL_CTL_ADD, action->conn_socket, &event);
+    int sent = 0;
+    for (int i = 0; i <= action->retries; i++) {
+        // stop waiting once we're stopping
+        if (i > 0 && wait_fd(-1, 0, action->interval) < 0) {
+            break;
+        }
 
-        // connect and measure time
-        MEASURE_START(measure);
-        int s;
-        if (action->sockaddr->ss_family == AF_INET) {
-            s = connect(action->conn_socket, (struct sockaddr *) action->sockaddr, sizeof(struct sockaddr_in));
+        if (sendto(fd, action->packet, WOL_PACKET_SIZE, 0, (struct sockaddr*) &destination, destination_len) < 0) {
+            sprint_error(logger, "[WoL]: Unable to send to %s: %s\n", action->mac, strerror(errno));
         } else {
-            s = connect(action->conn_socket, (struct sockaddr *) action->sockaddr, sizeof(struct sockaddr_in6));
+            sent++;
         }
-        
-        // If s == 0, then we are successfully connected
-        if (s == 0) {
-            sprint_debug(logger, "[Influx]: Connected to %s:%d\n", action->host, action->port);
-        } else if (s == -1 && errno == EINPROGRESS) {
-            struct epoll_event events_write[1];
-    
-            // wait for maximum 10 seconds until we can write
-            num_ready = epoll_wait(action->conn_epoll_write_fd, events_write, 1, timeout_left * 1e3);
-
-            if (num_ready < 0) {
-                sprint_error(logger, "[Influx]: Unable to connect to %s:%d: %s\n", action->host, action->port, strerror(errno));
-                CLOSE(action);
-                
-                return 0;
-            } else if (num_ready == 0) {
-                char str_tmp[32];
-                struct timespec now;
-                clock_gettime(CLOCK, &now);
-                format_time(datetime_ph, str_tmp, 32, &now);
+    }
+    close(fd);
 
-                sprint_error(logger, "[Influx]: %s: Timeout after %ds when waiting for the connection to be established to %s:%d\n", str_tmp, action->timeout, action->host, action->port);
-                
-                CLOSE(action);
+    sprint_debug(logger, "[WoL]: Sent %d packets to %s\n", sent, action->mac);
 
-                return 0;
-            } else {
-                double took_s = MEASURE_GET_SINCE(measure);
+    return sent > 0;
+}
 
-                // Check socket
-                int val;
-                socklen_t len = sizeof(val);
-                if ((s = getsockopt(action->conn_socket, SOL_SOCKET, SO_ERROR, &val, &len))) {
-                    sprint_error(logger, "[Influx]: Unable to get status for socket: %d %s\n", s, strerror(s));
+#ifndef SRD_NO_SYSTEMD
+static void execute_service_restart(const logger_t* logger, action_t* action, const char* text) {
+    (void) text;
+    restart_service(logger, action->object);
+}
+#endif
 
-                    CLOSE(action);
+static void execute_reboot(const logger_t* logger, action_t* action, const char* text) {
+    (void) action;
+    (void) text;
 
-                    return 0;
-                }
-                if (val != 0) {
-                    sprint_error(logger, "Unable to connect to %s:%d: %s\n", action->host, action->port, strerror(val));
+    sprint_info(logger, "Sending restart signal\n");
+#ifndef SRD_NO_SYSTEMD
+    if (restart_system(logger)) {
+        sprint_info(logger, "Reboot scheduled. \n");
+        return;
+    }
+    // unable to restart
+    sprint_error(logger, "Unable to restart using dbus. Will try command\n");
+#endif
 
-                    CLOSE(action);
+    placeholder_t placeholder = {.raw_message = "reboot", .info = 0};
 
-                    return 0;
-                }
+    const char* cmd = "reboot";
+    action_cmd_t cmd_reboot = {.cmd_ph = placeholder};
 
-                timeout_left -= took_s;
-                if (timeout_left <= 0) {
-                    sprint_error(logger, "[Influx]: Timeout after %ds when connecting to %s:%d\n", action->timeout, action->host, action->port);
+    run_command(logger, &cmd_reboot, 5e3, cmd);
+}
 
-                    CLOSE(action);
-                    return 0; 
-                }
+static void execute_command(const logger_t* logger, action_t* action, const char* text) {
+    action_cmd_t *cmd = action->object;
 
-                sprint_debug(logger, "[Influx]: Successfully connected to %s:%d in %1.3f seconds\n", action->host, action->port, took_s);
-            }
-        } else {
-            sprint_error(logger, "[Influx]: Unable to connect to %s:%d:  %s\n", action->host, action->port, strerror(errno));
+    sprint_debug(logger, "\tCommand: %s\n", text);
 
-            CLOSE(action);
-            return 0;
-        }
-    } // end of creating socket
+    run_command(logger, cmd, cmd->timeout * 1e3, text);
+}
 
-    char header[256];
-    int line_len = strlen(actual_line) + 1;
-    char body[line_len];
+static void execute_log(const logger_t* logger, action_t* action, const char* text) {
+    action_log_t* action_log = (action_log_t*) action->object;
 
-    // create body
-    snprintf(body, line_len, "%s\n", actual_line);
+    int r = log_to_file(logger, action_log, text);
+    if (r == 0) {
+        sprint_error(logger, "Unable to log to file %s\n", action_log->path);
+    }
+}
 
-    // header
-    snprintf(header, 256, "POST %s HTTP/1.1\r\n"
-                          "Host: %s:%d\r\n"
-                          "Content-Length: %zd\r\n"
-                          "Authorization: %s\r\n\r\n",
-                          action->endpoint, action->host, action->port, strlen(body), action->authorization);
+static void execute_influx(const logger_t* logger, action_t* action, const char* text) {
+    influx(logger, action->object, text);
+}
 
-    written_bytes = 0;
-    // send the header
-    do {
-        MEASURE_START(measure);
+static void execute_webhook(const logger_t* logger, action_t* action, const char* text) {
+    webhook(logger, action->object, text);
+}
 
-        written_bytes = send(action->conn_socket, header, strlen(header), MSG_NOSIGNAL);
+static void execute_mqtt(const logger_t* logger, action_t* action, const char* text) {
+    // text is the topic and the message, separated by '\0' (see prepare_mqtt)
+    const char* message = text + strlen(text) + 1;
 
-        if (written_bytes == -1 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
-            struct epoll_event events_write[1];
-            num_ready = epoll_wait(action->conn_epoll_write_fd, events_write, 1, timeout_left * 1e3);
+    sprint_debug(logger, "\tMQTT: %s: %s\n", text, message);
 
-            if (!running) {
-                return 0;
-            }
+    mqtt(logger, action->object, text, message);
+}
 
-            if (num_ready <= 0) {
-                sprint_error(logger, "[Influx]: Timeout after %ds while waiting for %s:%d.\n", action->timeout, action->host, action->port);
+static void execute_wol(const logger_t* logger, action_t* action, const char* text) {
+    (void) text;
+    wake_on_lan(logger, action->object);
+}
 
-                CLOSE(action);
-                return 0;
-            }
-            double took_s = MEASURE_GET_SINCE(measure);
+static void execute_route(const logger_t* logger, action_t* action, const char* text) {
+    (void) text;
 
-            timeout_left -= took_s;
-            if (timeout_left <= 0) {
-                sprint_error(logger, "[Influx]: Timeout for %s:%d\n", action->host, action->port);
-                return 0; 
-            }
-            continue;
-        } else if (written_bytes == (ssize_t)strlen(header)) {
-            break;
-        }
-        sprint_error(logger, "[Influx]: Unable to send to %s:%d %s\n", action->host, action->port, strerror(errno));
-        CLOSE(action);
-        return 0;
-    } while (1);
+    char description[256];
+    action->ops->describe(action, description, sizeof(description));
 
-    // send the body
-    do {
-        MEASURE_START(measure);
-        written_bytes = send(action->conn_socket, body, strlen(body), MSG_NOSIGNAL);
+    if (netlink_route(action->object)) {
+        sprint_info(logger, "[Route]: %s\n", description);
+    } else {
+        sprint_error(logger, "[Route]: Unable to %s: %s\n", description, strerror(errno));
+    }
+}
 
-        if (written_bytes == -1 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
-            struct epoll_event events[1];
+static void execute_interface_reset(const logger_t* logger, action_t* action, const char* text) {
+    (void) text;
+    const action_interface_reset_t* reset = action->object;
 
-            // 2 seconds timeout for waiting until server is ready to receive data
-            num_ready = epoll_wait(action->conn_epoll_write_fd, events, 1, timeout_left * 1e3);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-            if (!running) {
-                return 0;
-            }
+    int success = netlink_reset_link(reset->interface, reset->down_time, reset->timeout * 1000);
+    int error = errno;
 
-            if (num_ready < 0) {
-                sprint_error(logger, "[Influx]: Error while waiting for %s:%d: %s.\n", action->host, action->port, strerror(errno));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int32_t duration_ms = calculate_difference_ms(start, end);
 
-                CLOSE(action);
-                return 0;
-            } else if (num_ready == 0) {
-                sprint_error(logger, "[Influx]: Timeout while sending the body to %s:%d\n", action->host, action->port);
+    if (success && reset->timeout > 0) {
+        sprint_info(logger, "[Interface]: Reset %s in %d ms; it has a carrier again\n", reset->interface, duration_ms);
+    } else if (success) {
+        sprint_info(logger, "[Interface]: Reset %s in %d ms\n", reset->interface, duration_ms);
+    } else if (error == ETIMEDOUT) {
+        sprint_error(logger, "[Interface]: Reset %s, but it has no carrier after %d ms\n", reset->interface, duration_ms);
+    } else {
+        sprint_error(logger, "[Interface]: Unable to reset %s: %s\n", reset->interface, strerror(error));
+    }
+}
 
-                CLOSE(action);
+jsonl_file_t* jsonl_file(const char* path, const char* username) {
+    for (jsonl_file_t* file = jsonl_files; file != NULL; file = file->next) {
+        if (strcmp(file->path, path) == 0) {
+            return file;
+        }
+    }
 
-                return 0;
-            }
-            double took_s = MEASURE_GET_SINCE(measure);
+    jsonl_file_t* file = calloc(1, sizeof(jsonl_file_t));
+    file->path = strdup(path);
+    file->username = username != NULL ? strdup(username) : NULL;
+    pthread_mutex_init(&file->mut, NULL);
 
-            timeout_left -= took_s;
-            if (timeout_left <= 0) {
-                sprint_error(logger, "[Influx]: Timeout for %s:%d\n", action->host, action->port);
-                return 0; 
-            }
-            continue;
-        } else if (written_bytes == (ssize_t)strlen(body)) {
-            break;
+    file->next = jsonl_files;
+    jsonl_files = file;
+
+    return file;
+}
+
+int actions_flush_files() {
+    int count = 0;
+    uint32_t generation = files_generation;
+
+    for (jsonl_file_t* file = jsonl_files; file != NULL; file = file->next) {
+        pthread_mutex_lock(&file->mut);
+        if (file->file != NULL && file->generation != generation) {
+            // rotated: let go of the old file, the next line opens the new one
+            fclose(file->file);
+            file->file = NULL;
+        } else if (file->dirty) {
+            fflush(file->file);
         }
-        sprint_error(logger, "[Influx]: Unable to send body to %s:%d %s\n", action->host, action->port, strerror(errno));
-        CLOSE(action);
-        return 0;
-    } while (1);
+        file->dirty = 0;
+        pthread_mutex_unlock(&file->mut);
+
+        count++;
+    }
 
-    // we only need to look at the start to see if we were successfull at
-    // writing
-    int read_bytes = 0;
-    char answer[128];
+    return count;
+}
 
-    do {
-        MEASURE_START(measure);
-        read_bytes = read(action->conn_socket, answer, sizeof(answer));
+void actions_close_files() {
+    while (jsonl_files != NULL) {
+        jsonl_file_t* file = jsonl_files;
+        jsonl_files = file->next;
 
-        if (read_bytes == -1 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
-            struct epoll_event events[1];
+        if (file->file != NULL) {
+            fclose(file->file);
+        }
+        pthread_mutex_destroy(&file->mut);
+        free(file->path);
+        free(file->username);
+        free(file);
+    }
+}
 
-            // 2 seconds timeout for processing
-            num_ready = epoll_wait(action->conn_epoll_read_fd, events, 1, timeout_left * 1e3);
+/*
+ * Opens file for appending if it is not open or was rotated.
+ * Called with the mutex of file held. Returns 1 on success, else 0.
+ */
+static int open_jsonl(const logger_t* logger, jsonl_file_t* file) {
+    uint32_t generation = files_generation;
+    if (file->file != NULL && file->generation != generation) {
+        sprint_debug(logger, "Reopening file %s\n", file->path);
+        fclose(file->file);
+        file->file = NULL;
+    }
 
-            if (!running) {
-                return 0;
-            }
+    if (file->file != NULL) {
+        return 1;
+    }
 
-            if (num_ready < 0) {
-                sprint_error(logger, "[Influx]: Error while waiting for an answer %s:%d: %s.\n", action->host, action->port, strerror(errno));
+    int is_new = access(file->path, F_OK) != 0;
 
-                CLOSE(action);
-                return 0;
-            } else if (num_ready == 0) {
-                sprint_error(logger, "[Influx]: Timeout when waiting for an answer from %s:%d\n", action->host, action->port);
+    sprint_debug(logger, "Opening file %s\n", file->path);
+    file->file = fopen(file->path, "a");
+    file->generation = generation;
 
-                CLOSE(action);
+    if (file->file == NULL) {
+        sprint_error(logger, "Unable to open file: %s (Reason: %s)\n", file->path, strerror(errno));
+        return 0;
+    }
 
-                return 0;
-            }
-            double took_s = MEASURE_GET_SINCE(measure);
+    if (is_new && file->username != NULL) {
+        struct passwd *user_passwd = getpwnam(file->username);
 
-            timeout_left -= took_s;
-            
-            continue;
-        } else if (read_bytes > 22) {
-            break;
+        if (user_passwd == NULL || chown(file->path, user_passwd->pw_uid, user_passwd->pw_gid) < 0) {
+            sprint_error(logger, "Unable to chown log file %s: %s\n", file->path, user_passwd == NULL ? "Unknown user" : strerror(errno));
         }
+    }
 
-        sprint_error(logger, "[Influx]: Unable to receive answer from %s:%d %s\n", action->host, action->port, strerror(errno));
-        CLOSE(action);
-        return 0;
-    } while (1);
+    return 1;
+}
 
-    answer[read_bytes] = '\0';
+static void execute_jsonl(const logger_t* logger, action_t* action, const char* text) {
+    action_jsonl_t* jsonl = (action_jsonl_t*) action->object;
+    jsonl_file_t* file = jsonl->file;
 
-    // check if starts with start_success
-    const char* start_success = "HTTP/1.1 204 No Content";
-    if (strncmp(answer, start_success, 23) == 0) {
-        double influx_time_s = action->timeout * 1.0 - timeout_left;
+    // buffered; written by actions_flush_files
+    pthread_mutex_lock(&file->mut);
+    if (open_jsonl(logger, file)) {
+        fputs(text, file->file);
+        fputc('\n', file->file);
+        file->dirty = 1;
+    }
+    pthread_mutex_unlock(&file->mut);
+}
 
-        sprint_debug(logger, "[Influx]: Success. Took %1.3f seconds\n", influx_time_s);
-        return 1;
+static char* prepare_command(const action_t* action, const connectivity_check_t* check, double downtime, double uptime, int connected) {
+    const action_cmd_t* cmd = action->object;
+    return insert_placeholders(&cmd->cmd_ph, check, downtime, uptime, connected);
+}
+
+static char* prepare_log(const action_t* action, const connectivity_check_t* check, double downtime, double uptime, int connected) {
+    const action_log_t* action_log = action->object;
+    return insert_placeholders(&action_log->message_ph, check, downtime, uptime, connected);
+}
+
+static char* prepare_influx(const action_t* action, const connectivity_check_t* check, double downtime, double uptime, int connected) {
+    const action_influx_t* action_influx = action->object;
+    return insert_placeholders(&action_influx->line, check, downtime, uptime, connected);
+}
+
+static char* prepare_webhook(const action_t* action, const connectivity_check_t* check, double downtime, double uptime, int connected) {
+    const action_webhook_t* action_webhook = action->object;
+    return insert_placeholders(&action_webhook->body, check, downtime, uptime, connected);
+}
+
+static char* prepare_mqtt(const action_t* action, const connectivity_check_t* check, double downtime, double uptime, int connected) {
+    const action_mqtt_t* action_mqtt = action->object;
+
+    char* topic = insert_placeholders(&action_mqtt->topic, check, downtime, uptime, connected);
+    char* message = insert_placeholders(&action_mqtt->message, check, downtime, uptime, connected);
+
+    // both in one string, separated by '\0'
+    size_t topic_length = strlen(topic);
+    char* text = malloc(topic_length + strlen(message) + 2);
+    memcpy(text, topic, topic_length + 1);
+    strcpy(text + topic_length + 1, message);
+
+    free(topic);
+    free(message);
+
+    return text;
+}
+
+/*
+ * Writes the time as milliseconds since the epoch or null if it is not set,
+ * i.e. still the startup time the timestamps of a check are initialised to.
+ */
+static void time_to_json(const struct timespec* time, char* buffer, size_t size) {
+    if (time->tv_sec == startup_time && time->tv_nsec == 0) {
+        snprintf(buffer, size, "null");
+    } else {
+        snprintf(buffer, size, "%lld", (long long) time->tv_sec * 1000 + time->tv_nsec / 1000000);
     }
+}
 
-    sprint_error(logger, "[Influx] Failed wo send to influxdb. Received: %s\n", answer);
-    
-    CLOSE(action);
+static char* prepare_jsonl(const action_t* action, const connectivity_check_t* check, double downtime, double uptime, int connected) {
+    const action_jsonl_t* jsonl = action->object;
 
-    return 0;
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    // escaped here as targets following the gateway change their address
+    char target[6 * 256];
+    json_escape(check->address, target, sizeof(target));
+
+    char latency[24] = "null";
+    if (check->latency >= 0) {
+        snprintf(latency, sizeof(latency), "%ld", (long) (check->latency * 1e6));
+    }
+
+    char now_ms[24];
+    char down_since[24];
+    char up_since[24];
+    time_to_json(&now, now_ms, sizeof(now_ms));
+    time_to_json(&check->timestamp_first_failed, down_since, sizeof(down_since));
+    time_to_json(&check->timestamp_first_reply, up_since, sizeof(up_since));
+
+    // everything after the prefix with the config name
+    char rest[sizeof(target) + 512];
+    int length = snprintf(rest, sizeof(rest),
+        "\"time_ms\":%s,\"target\":\"%s\",\"state\":\"%s\",\"reply\":%s,\"latency_us\":%s,"
+        "\"downtime_s\":%ld,\"uptime_s\":%ld,\"down_since_ms\":%s,\"up_since_ms\":%s}",
+        now_ms, target, (check->state & STATE_UP) ? "up" : "down", connected ? "true" : "false", latency,
+        (long) downtime, (long) uptime, down_since, up_since);
+
+    char* text = malloc(jsonl->prefix_length + length + 1);
+    memcpy(text, jsonl->prefix, jsonl->prefix_length);
+    memcpy(text + jsonl->prefix_length, rest, length + 1);
+
+    return text;
 }
 
-int influx(const logger_t* logger, action_influx_t* action, const char* actual_line) {
-    int status = influx_db(logger, action, actual_line);
+static void free_object(action_t* action) {
+    free(action->object);
+}
 
-    // Return if successfull
-    if (status) return 1;
+static void free_command(action_t* action) {
+    action_cmd_t* cmd = (action_cmd_t*) action->object;
 
-    // Return 0 if no backup path is defined
-    if (action->backup_path == NULL) return 0;
+    free((char *)cmd->cmd_ph.raw_message);
+    free((char *)cmd->user);
+    free(action->object);
+}
 
-    // check if the file is beeing created
-    int is_new = 0;
-    if (access(action->backup_path, F_OK) != 0) {
-        is_new = 1;
+static void free_log(action_t* action) {
+    action_log_t* action_log = (action_log_t*) action->object;
+
+    free((char *)action_log->message_ph.raw_message);
+    free((char *)action_log->path);
+    if (action_log->username) {
+        free((char *)action_log->username);
+    }
+    if (action_log->header) {
+        free((char *)action_log->header);
+    }
+    if (action_log->file) {
+        fclose(action_log->file);
     }
+    free(action->object);
+}
 
-    FILE *f = fopen(action->backup_path, "a");
+static void free_influx(action_t* action) {
+    action_influx_t* influx = (action_influx_t*) action->object;
 
-    if (f == NULL)
-    {
-        sprint_error(logger, "Unable to open file: %s (Reason: %s)\n", action->backup_path, strerror(errno));
-        return 0;
+    // the connections are closed by http_stop
+    free((char *)influx->host);
+    free((char *)influx->authorization);
+    free((char *)influx->endpoint);
+    free((char *)influx->line.raw_message);
+    if (influx->backup_path) {
+        free((char *)influx->backup_path);
+    }
+    if (influx->backup_username) {
+        free((char *)influx->backup_username);
     }
+    free(action->object);
+}
 
-    fputs(actual_line, f);
-    fputs("\n", f);
+static void free_webhook(action_t* action) {
+    action_webhook_t* webhook = (action_webhook_t*) action->object;
 
-    // set permissions for the file when 
-    // it's newly created
-    if (is_new && action->backup_username != NULL) {
-        struct passwd *user_passwd = getpwnam(action->backup_username);
+    free((char *)webhook->host);
+    free((char *)webhook->path);
+    free((char *)webhook->headers);
+    free((char *)webhook->body.raw_message);
+    free(action->object);
+}
 
-        int r = chown(action->backup_path, user_passwd->pw_uid, user_passwd->pw_gid);
+static void free_mqtt(action_t* action) {
+    action_mqtt_t* mqtt = (action_mqtt_t*) action->object;
 
-        if (r < 0) {
-            sprint_error(logger, "Unable to chown log file %s: %s\n", action->backup_path, strerror(errno));
-        }
+    // the connection is closed by mqtt_stop
+    free((char *)mqtt->host);
+    free((char *)mqtt->topic.raw_message);
+    free((char *)mqtt->message.raw_message);
+    free(action->object);
+}
+
+static void free_wol(action_t* action) {
+    action_wol_t* wol = (action_wol_t*) action->object;
+
+    free((char *)wol->mac);
+    free((char *)wol->interface);
+    free(action->object);
+}
+
+static void free_route(action_t* action) {
+    action_route_t* route = (action_route_t*) action->object;
+
+    free((char *)route->interface);
+    free(route->request);
+    free(action->object);
+}
+
+static void free_interface_reset(action_t* action) {
+    action_interface_reset_t* reset = (action_interface_reset_t*) action->object;
+
+    free((char *)reset->interface);
+    free(action->object);
+}
+
+static void free_jsonl(action_t* action) {
+    action_jsonl_t* jsonl = (action_jsonl_t*) action->object;
+
+    // the file is freed by actions_close_files
+    free(jsonl->prefix);
+    free(action->object);
+}
+
+static void describe_service_restart(const action_t* action, char* buffer, size_t size) {
+    snprintf(buffer, size, "%s", (const char*) action->object);
+}
+
+static void describe_reboot(const action_t* action, char* buffer, size_t size) {
+    (void) action;
+    snprintf(buffer, size, "system");
+}
+
+static void describe_command(const action_t* action, char* buffer, size_t size) {
+    const action_cmd_t* cmd = action->object;
+    snprintf(buffer, size, "%s", cmd->cmd_ph.raw_message);
+}
+
+static void describe_log(const action_t* action, char* buffer, size_t size) {
+    const action_log_t* action_log = action->object;
+    snprintf(buffer, size, "%s", action_log->path);
+}
+
+static void describe_influx(const action_t* action, char* buffer, size_t size) {
+    const action_influx_t* action_influx = action->object;
+    snprintf(buffer, size, "%s:%d%s", action_influx->host, action_influx->port, action_influx->endpoint);
+}
+
+static void describe_webhook(const action_t* action, char* buffer, size_t size) {
+    const action_webhook_t* action_webhook = action->object;
+    snprintf(buffer, size, "%s:%d%s", action_webhook->host, action_webhook->port, action_webhook->path);
+}
+
+static void describe_mqtt(const action_t* action, char* buffer, size_t size) {
+    const action_mqtt_t* action_mqtt = action->object;
+    snprintf(buffer, size, "%s:%d %s", action_mqtt->host, action_mqtt->port, action_mqtt->topic.raw_message);
+}
+
+static void describe_wol(const action_t* action, char* buffer, size_t size) {
+    const action_wol_t* action_wol = action->object;
+    if (action_wol->interface != NULL) {
+        snprintf(buffer, size, "%s on %s", action_wol->mac, action_wol->interface);
+    } else {
+        snprintf(buffer, size, "%s", action_wol->mac);
     }
+}
 
-    fclose(f);
+static void address_to_string(const struct sockaddr_storage* sockaddr, char* buffer, size_t size) {
+    if (sockaddr->ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((const struct sockaddr_in*) sockaddr)->sin_addr, buffer, size);
+    } else {
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6*) sockaddr)->sin6_addr, buffer, size);
+    }
+}
 
-    sprint_error(logger, "Succesfully written to backup file: %s\n", action->backup_path);
+static void describe_route(const action_t* action, char* buffer, size_t size) {
+    static const char* operations[] = {
+        [ROUTE_REPLACE] = "replace",
+        [ROUTE_ADD] = "add",
+        [ROUTE_DELETE] = "delete",
+    };
+    const action_route_t* route = action->object;
+
+    char destination[INET6_ADDRSTRLEN] = "default";
+    if (route->prefix > 0) {
+        address_to_string(&route->destination, destination, sizeof(destination));
+    }
+    int len = snprintf(buffer, size, "%s %s", operations[route->operation], destination);
+    if (route->prefix > 0 && len < (int) size) {
+        len += snprintf(buffer + len, size - len, "/%d", route->prefix);
+    }
 
-    return 1;
+    char gateway[INET6_ADDRSTRLEN];
+    if (route->gateway.ss_family != AF_UNSPEC && len < (int) size) {
+        address_to_string(&route->gateway, gateway, sizeof(gateway));
+        len += snprintf(buffer + len, size - len, " via %s", gateway);
+    }
+    if (route->interface != NULL && len < (int) size) {
+        len += snprintf(buffer + len, size - len, " dev %s", route->interface);
+    }
+    if (route->metric >= 0 && len < (int) size) {
+        len += snprintf(buffer + len, size - len, " metric %ld", (long) route->metric);
+    }
+    if (route->table != ROUTE_TABLE_MAIN && len < (int) size) {
+        snprintf(buffer + len, size - len, " table %u", route->table);
+    }
+}
+
+static void describe_interface_reset(const action_t* action, char* buffer, size_t size) {
+    const action_interface_reset_t* reset = action->object;
+    snprintf(buffer, size, "%s", reset->interface);
+}
+
+static void describe_jsonl(const action_t* action, char* buffer, size_t size) {
+    const action_jsonl_t* jsonl = action->object;
+    snprintf(buffer, size, "%s", jsonl->file->path);
+}
+
+const action_ops_t action_ops[ACTION_TYPES] = {
+    [ACTION_SERVICE_RESTART] = {
+        .name = "service-restart",
+        .prepare = NULL,
+#ifndef SRD_NO_SYSTEMD
+        .execute = execute_service_restart,
+#else
+        .execute = NULL, // not available without systemd
+#endif
+        .free = free_object,
+        .describe = describe_service_restart,
+    },
+    [ACTION_REBOOT] = {
+        .name = "reboot",
+        .prepare = NULL,
+        .execute = execute_reboot,
+        .free = free_object,
+        .describe = describe_reboot,
+    },
+    [ACTION_COMMAND] = {
+        .name = "command",
+        .prepare = prepare_command,
+        .execute = execute_command,
+        .free = free_command,
+        .describe = describe_command,
+    },
+    [ACTION_LOG] = {
+        .name = "log",
+        .prepare = prepare_log,
+        .execute = execute_log,
+        .free = free_log,
+        .describe = describe_log,
+    },
+    [ACTION_INFLUX] = {
+        .name = "influx",
+        .prepare = prepare_influx,
+        .execute = execute_influx,
+        .free = free_influx,
+        .describe = describe_influx,
+    },
+    [ACTION_WEBHOOK] = {
+        .name = "webhook",
+        .prepare = prepare_webhook,
+        .execute = execute_webhook,
+        .free = free_webhook,
+        .describe = describe_webhook,
+    },
+    [ACTION_MQTT] = {
+        .name = "mqtt",
+        .prepare = prepare_mqtt,
+        .execute = execute_mqtt,
+        .free = free_mqtt,
+        .describe = describe_mqtt,
+    },
+    [ACTION_WOL] = {
+        .name = "wol",
+        .prepare = NULL,
+        .execute = execute_wol,
+        .free = free_wol,
+        .describe = describe_wol,
+    },
+    [ACTION_ROUTE] = {
+        .name = "route",
+        .prepare = NULL,
+        .execute = execute_route,
+        .free = free_route,
+        .describe = describe_route,
+    },
+    [ACTION_INTERFACE_RESET] = {
+        .name = "interface-reset",
+        .prepare = NULL,
+        .execute = execute_interface_reset,
+        .free = free_interface_reset,
+        .describe = describe_interface_reset,
+    },
+    [ACTION_JSONL] = {
+        .name = "jsonl",
+        .prepare = prepare_jsonl,
+        .execute = execute_jsonl,
+        .free = free_jsonl,
+        .describe = describe_jsonl,
+    },
+};
+
+int action_type(const char* name) {
+    for (int i = 0; i < ACTION_TYPES; i++) {
+        if (strcmp(action_ops[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
 }
@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/socket.h>
 
 #include "printing.h"
 
@@ -19,13 +20,6 @@ typedef struct placeholder_t {
     replacement_info_t info;
 } placeholder_t;
 
-#define CLOSE(action_influx)                    \
-    close(action_influx->conn_socket);          \
-    close(action_influx->conn_epoll_write_fd);  \
-    close(action_influx->conn_epoll_read_fd);   \
-    action_influx->conn_socket = -1;            \
-    action_influx->conn_epoll_write_fd = -1;    \
-    action_influx->conn_epoll_read_fd = -1;     \
 /*
  * Connectivity status for a target (connectivity_check_t).
  */
@@ -39,13 +33,67 @@ typedef enum conn_state_t
     STATE_ALL       = 0b1111,
 } conn_state_t;
 
+struct action_t;
+struct http_endpoint_t;
+struct mqtt_broker_t;
+struct connectivity_check_t;
+
+/*
+ * Types of actions; an index into action_ops.
+ */
+typedef enum action_type_t
+{
+    ACTION_SERVICE_RESTART,
+    ACTION_REBOOT,
+    ACTION_COMMAND,
+    ACTION_LOG,
+    ACTION_INFLUX,
+    ACTION_WEBHOOK,
+    ACTION_MQTT,
+    ACTION_WOL,
+    ACTION_ROUTE,
+    ACTION_INTERFACE_RESET,
+    ACTION_JSONL,
+    ACTION_TYPES, // amount of types
+} action_type_t;
+
+/*
+ * Implementation of one type of action.
+ */
+typedef struct action_ops_t {
+    // name of the action in the configuration
+    const char* name;
+
+    /* Returns the text the action is performed with (the command, message
+     * or line with all placeholders inserted) or NULL if it needs none.
+     * Called by the thread of the check when the action is due.
+     */
+    char* (*prepare)(const struct action_t* action, const struct connectivity_check_t* check,
+                     double downtime, double uptime, int connected);
+
+    // Performs the action with the text returned by prepare
+    void (*execute)(const logger_t* logger, struct action_t* action, const char* text);
+
+    // Frees the object of the action and closes its files and sockets
+    void (*free)(struct action_t* action);
+
+    // Writes a short description (f.ex. the command) into buffer
+    void (*describe)(const struct action_t* action, char* buffer, size_t size);
+} action_ops_t;
+
+/* Implementations of all types, indexed by action_type_t */
+extern const action_ops_t action_ops[ACTION_TYPES];
+
 /* 
 * An action which will be performed for one target
 * if down for delay seconds.
 */
 typedef struct action_t {
     // Defines which action to perform
-    const char* name;
+    action_type_t type;
+
+    // action_ops[type]
+    const action_ops_t* ops;
 
     /* Pointer to struct or string with more info
      * about the given action.
@@ -53,7 +101,13 @@ typedef struct action_t {
      *      * action_cmd_t
      *      * action_log_t
      *      * action_influx_t
-     *      * to char* which is the service name if name is "restart-service"
+     *      * action_webhook_t
+     *      * action_mqtt_t
+     *      * action_wol_t
+     *      * action_route_t
+     *      * action_interface_reset_t
+     *      * action_jsonl_t
+     *      * to char* which is the service name if type is ACTION_SERVICE_RESTART
      */
     void*       object;
 
@@ -65,6 +119,9 @@ typedef struct action_t {
 
     // Flags for this
     uint16_t flags;
+
+    // 1 while a worker of the pipeline performs this action (protected by the pipeline)
+    int busy;
 } action_t;
 
 /* 
@@ -102,6 +159,9 @@ typedef struct action_log_t {
 
     // Header for the log-file. Only written when creating the file
     const char* header;
+
+    // generation of the files (see actions_reopen_files) when file was opened
+    uint32_t generation;
 } action_log_t;
 
 /*
@@ -111,14 +171,15 @@ typedef struct action_influx_t {
     // host
     const char* host;
 
-    struct sockaddr_storage* sockaddr;
-
     int port;
 
+    // connections to host and port; shared by all actions sending to it
+    struct http_endpoint_t* server;
+
     // path for the endpoint, may include bucket and organization
     const char* endpoint;
 
-    // authorization token
+    // authorization header (with the token) ending with "\r\n"
     const char* authorization;
 
     /* placeholder_t for one line which is sent.
@@ -133,25 +194,165 @@ typedef struct action_influx_t {
     /* File where we write a line if we fail to insert into influx */
     const char* backup_username;
 
-    // socket to send the data
-    int conn_socket;
+    // timeout for the insertion of one line
+    int timeout;
+
+    // how often a failed insertion is tried again before it is written to backup_path
+    int retries;
+} action_influx_t;
+
+/*
+ * Action to POST a message (f.ex. JSON) to a URL.
+ */
+typedef struct action_webhook_t {
+    // host, port and path of the URL
+    const char* host;
+    int port;
+    const char* path;
+
+    // connections to host and port; shared by all actions sending to it
+    struct http_endpoint_t* server;
 
-    // epoll fd to send the data
-    int conn_epoll_write_fd;
+    // Content-Type and the configured headers, each ending with "\r\n"
+    const char* headers;
 
-    // epoll fd to receive an answer
-    int conn_epoll_read_fd;
+    // body of the request; may contain placeholders
+    struct placeholder_t body;
 
-    // timeout for the insertion of one line
+    // timeout for one try in seconds
     int timeout;
 
-    /* Used to store some properties of this action.
-     * FLAG_IS_HOSTNAME indicates that host is not an IP
-     * address and needs to be resolved.
-     */
-    int flags;
-} action_influx_t;
+    // how often a failed request is tried again
+    int retries;
+} action_webhook_t;
+
+/*
+ * Action to publish a message to an MQTT broker.
+ */
+typedef struct action_mqtt_t {
+    // host and port of the broker
+    const char* host;
+    int port;
+
+    // connection and session; shared by all actions with the same broker and client id
+    struct mqtt_broker_t* broker;
+
+    // topic (f.ex. srd/%ip/state) and message; both may contain placeholders
+    struct placeholder_t topic;
+    struct placeholder_t message;
+
+    // 0 (at most once) or 1 (at least once)
+    int qos;
+
+    // the broker keeps the last message of the topic for new subscribers
+    int retain;
+} action_mqtt_t;
+
+/* Length of a Wake-on-LAN packet: 6 times 0xFF followed by 16 times the MAC */
+#define WOL_PACKET_SIZE 102
+
+/* EtherType of Wake-on-LAN frames */
+#define WOL_ETHERTYPE 0x0842
+
+/*
+ * Action to wake a host with a Wake-on-LAN packet.
+ */
+typedef struct action_wol_t {
+    // MAC of the host, f.ex. "aa:bb:cc:dd:ee:ff"
+    const char* mac;
+
+    // the magic packet; built when the configuration is loaded
+    uint8_t packet[WOL_PACKET_SIZE];
+
+    // interface to send on; NULL to let the routing decide (UDP only)
+    const char* interface;
+
+    // 1 to send a raw ethernet frame to the MAC instead of a UDP broadcast
+    int raw;
+
+    // destination of the UDP packet (f.ex. 255.255.255.255:9)
+    struct sockaddr_storage address;
+
+    // the packet is sent 1 + retries times, interval milliseconds apart
+    int retries;
+    int interval;
+} action_wol_t;
 
+/* Table of the routes if none is configured (RT_TABLE_MAIN) */
+#define ROUTE_TABLE_MAIN 254
+
+/*
+ * Operations of the route action.
+ */
+typedef enum route_operation_t {
+    ROUTE_REPLACE, // install the route or replace the one with the same destination and metric
+    ROUTE_ADD,     // install the route; fails if it exists
+    ROUTE_DELETE,
+} route_operation_t;
+
+/*
+ * Action to install or delete a route through rtnetlink.
+ */
+typedef struct action_route_t {
+    route_operation_t operation;
+
+    // destination and length of its prefix; 0 for the default route
+    struct sockaddr_storage destination;
+    int prefix;
+
+    // next hop; family is AF_UNSPEC if the route has none
+    struct sockaddr_storage gateway;
+
+    // interface of the route; NULL if the kernel chooses it by the gateway
+    const char* interface;
+
+    // -1 if not set
+    int64_t metric;
+
+    uint32_t table;
+
+    // the rtnetlink request; built when the configuration is loaded (see netlink_build_route)
+    void* request;
+
+    // offset of the interface index inside request; set before each send
+    size_t oif_offset;
+} action_route_t;
+
+/*
+ * Action to take an interface down and up again.
+ */
+typedef struct action_interface_reset_t {
+    const char* interface;
+
+    // milliseconds the interface stays down
+    int down_time;
+
+    // seconds to wait for the carrier to return; 0 to not wait
+    int timeout;
+} action_interface_reset_t;
+
+/*
+ * A file written by jsonl actions. All actions with the same path share it,
+ * so their lines go through one buffered stream (see jsonl_file).
+ */
+typedef struct jsonl_file_t jsonl_file_t;
+
+/* Lines of jsonl actions stay at most this long in the buffer of their file */
+#define JSONL_FLUSH_MS 1000
+
+/*
+ * Action to append the event as one JSON object per line to a file.
+ */
+typedef struct action_jsonl_t {
+    // file the lines are written to; shared with the other actions writing to its path
+    jsonl_file_t* file;
+
+    // start of each object with the escaped config name; encoded when loading the config
+    char* prefix;
+    size_t prefix_length;
+} action_jsonl_t;
+
+#ifndef SRD_NO_SYSTEMD
 /*
 * Restarts the given service. The service-name must have
 * characters not in [a-Z] or [0-9] escaped to _HEX where
@@ -166,6 +367,7 @@ int restart_service(const logger_t* logger, const char* name);
 * Returns 1 on success, and otherwise 0.
 */
 int restart_system(const logger_t* logger);
+#endif
 
 /*
  * Runs the given command. If it does not exit within timeout_ms milliseconds
@@ -179,15 +381,58 @@ int run_command(const logger_t *logger, const action_cmd_t* cmd, const uint32_t
 */
 int log_to_file(const logger_t* logger, action_log_t* action_log, const char* actual_line);
 
-/* 
- * Tries to insert the line into the database defined by the action.
- * Returns 1 on success, else 0;
+/*
+ * Queues the line to be inserted into the database defined by the action.
+ * The line is written to the backup file of the action if it can't be inserted.
+ * Returns 1 if it was queued or backed up, else 0.
  */
-int influx_db(const logger_t* logger, action_influx_t* action, const char* actual_line);
+int influx(const logger_t* logger, action_influx_t* action, const char* actual_line);
 
 /*
- * Executes the given influx action. Returns 1 on success, else 0.
+ * Queues the body to be sent to the URL of the action.
+ * Returns 1 if it was queued, else 0.
  */
-int influx(const logger_t* logger, action_influx_t* action, const char* actual_line);
+int webhook(const logger_t* logger, action_webhook_t* action, const char* body);
+
+/*
+ * Queues the message to be published to topic on the broker of the action.
+ * Returns 1 if it was queued, else 0.
+ */
+int mqtt(const logger_t* logger, action_mqtt_t* action, const char* topic, const char* message);
+
+/*
+ * Sends the Wake-on-LAN packet of the action.
+ * Returns 1 if it was sent, else 0.
+ */
+int wake_on_lan(const logger_t* logger, const action_wol_t* action);
+
+/*
+ * Makes all log actions reopen their files before they write the next line,
+ * f.ex. after the files were rotated. Can be called from any thread.
+ */
+void actions_reopen_files();
+
+/*
+ * Returns the file at path for jsonl actions; the user of the first one owns
+ * it if it is created. Must be called while loading the configs.
+ */
+jsonl_file_t* jsonl_file(const char* path, const char* username);
+
+/*
+ * Writes the buffered lines of all jsonl files and closes the ones which are
+ * reopened (see actions_reopen_files). Call it every JSONL_FLUSH_MS.
+ * Returns the amount of jsonl files.
+ */
+int actions_flush_files();
+
+/*
+ * Flushes, closes and frees all jsonl files once no action writes anymore.
+ */
+void actions_close_files();
+
+/*
+ * Returns the type of the action with the given name or -1 if it is unknown.
+ */
+int action_type(const char* name);
 
 #endif
@@ -0,0 +1,893 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "srd.h"
+#include "printing.h"
+#include "actions.h"
+#include "util.h"
+
+/* records sent or received at once */
+#define COLLECTOR_BATCH 256
+
+/* maximum seconds between two attempts to connect to the collector */
+#define COLLECTOR_RECONNECT_MAX 30
+
+/* timeout in seconds for connecting and sending to the collector */
+#define COLLECTOR_SEND_TIMEOUT 5
+
+/* Returns 1 if sequence a is newer than b (handles the wrap around) */
+#define SEQUENCE_AFTER(a, b) ((int32_t) ((a) - (b)) > 0)
+
+/*
+ * An agent known to the collector. Kept across reconnects to drop resent records.
+ */
+typedef struct agent_t
+{
+    char name[256];
+
+    // session of the agent; a new session starts with a new sequence
+    uint32_t session;
+
+    // sequence of the latest record processed
+    uint32_t last_sequence;
+} agent_t;
+
+/*
+ * Latest result an agent reported for a collected check.
+ */
+typedef struct report_t
+{
+    // is 1 if the agent reported this target
+    int valid;
+
+    conn_state_t state;
+
+    // latency in seconds; -1.0 if the target was not reachable
+    float latency;
+
+    // time of the check on the agent
+    struct timespec time;
+} report_t;
+
+/*
+ * Reports of all agents for one collected check, indexed by the agent.
+ */
+typedef struct collected_t
+{
+    report_t* reports;
+    int count;
+} collected_t;
+
+/*
+ * A connection of an agent to the collector.
+ */
+typedef struct connection_t
+{
+    int fd;
+
+    // index in agents; -1 until the hello was received
+    int agent;
+
+    // received bytes not processed yet
+    char buffer[sizeof(collector_hello_t) + 256 + COLLECTOR_BATCH * sizeof(collector_record_t)];
+    size_t length;
+
+    // list of all connections
+    struct connection_t* prev;
+    struct connection_t* next;
+} connection_t;
+
+/* --- agent --- */
+
+static char* agent_endpoint = NULL;
+static char* agent_name = NULL;
+static uint32_t agent_session;
+
+/* results waiting to be sent or acknowledged, protected by queue_mut */
+static pthread_mutex_t queue_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static collector_record_t* queue = NULL;
+
+/* sequence of the oldest record not acknowledged and of the next record */
+static uint32_t queue_first = 1;
+static uint32_t queue_next = 1;
+static uint64_t queue_dropped = 0;
+
+/* --- collector --- */
+
+static int listen_fd = -1;
+static int listen_epoll_fd = -1;
+static char* listen_path = NULL;
+static connection_t* connections = NULL;
+
+/* protects agents and the reports of all collected checks */
+static pthread_mutex_t collector_mut = PTHREAD_MUTEX_INITIALIZER;
+static agent_t* agents = NULL;
+static int agents_count = 0;
+
+static connectivity_check_t** collected_checks = NULL;
+static int collected_count = 0;
+
+/* records dropped as duplicates or for unknown targets */
+static uint64_t duplicates = 0;
+static uint64_t unknown = 0;
+
+/*
+ * Connects the non-blocking socket fd to addr. Waits up to COLLECTOR_SEND_TIMEOUT
+ * or until we're stopping. Returns 1 on success, else 0.
+ */
+static int connect_fd(int fd, const struct sockaddr* addr, socklen_t len) {
+    if (connect(fd, addr, len) == 0) {
+        return 1;
+    }
+    if (errno != EINPROGRESS && errno != EAGAIN) {
+        return 0;
+    }
+
+    if (wait_fd(fd, POLLOUT, COLLECTOR_SEND_TIMEOUT * 1000) != 1) {
+        return 0;
+    }
+
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0;
+}
+
+/*
+ * Opens a stream socket for endpoint ("HOST:PORT", "[IPv6]:PORT" or a path).
+ * Binds and listens on it if listening is set, else connects to it.
+ * Returns the socket or -1.
+ */
+static int open_endpoint(const logger_t* logger, const char* endpoint, int listening) {
+    if (endpoint[0] == '/') {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+        if (strlen(endpoint) >= sizeof(addr.sun_path)) {
+            sprint_error(logger, "Path of the socket is too long: %s\n", endpoint);
+            return -1;
+        }
+        strcpy(addr.sun_path, endpoint);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (listening ? 0 : SOCK_NONBLOCK), 0);
+        if (fd < 0) {
+            return -1;
+        }
+
+        if (listening) {
+            unlink(endpoint);
+
+            if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0 && listen(fd, SOMAXCONN) == 0) {
+                return fd;
+            }
+        } else if (connect_fd(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+            return fd;
+        }
+        close(fd);
+        return -1;
+    }
+
+    // split into host and port
+    char host[256];
+    const char* port;
+    const char* host_start = endpoint;
+    const char* host_end;
+
+    if (endpoint[0] == '[') {
+        host_start = endpoint + 1;
+        host_end = strchr(endpoint, ']');
+        port = (host_end != NULL && host_end[1] == ':') ? host_end + 2 : NULL;
+    } else {
+        host_end = strrchr(endpoint, ':');
+        port = host_end != NULL ? host_end + 1 : NULL;
+    }
+
+    if (port == NULL || *port == '\0' || (size_t) (host_end - host_start) >= sizeof(host)) {
+        sprint_error(logger, "Invalid endpoint %s. Use HOST:PORT, [IPv6]:PORT or the path of a unix socket\n", endpoint);
+        return -1;
+    }
+    memcpy(host, host_start, host_end - host_start);
+    host[host_end - host_start] = '\0';
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = listening ? AI_PASSIVE : 0 };
+    struct addrinfo* result;
+
+    int s = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &result);
+    if (s != 0) {
+        sprint_error(logger, "Unable to resolve %s: %s\n", endpoint, gai_strerror(s));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* rp = result; rp != NULL; rp = rp->ai_next) {
+        fd = socket(rp->ai_family, rp->ai_socktype | SOCK_CLOEXEC | (listening ? 0 : SOCK_NONBLOCK), rp->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        if (listening) {
+            int enable = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+            if (bind(fd, rp->ai_addr, rp->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+                break;
+            }
+        } else {
+            // results are sent in batches already
+            int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            if (connect_fd(fd, rp->ai_addr, rp->ai_addrlen)) {
+                break;
+            }
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    return fd;
+}
+
+/*
+ * Writes all len bytes of buffer to fd. Returns 1 on success, else 0.
+ */
+static int send_all(int fd, const void* buffer, size_t len) {
+    const char* cur = buffer;
+
+    while (len > 0) {
+        ssize_t n = send(fd, cur, len, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // the socket is non-blocking so we stop waiting once we're stopping
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_fd(fd, POLLOUT, COLLECTOR_SEND_TIMEOUT * 1000) == 1) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        cur += n;
+        len -= n;
+    }
+
+    return 1;
+}
+
+int collector_agent_init(const logger_t* logger, const char* endpoint, const char* name) {
+    char hostname[256];
+
+    if (name == NULL) {
+        if (gethostname(hostname, sizeof(hostname)) < 0) {
+            strcpy(hostname, "srd");
+        }
+        hostname[sizeof(hostname) - 1] = '\0';
+        name = hostname;
+    }
+
+    if (strlen(name) > UINT8_MAX) {
+        print_error(logger, "agent_name is longer than %d characters\n", UINT8_MAX);
+        return 0;
+    }
+
+    queue = malloc(COLLECTOR_QUEUE_SIZE * sizeof(collector_record_t));
+    agent_endpoint = strdup(endpoint);
+    agent_name = strdup(name);
+
+    // the collector restarts the sequence with a new session
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    agent_session = (uint32_t) now.tv_nsec ^ (uint32_t) now.tv_sec ^ ((uint32_t) getpid() << 16);
+
+    print_info(logger, "Sending results as agent %s to collector %s\n", agent_name, agent_endpoint);
+
+    return 1;
+}
+
+void collector_submit(const connectivity_check_t* check, const struct timespec* time) {
+    if (queue == NULL || check->sockaddr == NULL) {
+        return;
+    }
+
+    collector_record_t record;
+    memset(&record, 0, sizeof(record));
+
+    if (check->sockaddr->ss_family == AF_INET) {
+        record.family = AF_INET;
+        memcpy(record.address, &((struct sockaddr_in*) check->sockaddr)->sin_addr, 4);
+    } else if (check->sockaddr->ss_family == AF_INET6) {
+        record.family = AF_INET6;
+        memcpy(record.address, &((struct sockaddr_in6*) check->sockaddr)->sin6_addr, 16);
+    } else {
+        // unresolved hostname
+        return;
+    }
+
+    record.latency_us = htonl(check->latency >= 0 ? (uint32_t) (check->latency * 1e6) : UINT32_MAX);
+    record.timestamp_ms = htobe64((uint64_t) time->tv_sec * 1000 + time->tv_nsec / 1000000);
+    record.state = check->state;
+
+    pthread_mutex_lock(&queue_mut);
+
+    // drop the oldest result if the collector is not reachable for long
+    if (queue_next - queue_first == COLLECTOR_QUEUE_SIZE) {
+        queue_first++;
+        queue_dropped++;
+    }
+    record.sequence = htonl(queue_next);
+    queue[queue_next % COLLECTOR_QUEUE_SIZE] = record;
+    queue_next++;
+
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mut);
+}
+
+/*
+ * Waits up to seconds or until we stop. queue_mut must be locked.
+ */
+static void wait_queue(int seconds) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += seconds;
+
+    pthread_cond_timedwait(&queue_cond, &queue_mut, &until);
+}
+
+/*
+ * Reads the acknowledgements of the collector without blocking.
+ * Returns 0 if the connection is closed, else 1.
+ */
+static int read_acks(int fd, char* ack_buffer, size_t* ack_length) {
+    while (1) {
+        ssize_t n = recv(fd, ack_buffer + *ack_length, sizeof(uint32_t) - *ack_length, MSG_DONTWAIT);
+
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        *ack_length += n;
+        if (*ack_length < sizeof(uint32_t)) {
+            continue;
+        }
+        *ack_length = 0;
+
+        uint32_t ack;
+        memcpy(&ack, ack_buffer, sizeof(ack));
+        ack = ntohl(ack);
+
+        // everything up to ack is stored by the collector
+        pthread_mutex_lock(&queue_mut);
+        if (SEQUENCE_AFTER(ack + 1, queue_first) && !SEQUENCE_AFTER(ack + 1, queue_next)) {
+            queue_first = ack + 1;
+        }
+        pthread_mutex_unlock(&queue_mut);
+    }
+}
+
+void* collector_agent_run(void* arg) {
+    const logger_t* logger = arg;
+
+    collector_record_t* batch = malloc(COLLECTOR_BATCH * sizeof(collector_record_t));
+    char ack_buffer[sizeof(uint32_t)];
+    size_t ack_length = 0;
+
+    int fd = -1;
+    int backoff = 1;
+    uint32_t sent = 0;
+    uint64_t reported_dropped = 0;
+
+    while (running) {
+        if (fd < 0) {
+            fd = open_endpoint(logger, agent_endpoint, 0);
+
+            collector_hello_t hello = { .version = COLLECTOR_VERSION, .name_length = strlen(agent_name), .session = htonl(agent_session) };
+            memcpy(hello.magic, COLLECTOR_MAGIC, sizeof(hello.magic));
+
+            if (fd < 0 || !send_all(fd, &hello, sizeof(hello)) || !send_all(fd, agent_name, hello.name_length)) {
+                sprint_debug(logger, "Unable to connect to collector %s. Retry in %d s\n", agent_endpoint, backoff);
+                if (fd >= 0) {
+                    close(fd);
+                    fd = -1;
+                }
+
+                pthread_mutex_lock(&queue_mut);
+                if (running) {
+                    wait_queue(backoff);
+                }
+                pthread_mutex_unlock(&queue_mut);
+
+                backoff = backoff * 2 > COLLECTOR_RECONNECT_MAX ? COLLECTOR_RECONNECT_MAX : backoff * 2;
+                continue;
+            }
+            sprint_info(logger, "Connected to collector %s\n", agent_endpoint);
+            backoff = 1;
+            ack_length = 0;
+
+            // resend everything not acknowledged
+            pthread_mutex_lock(&queue_mut);
+            sent = queue_first;
+            pthread_mutex_unlock(&queue_mut);
+        }
+
+        pthread_mutex_lock(&queue_mut);
+        if (running && sent == queue_next) {
+            // wake up regularly to read the acknowledgements
+            wait_queue(1);
+        }
+
+        // the oldest results were dropped
+        if (SEQUENCE_AFTER(queue_first, sent)) {
+            sent = queue_first;
+        }
+
+        uint32_t count = queue_next - sent;
+        if (count > COLLECTOR_BATCH) {
+            count = COLLECTOR_BATCH;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            batch[i] = queue[(sent + i) % COLLECTOR_QUEUE_SIZE];
+        }
+
+        uint64_t dropped = queue_dropped;
+        pthread_mutex_unlock(&queue_mut);
+
+        if (dropped != reported_dropped) {
+            sprint_error(logger, "Collector not reachable: dropped %lu results so far\n", (unsigned long) dropped);
+            reported_dropped = dropped;
+        }
+
+        if ((count > 0 && !send_all(fd, batch, count * sizeof(collector_record_t))) ||
+            !read_acks(fd, ack_buffer, &ack_length))
+        {
+            sprint_error(logger, "Lost connection to collector %s\n", agent_endpoint);
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        sent += count;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(batch);
+
+    return NULL;
+}
+
+/*
+ * Compares the address of check with family and address (as in collector_record_t).
+ */
+static int compare_address(const connectivity_check_t* check, const int family, const uint8_t* address) {
+    const struct sockaddr_storage* addr = check->sockaddr;
+
+    if (addr->ss_family != family) {
+        return addr->ss_family < family ? -1 : 1;
+    }
+    if (family == AF_INET) {
+        return memcmp(&((struct sockaddr_in*) addr)->sin_addr, address, 4);
+    }
+
+    return memcmp(&((struct sockaddr_in6*) addr)->sin6_addr, address, 16);
+}
+
+static int compare_collected(const void* a, const void* b) {
+    const connectivity_check_t* x = *(connectivity_check_t* const*) a;
+    const connectivity_check_t* y = *(connectivity_check_t* const*) b;
+    const struct sockaddr_storage* addr = y->sockaddr;
+
+    const uint8_t* address = addr->ss_family == AF_INET
+        ? (const uint8_t*) &((struct sockaddr_in*) addr)->sin_addr
+        : (const uint8_t*) &((struct sockaddr_in6*) addr)->sin6_addr;
+
+    return compare_address(x, addr->ss_family, address);
+}
+
+int collector_listen_init(const logger_t* logger, const char* endpoint, connectivity_check_t** checks, const int n) {
+    listen_fd = open_endpoint(logger, endpoint, 1);
+
+    if (listen_fd < 0) {
+        print_error(logger, "Unable to listen on %s: %s\n", endpoint, strerror(errno));
+        return 0;
+    }
+    if (endpoint[0] == '/') {
+        listen_path = strdup(endpoint);
+    }
+
+    listen_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(listen_epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+    // ends the wait once we're stopping
+    event.data.ptr = &stop_fd;
+    epoll_ctl(listen_epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
+
+    // the checks whose state is reported by the agents
+    collected_checks = malloc(n * sizeof(connectivity_check_t*));
+    for (int i = 0; i < n; i++) {
+        if (checks[i]->flags & FLAG_IS_COLLECTED) {
+            checks[i]->collected = calloc(1, sizeof(collected_t));
+            collected_checks[collected_count++] = checks[i];
+        }
+    }
+
+    // the records are matched by address; there may be many targets
+    qsort(collected_checks, collected_count, sizeof(connectivity_check_t*), compare_collected);
+
+    print_info(logger, "Collecting results of agents on %s for %d targets\n", endpoint, collected_count);
+
+    return 1;
+}
+
+/*
+ * Returns the index of the agent called name and starts its new session.
+ * collector_mut must be locked.
+ */
+static int get_agent(const char* name, uint32_t session) {
+    int idx;
+
+    for (idx = 0; idx < agents_count; idx++) {
+        if (strcmp(agents[idx].name, name) == 0) {
+            break;
+        }
+    }
+
+    if (idx == agents_count) {
+        agents = realloc(agents, (agents_count + 1) * sizeof(agent_t));
+        memset(&agents[idx], 0, sizeof(agent_t));
+        strcpy(agents[idx].name, name);
+        agents[idx].session = session + 1;
+        agents_count++;
+    }
+
+    // the agent restarted: its sequence starts at 1
+    if (agents[idx].session != session) {
+        agents[idx].session = session;
+        agents[idx].last_sequence = 0;
+    }
+
+    return idx;
+}
+
+/*
+ * Returns the collected check with the address of record or NULL.
+ * collected_checks is sorted by address.
+ */
+static connectivity_check_t* get_collected(const collector_record_t* record) {
+    int low = 0;
+    int high = collected_count;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        int c = compare_address(collected_checks[mid], record->family, record->address);
+
+        if (c == 0) {
+            return collected_checks[mid];
+        } else if (c < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Stores the result in record of agent. collector_mut must be locked.
+ */
+static void process_record(int agent, const collector_record_t* record) {
+    agent_t* a = &agents[agent];
+    uint32_t sequence = ntohl(record->sequence);
+
+    // resent after a reconnect
+    if (!SEQUENCE_AFTER(sequence, a->last_sequence)) {
+        duplicates++;
+        return;
+    }
+    a->last_sequence = sequence;
+
+    connectivity_check_t* check = get_collected(record);
+    if (check == NULL) {
+        unknown++;
+        return;
+    }
+
+    collected_t* collected = check->collected;
+    if (agent >= collected->count) {
+        collected->reports = realloc(collected->reports, agents_count * sizeof(report_t));
+        memset(&collected->reports[collected->count], 0, (agents_count - collected->count) * sizeof(report_t));
+        collected->count = agents_count;
+    }
+
+    uint64_t timestamp_ms = be64toh(record->timestamp_ms);
+    uint32_t latency_us = ntohl(record->latency_us);
+    report_t* report = &collected->reports[agent];
+
+    // results of one agent may not overtake each other
+    struct timespec time = { .tv_sec = timestamp_ms / 1000, .tv_nsec = (timestamp_ms % 1000) * 1000000 };
+    if (report->valid && calculate_difference(report->time, time) < 0) {
+        return;
+    }
+
+    report->valid = 1;
+    report->state = record->state;
+    report->latency = latency_us == UINT32_MAX ? -1.0 : latency_us / 1e6;
+    report->time = time;
+}
+
+static void close_connection(const logger_t* logger, connection_t* connection) {
+    if (connection->agent >= 0) {
+        pthread_mutex_lock(&collector_mut);
+        sprint_info(logger, "Agent %s disconnected\n", agents[connection->agent].name);
+        pthread_mutex_unlock(&collector_mut);
+    }
+
+    if (connection->prev != NULL) {
+        connection->prev->next = connection->next;
+    } else {
+        connections = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->prev = connection->prev;
+    }
+
+    epoll_ctl(listen_epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection);
+}
+
+/*
+ * Processes the received bytes of connection. Returns 0 if it has to be closed.
+ */
+static int receive(const logger_t* logger, connection_t* connection) {
+    ssize_t n = recv(connection->fd, connection->buffer + connection->length, sizeof(connection->buffer) - connection->length, MSG_DONTWAIT);
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return 1;
+    }
+    if (n <= 0) {
+        return 0;
+    }
+    connection->length += n;
+
+    size_t offset = 0;
+
+    if (connection->agent < 0) {
+        collector_hello_t hello;
+
+        if (connection->length < sizeof(hello)) {
+            return 1;
+        }
+        memcpy(&hello, connection->buffer, sizeof(hello));
+
+        if (memcmp(hello.magic, COLLECTOR_MAGIC, sizeof(hello.magic)) != 0 || hello.version != COLLECTOR_VERSION) {
+            sprint_error(logger, "Connection is not from an agent of this version of srd\n");
+            return 0;
+        }
+        if (connection->length < sizeof(hello) + hello.name_length) {
+            return 1;
+        }
+
+        char name[256];
+        memcpy(name, connection->buffer + sizeof(hello), hello.name_length);
+        name[hello.name_length] = '\0';
+
+        pthread_mutex_lock(&collector_mut);
+        connection->agent = get_agent(name, ntohl(hello.session));
+        pthread_mutex_unlock(&collector_mut);
+
+        sprint_info(logger, "Agent %s connected\n", name);
+        offset = sizeof(hello) + hello.name_length;
+    }
+
+    size_t count = (connection->length - offset) / sizeof(collector_record_t);
+
+    if (count > 0) {
+        pthread_mutex_lock(&collector_mut);
+        for (size_t i = 0; i < count; i++) {
+            collector_record_t record;
+            memcpy(&record, connection->buffer + offset + i * sizeof(record), sizeof(record));
+
+            process_record(connection->agent, &record);
+        }
+        uint32_t ack = htonl(agents[connection->agent].last_sequence);
+        pthread_mutex_unlock(&collector_mut);
+
+        // the agent may drop what we acknowledge
+        if (send(connection->fd, &ack, sizeof(ack), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(ack)) {
+            return 0;
+        }
+        offset += count * sizeof(collector_record_t);
+    }
+
+    // keep the incomplete rest for the next read
+    memmove(connection->buffer, connection->buffer + offset, connection->length - offset);
+    connection->length -= offset;
+
+    return 1;
+}
+
+void* collector_listen_run(void* arg) {
+    const logger_t* logger = arg;
+    struct epoll_event events[64];
+
+    uint64_t reported_duplicates = 0;
+    uint64_t reported_unknown = 0;
+
+    while (running) {
+        int num_ready = epoll_wait(listen_epoll_fd, events, 64, 1000);
+
+        if (num_ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            sprint_error(logger, "Unable to wait for agents: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < num_ready && running; i++) {
+            connection_t* connection = events[i].data.ptr;
+
+            // we're stopping
+            if (events[i].data.ptr == &stop_fd) {
+                break;
+            }
+
+            // new agent
+            if (connection == NULL) {
+                int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    continue;
+                }
+
+                connection = calloc(1, sizeof(connection_t));
+                connection->fd = fd;
+                connection->agent = -1;
+                connection->next = connections;
+                if (connections != NULL) {
+                    connections->prev = connection;
+                }
+                connections = connection;
+
+                struct epoll_event event = { .events = EPOLLIN, .data.ptr = connection };
+                epoll_ctl(listen_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+                continue;
+            }
+
+            if (!receive(logger, connection)) {
+                close_connection(logger, connection);
+            }
+        }
+
+        pthread_mutex_lock(&collector_mut);
+        if (duplicates != reported_duplicates || unknown != reported_unknown) {
+            sprint_debug(logger, "Dropped %lu resent results and %lu results of unknown targets\n", (unsigned long) duplicates, (unsigned long) unknown);
+            reported_duplicates = duplicates;
+            reported_unknown = unknown;
+        }
+        pthread_mutex_unlock(&collector_mut);
+    }
+
+    return NULL;
+}
+
+int collector_evaluate(const logger_t* logger, connectivity_check_t* check, struct timespec* first_failed) {
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    int up = 0;
+    int down = 0;
+    double latency = 0.0;
+    int latencies = 0;
+
+    pthread_mutex_lock(&collector_mut);
+
+    collected_t* collected = check->collected;
+    for (int i = 0; collected != NULL && i < collected->count; i++) {
+        const report_t* report = &collected->reports[i];
+
+        // the agent stopped reporting this target
+        if (!report->valid || calculate_difference(report->time, now) > COLLECTOR_STALE_PERIODS * check->period) {
+            continue;
+        }
+
+        if (report->state & STATE_UP) {
+            up++;
+
+            if (report->latency >= 0) {
+                latency += report->latency;
+                latencies++;
+            }
+        } else if (report->state & STATE_DOWN) {
+            down++;
+        }
+    }
+
+    pthread_mutex_unlock(&collector_mut);
+
+    check->latency = latencies > 0 ? latency / latencies : -1.0;
+
+    if (up + down == 0) {
+        sprint_debug(logger, "No agent reported this target recently\n");
+        return -1;
+    }
+
+    sprint_debug(logger, "%d agents report UP, %d report DOWN\n", up, down);
+
+    if (down >= check->quorum) {
+        *first_failed = now;
+        return 0;
+    }
+
+    return 1;
+}
+
+void collector_stop() {
+    pthread_mutex_lock(&queue_mut);
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_mut);
+}
+
+void collector_close() {
+    free(queue);
+    free(agent_endpoint);
+    free(agent_name);
+    queue = NULL;
+    agent_endpoint = NULL;
+    agent_name = NULL;
+
+    if (listen_fd < 0) {
+        return;
+    }
+
+    while (connections != NULL) {
+        connection_t* next = connections->next;
+
+        close(connections->fd);
+        free(connections);
+        connections = next;
+    }
+
+    close(listen_epoll_fd);
+    close(listen_fd);
+    listen_fd = -1;
+
+    if (listen_path != NULL) {
+        unlink(listen_path);
+        free(listen_path);
+        listen_path = NULL;
+    }
+
+    for (int i = 0; i < collected_count; i++) {
+        collected_t* collected = collected_checks[i]->collected;
+
+        free(collected->reports);
+        free(collected);
+        collected_checks[i]->collected = NULL;
+    }
+    free(collected_checks);
+    free(agents);
+}
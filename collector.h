@@ -0,0 +1,128 @@
+#ifndef SRD_COLLECTOR_H
+#define SRD_COLLECTOR_H
+
+#include <stdint.h>
+#include <time.h>
+struct timespec;
+
+#include "srd.h"
+#include "printing.h"
+
+#define COLLECTOR_MAGIC "SRDC"
+#define COLLECTOR_VERSION 1
+
+/* Maximum amount of results an agent keeps while the collector is not reachable */
+#define COLLECTOR_QUEUE_SIZE 65536
+
+/* Reports of agents older than this many periods of the collected check are ignored */
+#define COLLECTOR_STALE_PERIODS 3
+
+/*
+ * Sent by an agent once after connecting, followed by name_length bytes of its name.
+ */
+typedef struct collector_hello_t
+{
+    // COLLECTOR_MAGIC without null delimiter
+    char magic[4];
+
+    // COLLECTOR_VERSION
+    uint8_t version;
+
+    // length of the name following this header
+    uint8_t name_length;
+
+    uint16_t reserved;
+
+    // random value chosen at the start of the agent; a new session restarts the sequence
+    uint32_t session;
+} collector_hello_t;
+
+/*
+ * Result of one check of an agent. All fields are in network byte order.
+ */
+typedef struct collector_record_t
+{
+    // increases by one for each record of a session; used to drop duplicates
+    uint32_t sequence;
+
+    // latency in microseconds; UINT32_MAX if the target was not reachable
+    uint32_t latency_us;
+
+    // time of the check (unix timestamp in ms)
+    uint64_t timestamp_ms;
+
+    // conn_state_t of the target
+    uint8_t state;
+
+    // AF_INET or AF_INET6
+    uint8_t family;
+
+    uint16_t reserved;
+
+    // target IP address; IPv4 uses the first 4 bytes
+    uint8_t address[16];
+
+    uint32_t reserved2;
+} collector_record_t;
+
+_Static_assert(sizeof(collector_hello_t) == 12, "collector_hello_t must have 12 bytes");
+_Static_assert(sizeof(collector_record_t) == 40, "collector_record_t must have 40 bytes");
+
+/*
+ * The collector acknowledges the records it processed by sending the
+ * sequence (uint32_t, network byte order) of the latest one.
+ * Agents resend all records not acknowledged after reconnecting.
+ */
+
+/*
+ * Agent: prepares sending the results of all checks to the collector at
+ * endpoint ("HOST:PORT", "[IPv6]:PORT" or the path of a unix socket).
+ * Returns 1 on success, else 0.
+ */
+int collector_agent_init(const logger_t* logger, const char* endpoint, const char* name);
+
+/*
+ * Agent: queues the current result of check for the collector. Never blocks
+ * on the network; the oldest results are dropped if the queue is full.
+ */
+void collector_submit(const connectivity_check_t* check, const struct timespec* time);
+
+/*
+ * Agent: sends the queued results and reconnects if needed until we stop.
+ * This is run in its own thread and takes the logger as argument.
+ */
+void* collector_agent_run(void* logger);
+
+/*
+ * Collector: listens on endpoint for agents. Their results are the state
+ * of the checks with FLAG_IS_COLLECTED.
+ * Returns 1 on success, else 0.
+ */
+int collector_listen_init(const logger_t* logger, const char* endpoint, connectivity_check_t** checks, const int n);
+
+/*
+ * Collector: receives results of agents until we stop.
+ * This is run in its own thread and takes the logger as argument.
+ */
+void* collector_listen_run(void* logger);
+
+/*
+ * Collector: evaluates the latest results of all agents for check.
+ * The target is DOWN if at least `quorum` agents report it DOWN.
+ * Returns 1 if it is reachable, 0 if not (and sets first_failed) and
+ * -1 if no agent reported it recently.
+ */
+int collector_evaluate(const logger_t* logger, connectivity_check_t* check, struct timespec* first_failed);
+
+/*
+ * Wakes the thread of the agent so it notices we stop.
+ */
+void collector_stop();
+
+/*
+ * Closes all sockets of the agent and the collector and frees their state.
+ * The threads must have ended.
+ */
+void collector_close();
+
+#endif
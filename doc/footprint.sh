@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Measures the footprint of a srd build as in the table of the README: the
+# startup time until all checks are started, then RSS and virtual memory
+# after a few seconds of pinging. The config has TARGETS loopback targets,
+# probe_threads = 1 and action_workers = 1.
+#
+# Usage:
+#   doc/footprint.sh ./srd [TARGETS]
+#   doc/footprint.sh ./srd-embedded 50
+#
+# Unprivileged users need net.ipv4.ping_group_range to include their group.
+#
+
+set -e
+
+binary=$1
+targets=${2:-50}
+
+if [ ! -x "$binary" ]; then
+    echo "usage: $0 BINARY [TARGETS]" >&2
+    exit 1
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+destinations=""
+for i in $(seq 1 $targets); do
+    destinations="$destinations${destinations:+,}127.0.$((i / 250)).$((i % 250 + 1))"
+done
+
+cat > "$dir/srd.conf" <<EOF
+loglevel = "INFO"
+probe_threads = 1
+action_workers = 1
+state_file = "$dir/srd.state"
+journal_file = "$dir/srd.journal"
+state_table = "/srd-footprint-$$"
+
+destination = "$destinations"
+period = 1
+timeout = 1
+
+actions = (
+    { action = "log"; message = "%ip %status"; path = "$dir/srd.log"; run_if = "up-new"; },
+)
+EOF
+
+# run it on a terminal, as stdout is only line buffered there
+start=$(date +%s%N)
+script -qfec "exec $binary -c $dir" "$dir/output" > /dev/null &
+terminal=$!
+
+while ! grep -qs "Started all target checks" "$dir/output"; do
+    if ! kill -0 $terminal 2> /dev/null; then
+        cat "$dir/output" >&2
+        exit 1
+    fi
+    sleep 0.001
+done
+started=$(date +%s%N)
+pid=$(pgrep -P $terminal)
+
+# let every target be pinged a few times
+sleep 5
+
+rss=$(awk '/^VmRSS/ { print $2 }' /proc/$pid/status)
+virtual=$(awk '/^VmSize/ { print $2 }' /proc/$pid/status)
+
+kill -TERM $pid
+wait $terminal || true
+
+size=$(stat -c %s "$binary")
+
+echo "| build | size | startup | RSS | virtual memory |"
+echo "|-------|------|---------|-----|----------------|"
+awk -v binary="$binary" -v size=$size -v ms=$(((started - start) / 1000000)) -v rss=$rss -v virtual=$virtual 'BEGIN {
+    printf "| `%s` | %d KiB | ~%d ms | %.1f MiB | %.1f MiB |\n", binary, size / 1024, ms, rss / 1024, virtual / 1024
+}'
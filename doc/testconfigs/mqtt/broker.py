@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+#
+# Minimal MQTT 3.1.1 broker stand-in to test the mqtt action without a real
+# broker. It prints each packet it gets and answers CONNECT, PUBLISH (QoS 1)
+# and PINGREQ. Messages are not forwarded to anyone.
+#
+# Usage: broker.py [port] [address] [drop_after] [noack]
+#   drop_after: closes the connection after this many PUBLISH packets (0: never)
+#   noack: never acknowledges PUBLISH with QoS 1, so srd sends them again
+#          with the dup flag after reconnecting
+#
+
+import socket
+import sys
+import threading
+
+port = int(sys.argv[1]) if len(sys.argv) > 1 else 1883
+address = sys.argv[2] if len(sys.argv) > 2 else "127.0.0.1"
+drop_after = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+noack = len(sys.argv) > 4 and sys.argv[4] == "noack"
+
+count = 0
+lock = threading.Lock()
+
+
+def read(conn, n):
+    data = b""
+    while len(data) < n:
+        part = conn.recv(n - len(data))
+        if not part:
+            raise EOFError
+        data += part
+    return data
+
+
+def handle(conn):
+    global count
+    try:
+        while True:
+            header = read(conn, 1)[0]
+
+            # remaining length
+            length = 0
+            multiplier = 1
+            while True:
+                digit = read(conn, 1)[0]
+                length += (digit & 127) * multiplier
+                multiplier *= 128
+                if not digit & 128:
+                    break
+
+            body = read(conn, length)
+            kind = header & 0xF0
+
+            if kind == 0x10:
+                flags = body[7]
+                keepalive = body[8] << 8 | body[9]
+                id_length = body[10] << 8 | body[11]
+                client_id = body[12:12 + id_length].decode()
+                print(f"CONNECT id={client_id} flags={flags:#x} keepalive={keepalive}", flush=True)
+                conn.sendall(bytes([0x20, 2, 1, 0]))
+            elif kind == 0x30:
+                qos = (header >> 1) & 3
+                topic_length = body[0] << 8 | body[1]
+                topic = body[2:2 + topic_length].decode()
+                offset = 2 + topic_length
+                packet_id = None
+                if qos:
+                    packet_id = body[offset] << 8 | body[offset + 1]
+                    offset += 2
+                print(f"PUBLISH dup={(header >> 3) & 1} qos={qos} retain={header & 1} id={packet_id} "
+                      f"{topic} {body[offset:].decode()}", flush=True)
+
+                if qos and not noack:
+                    conn.sendall(bytes([0x40, 2, packet_id >> 8, packet_id & 255]))
+
+                with lock:
+                    count += 1
+                    drop = drop_after and count % drop_after == 0
+                if drop:
+                    print("dropping the connection", flush=True)
+                    conn.close()
+                    return
+            elif kind == 0xC0:
+                print("PINGREQ", flush=True)
+                conn.sendall(bytes([0xD0, 0]))
+            elif kind == 0xE0:
+                print("DISCONNECT", flush=True)
+    except (EOFError, OSError):
+        print("connection closed", flush=True)
+
+
+server = socket.socket(socket.AF_INET6 if ":" in address else socket.AF_INET)
+server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+server.bind((address, port))
+server.listen()
+print(f"listening on {address} port {port}", flush=True)
+
+while True:
+    conn, _ = server.accept()
+    threading.Thread(target=handle, args=(conn,), daemon=True).start()
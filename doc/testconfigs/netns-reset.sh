@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Network namespace to test the interface-reset action without bouncing an
+# interface of the host. The namespace srd-reset has the interface lan0
+# (10.73.0.2), a veth pair to lan0-host (10.73.0.1) on the host. The target
+# is 10.73.0.3, a second address of lan0-host.
+#
+# Usage (as root):
+#   netns-reset.sh up           creates the namespace
+#   ip netns exec srd-reset srd -c doc/testconfigs/reset
+#   netns-reset.sh target-down  the target stops answering; the carrier stays
+#   netns-reset.sh target-up    the target answers again
+#   netns-reset.sh peer-down    takes lan0-host down: after a reset the carrier
+#                               does not return and the action times out
+#   netns-reset.sh peer-up      brings lan0-host up again
+#   netns-reset.sh down         removes the namespace
+#
+
+set -e
+
+ns=srd-reset
+
+case "$1" in
+    up)
+        ip netns add $ns
+        ip -n $ns link set lo up
+
+        # srd pings through unprivileged ICMP sockets
+        ip netns exec $ns sysctl -qw net.ipv4.ping_group_range="0 2147483647"
+
+        ip link add lan0-host type veth peer name lan0 netns $ns
+        ip addr add 10.73.0.1/24 dev lan0-host
+        ip addr add 10.73.0.3/24 dev lan0-host
+        ip link set lan0-host up
+        ip -n $ns addr add 10.73.0.2/24 dev lan0
+        ip -n $ns link set lan0 up
+
+        # srd waits for a default gateway before it starts; the kernel
+        # removes it when lan0 goes down, which the target does not need
+        ip -n $ns route add default via 10.73.0.1 dev lan0
+        ;;
+    target-down)
+        ip addr del 10.73.0.3/24 dev lan0-host
+        ;;
+    target-up)
+        ip addr add 10.73.0.3/24 dev lan0-host
+        ;;
+    peer-down)
+        ip link set lan0-host down
+        ;;
+    peer-up)
+        ip link set lan0-host up
+        ;;
+    down)
+        # removing the namespace removes the veth pair as well
+        ip netns del $ns
+        ;;
+    *)
+        echo "Usage: $0 up|target-down|target-up|peer-down|peer-up|down"
+        exit 1
+        ;;
+esac
@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Network namespace to test the route action without touching the routes of
+# the host. The namespace srd-route has two uplinks, each a veth pair to the
+# host: wan1 (10.71.0.2, gateway 10.71.0.1) and wan2 (10.72.0.2, gateway
+# 10.72.0.1). Its default route goes through wan1 with metric 100. The target
+# 10.70.0.1 is an address of the host which is always pinged through wan1,
+# so it tells whether wan1 works while the default route is switched.
+#
+# Usage (as root):
+#   netns-route.sh up         creates the namespace
+#   ip netns exec srd-route srd -c doc/testconfigs/route
+#   netns-route.sh fail       takes the host side of wan1 down: no carrier
+#   netns-route.sh recover    brings it up again
+#   netns-route.sh show       prints the routes of the namespace
+#   netns-route.sh down       removes the namespace
+#
+
+set -e
+
+ns=srd-route
+
+case "$1" in
+    up)
+        ip netns add $ns
+        ip -n $ns link set lo up
+
+        # srd pings through unprivileged ICMP sockets
+        ip netns exec $ns sysctl -qw net.ipv4.ping_group_range="0 2147483647"
+
+        for i in 1 2; do
+            ip link add wan$i-host type veth peer name wan$i netns $ns
+            ip addr add 10.7$i.0.1/24 dev wan$i-host
+            ip link set wan$i-host up
+            ip -n $ns addr add 10.7$i.0.2/24 dev wan$i
+            ip -n $ns link set wan$i up
+        done
+
+        ip addr add 10.70.0.1/32 dev wan1-host
+        ip -n $ns route add default via 10.71.0.1 dev wan1 metric 100
+        ip -n $ns route add 10.70.0.1/32 via 10.71.0.1 dev wan1
+        ;;
+    fail)
+        ip link set wan1-host down
+        ;;
+    recover)
+        ip link set wan1-host up
+        ;;
+    show)
+        ip -n $ns route show table all | grep -v "^local\|^broadcast\|^multicast\|fe80\|ff00"
+        ;;
+    down)
+        # removing the namespace removes the veth pairs as well
+        ip netns del $ns
+        ;;
+    *)
+        echo "Usage: $0 up|fail|recover|show|down"
+        exit 1
+        ;;
+esac
@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Creates a CA and a server certificate for 127.0.0.1 and localhost signed by
+# it in the directory $1 (default: the current one), and a second CA which
+# did not sign it to check that srd rejects the server with it:
+#   ca.pem, ca.key      CA for http_ca_file
+#   server.pem, server.key  certificate and key for server.py
+#   other.pem           unrelated CA
+#
+
+set -e
+
+dir=${1:-.}
+mkdir -p "$dir"
+cd "$dir"
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 30 -subj "/CN=srd test CA" \
+    -keyout ca.key -out ca.pem 2> /dev/null
+
+openssl req -newkey rsa:2048 -nodes -subj "/CN=localhost" \
+    -keyout server.key -out server.csr 2> /dev/null
+
+echo "subjectAltName = IP:127.0.0.1, DNS:localhost" > server.ext
+openssl x509 -req -in server.csr -CA ca.pem -CAkey ca.key -CAcreateserial -days 30 \
+    -extfile server.ext -out server.pem 2> /dev/null
+rm -f server.csr server.ext ca.srl
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 30 -subj "/CN=other CA" \
+    -keyout other.key -out other.pem 2> /dev/null
+rm -f other.key
+
+echo "created ca.pem, server.pem, server.key and other.pem in $dir"
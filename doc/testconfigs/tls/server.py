@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+#
+# HTTPS server stand-in for the influx and webhook actions. It answers each
+# POST with 204 and prints the TLS version, whether the session was resumed
+# and the body.
+#
+# Usage: server.py cert key [port] [address] [close] [tls12]
+#   close: closes the connection after each request, so each request needs a
+#          new handshake, which should resume an earlier session
+#   tls12: allows TLS 1.2 at most
+#
+
+import http.server
+import socketserver
+import ssl
+import sys
+import threading
+
+cert = sys.argv[1]
+key = sys.argv[2]
+port = int(sys.argv[3]) if len(sys.argv) > 3 else 8443
+address = sys.argv[4] if len(sys.argv) > 4 else "127.0.0.1"
+close = "close" in sys.argv[5:]
+tls12 = "tls12" in sys.argv[5:]
+
+lock = threading.Lock()
+count = 0
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):
+        global count
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        with lock:
+            count += 1
+            n = count
+        print(f"{n} port={self.client_address[1]} {self.connection.version()} "
+              f"resumed={self.connection.session_reused} {self.path} {body!r}", flush=True)
+
+        self.send_response(204)
+        if close:
+            self.send_header("Connection", "close")
+            self.close_connection = True
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+    def get_request(self):
+        sock, client = self.socket.accept()
+        try:
+            return context.wrap_socket(sock, server_side=True), client
+        except (ssl.SSLError, OSError) as e:
+            print("handshake failed:", e, flush=True)
+            sock.close()
+            raise OSError(e)
+
+
+context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+context.load_cert_chain(cert, key)
+if tls12:
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+
+print(f"listening on {address} port {port}", flush=True)
+Server((address, port), Handler).serve_forever()
@@ -0,0 +1,1163 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "http.h"
+#include "printing.h"
+#include "srd.h"
+#include "tls.h"
+#include "util.h"
+
+#define HTTP_EVENTS 64
+
+typedef enum http_conn_state_t {
+    CONN_CONNECTING,
+    CONN_HANDSHAKING,
+    CONN_SENDING,
+    CONN_RECEIVING,
+    CONN_IDLE,
+} http_conn_state_t;
+
+/*
+ * States of the circuit breaker of an endpoint.
+ */
+typedef enum http_breaker_t {
+    BREAKER_CLOSED,    // requests are sent
+    BREAKER_OPEN,      // requests fail right away until the cooldown passed
+    BREAKER_HALF_OPEN, // one request tests if the endpoint recovered; the others fail
+} http_breaker_t;
+
+/*
+ * A request queued by an action.
+ */
+typedef struct http_request_t {
+    // logger of the check which queued this
+    const logger_t* logger;
+
+    http_endpoint_t* endpoint;
+
+    // header and body as sent; the body starts at body_offset
+    char* data;
+    size_t length;
+    size_t body_offset;
+
+    int timeout_ms;
+
+    // retries left and tries so far
+    int retries;
+    int tries;
+
+    // earliest time of the next try (ms of CLOCK_MONOTONIC)
+    int64_t not_before;
+
+    http_done_t done;
+    void* arg;
+
+    struct http_request_t* next;
+} http_request_t;
+
+/*
+ * A connection to an endpoint; performs one request at a time.
+ */
+typedef struct http_conn_t {
+    http_endpoint_t* endpoint;
+
+    int fd;
+    http_conn_state_t state;
+
+    // NULL unless the endpoint uses TLS
+    tls_t* tls;
+
+    // request being sent or answered; NULL if idle
+    http_request_t* request;
+    size_t sent;
+
+    char response[HTTP_RESPONSE_SIZE + 1];
+    size_t received;
+
+    // 1 if the connection performed a request before; the server may have closed it meanwhile
+    int reused;
+
+    // the request times out or the idle connection is closed at this time
+    int64_t deadline;
+
+    struct http_conn_t* next;
+} http_conn_t;
+
+struct http_endpoint_t {
+    char* host;
+    int port;
+
+    // 1 if the connections use TLS; they resume the session of the latest handshake
+    int tls;
+    tls_session_t* session;
+
+    // "host:port" as sent in the Host header
+    char authority[INET6_ADDRSTRLEN + 256];
+
+    struct sockaddr_storage sockaddr;
+
+    // 1 if host is a hostname, which is resolved again after connection errors
+    int is_hostname;
+    int resolved;
+
+    // pending lookup of host if it is a hostname; polled every RESOLVE_POLL_MS
+    struct gaicb* resolving;
+    int64_t resolve_deadline;
+
+    // requests waiting for a connection, oldest first
+    http_request_t* head;
+    http_request_t* tail;
+
+    http_conn_t* conns;
+    int conns_count;
+
+    // circuit breaker: it opens after HTTP_BREAKER_THRESHOLD consecutive failed tries
+    http_breaker_t breaker;
+    int failures;
+
+    // while open: end of the cooldown and the cooldown after the next failed test
+    int64_t breaker_until;
+    int64_t breaker_cooldown;
+
+    // 1 while the request testing the endpoint is sent (BREAKER_HALF_OPEN)
+    int testing;
+
+    struct http_endpoint_t* next;
+};
+
+static http_endpoint_t* endpoints = NULL;
+
+static const logger_t* http_logger = NULL;
+static pthread_t http_thread;
+static int started = 0;
+static int epoll_fd = -1;
+
+/* wakes the thread when requests were queued */
+static int wake_fd = -1;
+
+/* protects everything below */
+static pthread_mutex_t http_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* requests queued since the thread looked last, oldest first */
+static http_request_t* incoming_head = NULL;
+static http_request_t* incoming_tail = NULL;
+
+/* requests which are queued, sent or waiting for a retry */
+static int pending = 0;
+static int capacity = HTTP_QUEUE_SIZE;
+
+/* metrics; dropped_interval is reset when printed */
+static uint64_t succeeded = 0;
+static uint64_t failed = 0;
+static uint64_t retried = 0;
+static uint64_t rejected = 0;
+static uint64_t dropped = 0;
+static uint64_t dropped_interval = 0;
+static uint64_t handshakes = 0;
+static uint64_t resumed = 0;
+
+/* requests waiting for their retry, earliest first; only used by the thread */
+static http_request_t* delayed = NULL;
+
+#define METRICS_FORMAT "HTTP: %d pending, %lu succeeded, %lu failed, %lu retries, %lu rejected by circuit breakers, %lu dropped (%lu recently), %lu TLS handshakes (%lu resumed).\n"
+
+static int64_t now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+http_endpoint_t* http_endpoint(const char* host, int port, int tls) {
+    for (http_endpoint_t* endpoint = endpoints; endpoint != NULL; endpoint = endpoint->next) {
+        if (endpoint->port == port && endpoint->tls == tls && strcmp(endpoint->host, host) == 0) {
+            return endpoint;
+        }
+    }
+
+    http_endpoint_t* endpoint = calloc(1, sizeof(http_endpoint_t));
+    endpoint->host = strdup(host);
+    endpoint->port = port;
+    endpoint->tls = tls;
+    endpoint->session = tls ? tls_session() : NULL;
+    endpoint->breaker_cooldown = HTTP_BREAKER_COOLDOWN_MS;
+
+    // IPv6 addresses are put in brackets
+    if (strchr(host, ':') != NULL) {
+        snprintf(endpoint->authority, sizeof(endpoint->authority), "[%s]:%d", host, port);
+    } else {
+        snprintf(endpoint->authority, sizeof(endpoint->authority), "%s:%d", host, port);
+    }
+
+    endpoint->resolved = to_sockaddr(host, &endpoint->sockaddr);
+    endpoint->is_hostname = !endpoint->resolved;
+    if (endpoint->resolved) {
+        set_port(&endpoint->sockaddr, port);
+    }
+
+    endpoint->next = endpoints;
+    endpoints = endpoint;
+
+    return endpoint;
+}
+
+int http_parse_url(const char* url, char** host, int* port, char** path, int* tls) {
+    const char* start;
+    if (strncmp(url, "http://", 7) == 0) {
+        start = url + 7;
+        *tls = 0;
+    } else if (strncmp(url, "https://", 8) == 0) {
+        start = url + 8;
+        *tls = 1;
+    } else {
+        return 0;
+    }
+
+    const char* path_start = strchr(start, '/');
+    if (path_start == NULL) {
+        path_start = start + strlen(start);
+    }
+
+    const char* host_end;
+    const char* port_start = NULL;
+    if (*start == '[') {
+        // IPv6 address: [::1]:8080
+        host_end = memchr(start, ']', path_start - start);
+        if (host_end == NULL) {
+            return 0;
+        }
+        start++;
+        if (host_end[1] == ':') {
+            port_start = host_end + 2;
+        }
+    } else {
+        host_end = memchr(start, ':', path_start - start);
+        if (host_end == NULL) {
+            host_end = path_start;
+        } else {
+            port_start = host_end + 1;
+        }
+    }
+
+    if (host_end == start) {
+        return 0;
+    }
+
+    *port = *tls ? 443 : 80;
+    if (port_start != NULL) {
+        char* port_end;
+        long p = strtol(port_start, &port_end, 10);
+        if (port_end != path_start || p <= 0 || p > 65535) {
+            return 0;
+        }
+        *port = p;
+    }
+
+    *host = strndup(start, host_end - start);
+    *path = strdup(*path_start == '\0' ? "/" : path_start);
+
+    return 1;
+}
+
+static void append(http_endpoint_t* endpoint, http_request_t* request) {
+    request->next = NULL;
+    if (endpoint->tail == NULL) {
+        endpoint->head = request;
+    } else {
+        endpoint->tail->next = request;
+    }
+    endpoint->tail = request;
+}
+
+static http_request_t* pop(http_endpoint_t* endpoint) {
+    http_request_t* request = endpoint->head;
+    endpoint->head = request->next;
+    if (endpoint->head == NULL) {
+        endpoint->tail = NULL;
+    }
+
+    return request;
+}
+
+/*
+ * Ends request with status (-1 if there was no response) and frees it.
+ */
+static void finish(http_request_t* request, int status) {
+    request->done(request->logger, request->arg, request->data + request->body_offset, status);
+
+    pthread_mutex_lock(&http_mut);
+    pending--;
+    if (status >= 200 && status < 300) {
+        succeeded++;
+    } else {
+        failed++;
+    }
+    pthread_mutex_unlock(&http_mut);
+
+    free(request->data);
+    free(request);
+}
+
+/*
+ * Ends request without sending it as the circuit breaker of its endpoint is open.
+ */
+static void reject(http_request_t* request) {
+    pthread_mutex_lock(&http_mut);
+    rejected++;
+    pthread_mutex_unlock(&http_mut);
+
+    finish(request, -1);
+}
+
+/*
+ * Updates the circuit breaker of endpoint with the result of a try. It opens
+ * after HTTP_BREAKER_THRESHOLD failed tries in a row or if the request testing
+ * the endpoint failed, and closes again once a request succeeded.
+ */
+static void breaker_result(http_endpoint_t* endpoint, int ok, int64_t now) {
+    if (ok) {
+        if (endpoint->breaker != BREAKER_CLOSED) {
+            sprint_info(http_logger, "[HTTP]: %s recovered, sending requests again\n", endpoint->authority);
+        }
+        endpoint->breaker = BREAKER_CLOSED;
+        endpoint->failures = 0;
+        endpoint->breaker_cooldown = HTTP_BREAKER_COOLDOWN_MS;
+        endpoint->testing = 0;
+        return;
+    }
+
+    endpoint->failures++;
+
+    // requests sent before it opened don't count
+    if (endpoint->breaker == BREAKER_OPEN) {
+        return;
+    }
+
+    if (endpoint->breaker == BREAKER_HALF_OPEN) {
+        endpoint->breaker_cooldown *= 2;
+        if (endpoint->breaker_cooldown > HTTP_BREAKER_COOLDOWN_MAX_MS) {
+            endpoint->breaker_cooldown = HTTP_BREAKER_COOLDOWN_MAX_MS;
+        }
+    } else if (endpoint->failures < HTTP_BREAKER_THRESHOLD) {
+        return;
+    }
+
+    endpoint->breaker = BREAKER_OPEN;
+    endpoint->breaker_until = now + endpoint->breaker_cooldown;
+    endpoint->testing = 0;
+
+    sprint_error(http_logger, "[HTTP]: %s failed %d times in a row, failing its requests for %d ms\n",
+        endpoint->authority, endpoint->failures, (int) endpoint->breaker_cooldown);
+}
+
+/*
+ * Queues request again after a backoff if it has retries left, otherwise it
+ * is finished with status. Requests to an endpoint whose circuit breaker is
+ * open are finished right away.
+ */
+static void retry_or_finish(http_request_t* request, int status) {
+    if (request->retries <= 0 || !running || request->endpoint->breaker == BREAKER_OPEN) {
+        finish(request, status);
+        return;
+    }
+    request->retries--;
+
+    int shift = request->tries > 1 ? request->tries - 1 : 0;
+    int64_t backoff = shift < 16 ? (int64_t) HTTP_BACKOFF_MS << shift : HTTP_BACKOFF_MAX_MS;
+    if (backoff > HTTP_BACKOFF_MAX_MS) {
+        backoff = HTTP_BACKOFF_MAX_MS;
+    }
+    request->not_before = now_ms() + backoff;
+
+    sprint_info(request->logger, "[HTTP]: Retrying the request to %s in %d ms (%d retries left)\n",
+        request->endpoint->authority, (int) backoff, request->retries);
+
+    // keep the delayed requests sorted by their time
+    http_request_t** next = &delayed;
+    while (*next != NULL && (*next)->not_before <= request->not_before) {
+        next = &(*next)->next;
+    }
+    request->next = *next;
+    *next = request;
+
+    pthread_mutex_lock(&http_mut);
+    retried++;
+    pthread_mutex_unlock(&http_mut);
+}
+
+/*
+ * Ends all requests waiting for a connection to endpoint, f.ex. as its
+ * hostname could not be resolved. Counts as one failed try.
+ */
+static void fail_waiting(http_endpoint_t* endpoint, int64_t now) {
+    breaker_result(endpoint, 0, now);
+
+    while (endpoint->head != NULL) {
+        retry_or_finish(pop(endpoint), -1);
+    }
+}
+
+static void watch(http_conn_t* conn, uint32_t events) {
+    struct epoll_event event = { .events = events, .data.ptr = conn };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+static void close_conn(http_conn_t* conn) {
+    http_endpoint_t* endpoint = conn->endpoint;
+
+    http_conn_t** next = &endpoint->conns;
+    while (*next != conn) {
+        next = &(*next)->next;
+    }
+    *next = conn->next;
+    endpoint->conns_count--;
+
+    if (conn->tls != NULL) {
+        tls_close(conn->tls);
+    }
+
+    // closing removes it from the epoll set as well
+    close(conn->fd);
+    free(conn);
+}
+
+/*
+ * Closes conn after an error. Its request is tried again on another
+ * connection if conn was reused and closed by the server before it answered,
+ * otherwise it is retried after a backoff or finished.
+ */
+static void fail_conn(http_conn_t* conn, const char* reason, int closed, int64_t now) {
+    http_endpoint_t* endpoint = conn->endpoint;
+    http_request_t* request = conn->request;
+
+    int stale = closed && conn->reused && conn->received == 0;
+
+    // reason may be kept by the TLS state of conn, which is freed with it
+    char reason_copy[256];
+    snprintf(reason_copy, sizeof(reason_copy), "%s", reason);
+
+    // the address of a hostname may have changed
+    if (conn->state == CONN_CONNECTING && endpoint->is_hostname) {
+        endpoint->resolved = 0;
+    }
+
+    close_conn(conn);
+
+    if (request == NULL) {
+        return;
+    }
+
+    if (stale) {
+        request->next = endpoint->head;
+        endpoint->head = request;
+        if (endpoint->tail == NULL) {
+            endpoint->tail = request;
+        }
+        request->tries--;
+
+        // it is sent again, even if it was testing the endpoint
+        endpoint->testing = 0;
+
+        return;
+    }
+
+    sprint_error(request->logger, "[HTTP]: Request to %s failed: %s\n", endpoint->authority, reason_copy);
+    breaker_result(endpoint, 0, now);
+    retry_or_finish(request, -1);
+}
+
+/*
+ * send and recv on conn, through TLS if the endpoint uses it.
+ */
+static ssize_t conn_send(http_conn_t* conn, const char* data, size_t length) {
+    if (conn->tls != NULL) {
+        return tls_send(conn->tls, data, length);
+    }
+    return send(conn->fd, data, length, MSG_NOSIGNAL);
+}
+
+static ssize_t conn_recv(http_conn_t* conn, char* buffer, size_t length) {
+    if (conn->tls != NULL) {
+        return tls_recv(conn->tls, buffer, length);
+    }
+    return recv(conn->fd, buffer, length, 0);
+}
+
+/*
+ * Returns the reason of the latest error of conn_send or conn_recv.
+ */
+static const char* conn_error(http_conn_t* conn) {
+    if (conn->tls != NULL && errno == EPROTO) {
+        return tls_error(conn->tls);
+    }
+    return strerror(errno);
+}
+
+static void send_request(http_conn_t* conn, int64_t now) {
+    http_request_t* request = conn->request;
+
+    while (conn->sent < request->length) {
+        ssize_t n = conn_send(conn, request->data + conn->sent, request->length - conn->sent);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return; // wait for EPOLLOUT
+            }
+            fail_conn(conn, conn_error(conn), errno == EPIPE || errno == ECONNRESET, now);
+            return;
+        }
+        conn->sent += n;
+    }
+
+    conn->state = CONN_RECEIVING;
+    watch(conn, EPOLLIN);
+}
+
+static void start_request(http_conn_t* conn, http_request_t* request, int64_t now) {
+    conn->request = request;
+    conn->sent = 0;
+    conn->received = 0;
+    conn->deadline = now + request->timeout_ms;
+    request->tries++;
+
+    if (conn->state == CONN_IDLE) {
+        conn->state = CONN_SENDING;
+        watch(conn, EPOLLOUT);
+        send_request(conn, now);
+    }
+}
+
+/*
+ * Returns the value of the header name in the header block of a response or
+ * NULL. The value ends at "\r\n".
+ */
+static const char* header_value(const char* headers, const char* end, const char* name) {
+    size_t name_length = strlen(name);
+
+    // skip the status line
+    const char* line = strstr(headers, "\r\n");
+
+    while (line != NULL && line < end) {
+        line += 2;
+        if (strncasecmp(line, name, name_length) == 0 && line[name_length] == ':') {
+            const char* value = line + name_length + 1;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return NULL;
+}
+
+/*
+ * Checks the response received on conn. Returns the status once the response
+ * is complete, 0 while more is needed and -1 if it is invalid. keep_alive is
+ * set if the connection may be used for the next request. Responses longer
+ * than HTTP_RESPONSE_SIZE are cut off; their connection is closed.
+ */
+static int parse_response(http_conn_t* conn, int closed, int* keep_alive) {
+    conn->response[conn->received] = '\0';
+    int full = conn->received >= HTTP_RESPONSE_SIZE;
+
+    char* headers_end = strstr(conn->response, "\r\n\r\n");
+    if (headers_end == NULL) {
+        return closed || full ? -1 : 0;
+    }
+
+    int minor;
+    int status;
+    if (sscanf(conn->response, "HTTP/1.%d %d", &minor, &status) != 2 || status < 100) {
+        return -1;
+    }
+
+    const char* connection = header_value(conn->response, headers_end, "Connection");
+    *keep_alive = minor >= 1 && !closed && !(connection != NULL && strncasecmp(connection, "close", 5) == 0);
+
+    const char* body = headers_end + 4;
+    size_t body_length = conn->received - (body - conn->response);
+
+    const char* content_length = header_value(conn->response, headers_end, "Content-Length");
+    const char* encoding = header_value(conn->response, headers_end, "Transfer-Encoding");
+
+    int complete;
+    if (status == 204 || status == 304) {
+        complete = 1;
+    } else if (content_length != NULL) {
+        complete = body_length >= strtoul(content_length, NULL, 10);
+    } else if (encoding != NULL && strncasecmp(encoding, "chunked", 7) == 0) {
+        // the last chunk is empty; trailers are not supported
+        complete = body_length >= 5 && memcmp(body + body_length - 5, "0\r\n\r\n", 5) == 0;
+    } else {
+        // the body ends with the connection
+        *keep_alive = 0;
+        complete = closed;
+    }
+
+    if (!complete && (closed || full)) {
+        *keep_alive = 0;
+        return full ? status : -1;
+    }
+
+    return complete ? status : 0;
+}
+
+static void receive_response(http_conn_t* conn, int64_t now) {
+    int closed = 0;
+
+    while (conn->received < HTTP_RESPONSE_SIZE) {
+        ssize_t n = conn_recv(conn, conn->response + conn->received, HTTP_RESPONSE_SIZE - conn->received);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            fail_conn(conn, conn_error(conn), errno == ECONNRESET, now);
+            return;
+        }
+        if (n == 0) {
+            closed = 1;
+            break;
+        }
+        conn->received += n;
+    }
+
+    int keep_alive = 0;
+    int status = parse_response(conn, closed, &keep_alive);
+
+    if (status == 0) {
+        return; // wait for the rest
+    }
+    if (status < 0) {
+        fail_conn(conn, closed ? "Connection closed without a response" : "Invalid response", closed, now);
+        return;
+    }
+
+    http_request_t* request = conn->request;
+    conn->request = NULL;
+
+    if (keep_alive) {
+        conn->state = CONN_IDLE;
+        conn->reused = 1;
+        conn->deadline = now + HTTP_IDLE_TIMEOUT_MS;
+        watch(conn, EPOLLIN);
+    } else {
+        close_conn(conn);
+    }
+
+    // overloaded or failed servers may answer the next try
+    if (status == 429 || status >= 500) {
+        sprint_error(request->logger, "[HTTP]: %s answered with status %d\n", request->endpoint->authority, status);
+        breaker_result(request->endpoint, 0, now);
+        retry_or_finish(request, status);
+    } else {
+        breaker_result(request->endpoint, 1, now);
+        finish(request, status);
+    }
+}
+
+/*
+ * Continues the TLS handshake of conn and sends its request once it is done.
+ */
+static void handshake(http_conn_t* conn, int64_t now) {
+    uint32_t events;
+    int done = tls_handshake(conn->tls, &events);
+
+    if (done < 0) {
+        fail_conn(conn, tls_error(conn->tls), 0, now);
+        return;
+    }
+    if (done == 0) {
+        watch(conn, events);
+        return;
+    }
+
+    pthread_mutex_lock(&http_mut);
+    handshakes++;
+    resumed += tls_resumed(conn->tls);
+    pthread_mutex_unlock(&http_mut);
+
+    conn->state = CONN_SENDING;
+    watch(conn, EPOLLOUT);
+    send_request(conn, now);
+}
+
+static void handle_conn(http_conn_t* conn, uint32_t events, int64_t now) {
+    switch (conn->state) {
+        case CONN_CONNECTING: {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+                error = errno;
+            }
+            if (error != 0) {
+                fail_conn(conn, strerror(error), 0, now);
+                return;
+            }
+
+            if (conn->endpoint->tls) {
+                conn->tls = tls_connect(conn->request->logger, conn->fd, conn->endpoint->host, conn->endpoint->session);
+                if (conn->tls == NULL) {
+                    fail_conn(conn, "Unable to start TLS", 0, now);
+                    return;
+                }
+                conn->state = CONN_HANDSHAKING;
+                handshake(conn, now);
+                break;
+            }
+
+            conn->state = CONN_SENDING;
+            send_request(conn, now);
+            break;
+        }
+        case CONN_HANDSHAKING:
+            handshake(conn, now);
+            break;
+        case CONN_SENDING:
+            send_request(conn, now);
+            break;
+        case CONN_RECEIVING:
+            receive_response(conn, now);
+            break;
+        case CONN_IDLE:
+            // the server closed the connection (or sent something unasked);
+            // with TLS it may also have been a late session ticket
+            (void) events;
+            if (conn->tls != NULL) {
+                char byte;
+                if (tls_recv(conn->tls, &byte, 1) < 0 && errno == EAGAIN) {
+                    break;
+                }
+            }
+            close_conn(conn);
+            break;
+    }
+}
+
+/*
+ * Opens a new connection to endpoint for the oldest waiting request.
+ */
+static void open_conn(http_endpoint_t* endpoint, int64_t now) {
+    http_request_t* request = pop(endpoint);
+
+    int fd = socket(endpoint->sockaddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        sprint_error(request->logger, "[HTTP]: Unable to create socket: %s\n", strerror(errno));
+        retry_or_finish(request, -1);
+        return;
+    }
+
+    socklen_t len = endpoint->sockaddr.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    if (connect(fd, (struct sockaddr*) &endpoint->sockaddr, len) < 0 && errno != EINPROGRESS) {
+        sprint_error(request->logger, "[HTTP]: Unable to connect to %s: %s\n", endpoint->authority, strerror(errno));
+        close(fd);
+        if (endpoint->is_hostname) {
+            endpoint->resolved = 0;
+        }
+        breaker_result(endpoint, 0, now);
+        retry_or_finish(request, -1);
+        return;
+    }
+
+    http_conn_t* conn = calloc(1, sizeof(http_conn_t));
+    conn->endpoint = endpoint;
+    conn->fd = fd;
+    conn->state = CONN_CONNECTING;
+
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = conn };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+    conn->next = endpoint->conns;
+    endpoint->conns = conn;
+    endpoint->conns_count++;
+
+    start_request(conn, request, now);
+}
+
+/*
+ * Resolves the hostname of endpoint without blocking. Returns 1 once it is
+ * resolved.
+ */
+static int resolve(http_endpoint_t* endpoint, int64_t now) {
+    const logger_t* logger = endpoint->head->logger;
+
+    if (endpoint->resolving == NULL) {
+        endpoint->resolving = resolve_start(logger, endpoint->host);
+        endpoint->resolve_deadline = now + DNS_RESOLVE_TIMEOUT * 1000;
+
+        if (endpoint->resolving == NULL) {
+            fail_waiting(endpoint, now);
+            return 0;
+        }
+    }
+
+    int resolved = resolve_result(logger, endpoint->resolving, &endpoint->sockaddr);
+    if (resolved < 0) {
+        if (now >= endpoint->resolve_deadline) {
+            sprint_error(logger, "[HTTP]: Timeout when resolving %s\n", endpoint->host);
+            resolve_cancel(endpoint->resolving);
+            endpoint->resolving = NULL;
+            fail_waiting(endpoint, now);
+        }
+        return 0;
+    }
+    endpoint->resolving = NULL;
+
+    if (!resolved) {
+        fail_waiting(endpoint, now);
+        return 0;
+    }
+
+    set_port(&endpoint->sockaddr, endpoint->port);
+    endpoint->resolved = 1;
+
+    return 1;
+}
+
+/*
+ * Hands the waiting requests of endpoint to idle connections and opens new
+ * connections for the rest, up to HTTP_POOL_SIZE. While its circuit breaker
+ * is open they are rejected; once the cooldown passed only one is sent to
+ * test the endpoint.
+ */
+static void dispatch(http_endpoint_t* endpoint, int64_t now) {
+    if (endpoint->breaker == BREAKER_OPEN && now >= endpoint->breaker_until) {
+        endpoint->breaker = BREAKER_HALF_OPEN;
+    }
+
+    while (endpoint->head != NULL) {
+        if (endpoint->breaker == BREAKER_OPEN || endpoint->testing) {
+            reject(pop(endpoint));
+            continue;
+        }
+
+        http_conn_t* idle = endpoint->conns;
+        while (idle != NULL && idle->state != CONN_IDLE) {
+            idle = idle->next;
+        }
+
+        if (idle == NULL) {
+            if (endpoint->conns_count >= HTTP_POOL_SIZE) {
+                break;
+            }
+            if (!endpoint->resolved && !resolve(endpoint, now)) {
+                break;
+            }
+        }
+
+        // set before sending as the request may fail right away
+        endpoint->testing = endpoint->breaker == BREAKER_HALF_OPEN;
+
+        if (idle != NULL) {
+            start_request(idle, pop(endpoint), now);
+        } else {
+            open_conn(endpoint, now);
+        }
+    }
+}
+
+/*
+ * Moves the requests queued by the actions to their endpoints.
+ */
+static void take_incoming() {
+    uint64_t value;
+    if (read(wake_fd, &value, sizeof(value)) < 0) {
+        // nothing to do, the eventfd is only a notification
+    }
+
+    pthread_mutex_lock(&http_mut);
+    http_request_t* request = incoming_head;
+    incoming_head = NULL;
+    incoming_tail = NULL;
+    pthread_mutex_unlock(&http_mut);
+
+    while (request != NULL) {
+        http_request_t* next = request->next;
+        append(request->endpoint, request);
+        request = next;
+    }
+}
+
+/*
+ * Returns how long the loop may wait until the next deadline, -1 if there is none.
+ */
+static int next_timeout(int64_t now) {
+    int64_t next = -1;
+
+    if (delayed != NULL) {
+        next = delayed->not_before;
+    }
+
+    for (http_endpoint_t* endpoint = endpoints; endpoint != NULL; endpoint = endpoint->next) {
+        if (endpoint->resolving != NULL && (next < 0 || now + RESOLVE_POLL_MS < next)) {
+            next = now + RESOLVE_POLL_MS;
+        }
+        for (http_conn_t* conn = endpoint->conns; conn != NULL; conn = conn->next) {
+            if (next < 0 || conn->deadline < next) {
+                next = conn->deadline;
+            }
+        }
+    }
+
+    if (next < 0) {
+        return -1;
+    }
+
+    return next <= now ? 0 : (int) (next - now);
+}
+
+static void handle_deadlines(int64_t now) {
+    // retries which are due
+    while (delayed != NULL && delayed->not_before <= now) {
+        http_request_t* request = delayed;
+        delayed = request->next;
+        append(request->endpoint, request);
+    }
+
+    for (http_endpoint_t* endpoint = endpoints; endpoint != NULL; endpoint = endpoint->next) {
+        http_conn_t* conn = endpoint->conns;
+        while (conn != NULL) {
+            http_conn_t* next = conn->next;
+
+            if (conn->deadline <= now) {
+                if (conn->state == CONN_IDLE) {
+                    close_conn(conn);
+                } else {
+                    fail_conn(conn, "Timeout", 0, now);
+                }
+            }
+            conn = next;
+        }
+
+        dispatch(endpoint, now);
+    }
+}
+
+static void* http_run(void* arg) {
+    (void) arg;
+    struct epoll_event events[HTTP_EVENTS];
+
+    while (running) {
+        int num_ready = epoll_wait(epoll_fd, events, HTTP_EVENTS, next_timeout(now_ms()));
+
+        if (num_ready < 0 && errno != EINTR) {
+            sprint_error(http_logger, "HTTP client is unable to wait: %s\n", strerror(errno));
+            break;
+        }
+
+        int64_t now = now_ms();
+        for (int i = 0; i < num_ready && running; i++) {
+            if (events[i].data.ptr == &stop_fd) {
+                continue; // ends the loop
+            }
+            if (events[i].data.ptr == &wake_fd) {
+                take_incoming();
+            } else {
+                handle_conn(events[i].data.ptr, events[i].events, now);
+            }
+        }
+
+        handle_deadlines(now_ms());
+    }
+
+    return NULL;
+}
+
+int http_start(const logger_t* logger, int queue_size, const char* ca_file) {
+    capacity = queue_size > 0 ? queue_size : HTTP_QUEUE_SIZE;
+    http_logger = logger;
+
+    // no action sends requests
+    if (endpoints == NULL) {
+        return 1;
+    }
+
+    for (http_endpoint_t* endpoint = endpoints; endpoint != NULL; endpoint = endpoint->next) {
+        if (endpoint->tls) {
+            if (!tls_init(logger, ca_file)) {
+                return 0;
+            }
+            break;
+        }
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        sprint_error(logger, "Unable to create the HTTP event loop: %s\n", strerror(errno));
+        return 0;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &wake_fd };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+
+    // ends the loop once we're stopping
+    event.data.ptr = &stop_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
+
+    if (!start_thread(&http_thread, http_run, NULL)) {
+        sprint_error(logger, "Unable to start the HTTP client\n");
+        return 0;
+    }
+    started = 1;
+
+    pthread_setname_np(http_thread, "srd-http");
+
+    print_debug(logger, "Started the HTTP client (queue size %d)\n", capacity);
+
+    return 1;
+}
+
+int http_post(const logger_t* logger, http_endpoint_t* endpoint, const char* path, const char* headers,
+              const char* body, int timeout_ms, int retries, http_done_t done, void* arg) {
+    pthread_mutex_lock(&http_mut);
+
+    if (!started || !running || pending >= capacity) {
+        dropped++;
+
+        // print only once per interval of the metrics; the queue may be full for long
+        if (running && dropped_interval++ == 0) {
+            sprint_error(logger, "HTTP queue is full (%d requests). Dropping requests until the endpoints caught up.\n", capacity);
+        }
+        pthread_mutex_unlock(&http_mut);
+
+        return 0;
+    }
+    pending++;
+
+    pthread_mutex_unlock(&http_mut);
+
+    size_t body_length = strlen(body);
+    int header_length = snprintf(NULL, 0, "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %zu\r\n%s\r\n",
+        path, endpoint->authority, body_length, headers);
+
+    http_request_t* request = calloc(1, sizeof(http_request_t));
+    request->logger = logger;
+    request->endpoint = endpoint;
+    request->length = header_length + body_length;
+    request->body_offset = header_length;
+    request->data = malloc(request->length + 1);
+    snprintf(request->data, header_length + 1, "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %zu\r\n%s\r\n",
+        path, endpoint->authority, body_length, headers);
+    memcpy(request->data + header_length, body, body_length + 1);
+    request->timeout_ms = timeout_ms;
+    request->retries = retries;
+    request->done = done;
+    request->arg = arg;
+
+    pthread_mutex_lock(&http_mut);
+    if (incoming_tail == NULL) {
+        incoming_head = request;
+    } else {
+        incoming_tail->next = request;
+    }
+    incoming_tail = request;
+    pthread_mutex_unlock(&http_mut);
+
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        sprint_error(logger, "Unable to wake the HTTP client: %s\n", strerror(errno));
+    }
+
+    return 1;
+}
+
+void http_print_metrics(const logger_t* logger) {
+    if (endpoints == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&http_mut);
+
+    // requests were lost: that is worth more than a debug message
+    if (dropped_interval > 0) {
+        sprint_info(logger, METRICS_FORMAT, pending, (unsigned long) succeeded, (unsigned long) failed,
+            (unsigned long) retried, (unsigned long) rejected, (unsigned long) dropped, (unsigned long) dropped_interval,
+            (unsigned long) handshakes, (unsigned long) resumed);
+    } else {
+        sprint_debug(logger, METRICS_FORMAT, pending, (unsigned long) succeeded, (unsigned long) failed,
+            (unsigned long) retried, (unsigned long) rejected, (unsigned long) dropped, (unsigned long) dropped_interval,
+            (unsigned long) handshakes, (unsigned long) resumed);
+    }
+    dropped_interval = 0;
+
+    pthread_mutex_unlock(&http_mut);
+}
+
+void http_stop(const logger_t* logger) {
+    if (started) {
+        pthread_join(http_thread, NULL);
+        started = 0;
+    }
+
+    // the loop ended; finish whatever is left so the actions may keep a backup
+    pthread_mutex_lock(&http_mut);
+    http_request_t* request = incoming_head;
+    incoming_head = NULL;
+    incoming_tail = NULL;
+    int aborted = pending;
+    pthread_mutex_unlock(&http_mut);
+
+    if (aborted > 0) {
+        sprint_info(logger, "Aborting %d pending HTTP requests\n", aborted);
+    }
+
+    while (request != NULL) {
+        http_request_t* next = request->next;
+        finish(request, -1);
+        request = next;
+    }
+
+    while (delayed != NULL) {
+        request = delayed;
+        delayed = request->next;
+        finish(request, -1);
+    }
+
+    while (endpoints != NULL) {
+        http_endpoint_t* endpoint = endpoints;
+        endpoints = endpoint->next;
+
+        while (endpoint->conns != NULL) {
+            http_conn_t* conn = endpoint->conns;
+            if (conn->request != NULL) {
+                finish(conn->request, -1);
+            }
+            close_conn(conn);
+        }
+        while (endpoint->head != NULL) {
+            finish(pop(endpoint), -1);
+        }
+        if (endpoint->resolving != NULL) {
+            resolve_cancel(endpoint->resolving);
+        }
+
+        if (endpoint->session != NULL) {
+            tls_session_free(endpoint->session);
+        }
+        free(endpoint->host);
+        free(endpoint);
+    }
+    tls_cleanup();
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef SRD_HTTP_H
+#define SRD_HTTP_H
+
+#include "printing.h"
+
+/* Defaults of the HTTP client; the queue size is configurable in srd.conf */
+#define HTTP_QUEUE_SIZE 1024
+
+/* Connections kept open to one endpoint */
+#define HTTP_POOL_SIZE 4
+
+/* Idle connections are closed after this time */
+#define HTTP_IDLE_TIMEOUT_MS 30000
+
+/* Delay before the first retry of a request; doubled for each further retry */
+#define HTTP_BACKOFF_MS 1000
+#define HTTP_BACKOFF_MAX_MS 60000
+
+/* Consecutive failed tries after which requests to an endpoint fail right away
+ * (the circuit breaker opens) until a single request succeeds again */
+#define HTTP_BREAKER_THRESHOLD 5
+
+/* Time the circuit breaker stays open; doubled each time the test request fails */
+#define HTTP_BREAKER_COOLDOWN_MS 5000
+#define HTTP_BREAKER_COOLDOWN_MAX_MS 300000
+
+/* Part of the response that is kept; longer responses close the connection */
+#define HTTP_RESPONSE_SIZE 4096
+
+typedef struct http_endpoint_t http_endpoint_t;
+
+/*
+ * Called by the HTTP client once a request finished. status is the status of
+ * the response (f.ex. 204) or -1 if there was none (after all retries or at
+ * shutdown). body is the body of the request.
+ */
+typedef void (*http_done_t)(const logger_t* logger, void* arg, const char* body, int status);
+
+/*
+ * Returns the endpoint for host (IP or hostname) and port, connected to with
+ * TLS if tls is 1. All requests to the same endpoint share its connections,
+ * new connections resume the TLS session of the previous one. Must be called
+ * before http_start.
+ */
+http_endpoint_t* http_endpoint(const char* host, int port, int tls);
+
+/*
+ * Splits url ("http[s]://host[:port][/path]") into a newly allocated host and
+ * path, the port and tls (1 for https). Returns 1 on success, else 0.
+ */
+int http_parse_url(const char* url, char** host, int* port, char** path, int* tls);
+
+/*
+ * Starts the thread performing the requests if there is any endpoint. The
+ * certificates of TLS endpoints are verified with the CAs in ca_file or the
+ * ones of the system if it is NULL. At most queue_size requests are pending;
+ * further requests are dropped. Returns 1 on success, else 0.
+ */
+int http_start(const logger_t* logger, int queue_size, const char* ca_file);
+
+/*
+ * Queues a POST of body to path of endpoint. headers are further header
+ * lines, each ending with "\r\n" (may be empty). The request is retried up to
+ * retries times with a growing backoff if it fails, times out after
+ * timeout_ms per try or the server answers with 429 or 5xx. done is called
+ * with arg once it finished; with -1 right away while the circuit breaker of
+ * the endpoint is open. Never blocks; returns 0 if the queue is full and the
+ * request was dropped (done is not called then).
+ */
+int http_post(const logger_t* logger, http_endpoint_t* endpoint, const char* path, const char* headers,
+              const char* body, int timeout_ms, int retries, http_done_t done, void* arg);
+
+/*
+ * Prints the amount of pending, sent, failed, rejected and dropped requests
+ * and of the TLS handshakes.
+ */
+void http_print_metrics(const logger_t* logger);
+
+/*
+ * Waits for the thread, which ends once we're stopping, aborts all pending
+ * requests and frees the endpoints.
+ */
+void http_stop(const logger_t* logger);
+
+#endif
@@ -0,0 +1,175 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "srd.h"
+#include "printing.h"
+#include "actions.h"
+
+static int journal_fd = -1;
+static int index_fd = -1;
+
+/* serializes appends of all check threads */
+static pthread_mutex_t journal_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* amount of records in the journal */
+static uint64_t records_count = 0;
+
+/* amount of entries in the index and start of the latest interval in it */
+static uint64_t index_entries = 0;
+static int64_t last_interval = -1;
+
+int journal_open(const logger_t* logger, const char* path) {
+    journal_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (journal_fd < 0) {
+        print_error(logger, "Unable to open journal %s: %s. Transitions are not logged.\n", path, strerror(errno));
+        return 0;
+    }
+
+    struct stat st;
+    journal_header_t header;
+
+    if (fstat(journal_fd, &st) < 0) {
+        print_error(logger, "Unable to read journal %s: %s\n", path, strerror(errno));
+        journal_close();
+        return 0;
+    }
+
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+        header.version = JOURNAL_VERSION;
+        header.record_size = sizeof(journal_record_t);
+        header.index_interval = JOURNAL_INDEX_INTERVAL;
+
+        if (pwrite(journal_fd, &header, sizeof(header), 0) != sizeof(header)) {
+            print_error(logger, "Unable to write journal %s: %s\n", path, strerror(errno));
+            journal_close();
+            return 0;
+        }
+        st.st_size = sizeof(header);
+    } else if (pread(journal_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != JOURNAL_VERSION ||
+        header.record_size != sizeof(journal_record_t) ||
+        header.index_interval != JOURNAL_INDEX_INTERVAL)
+    {
+        // do not touch files we do not understand
+        print_error(logger, "%s is not a journal of this version of srd. Transitions are not logged.\n", path);
+        journal_close();
+        return 0;
+    }
+
+    // drop a partially written record (f.ex. after a power loss)
+    records_count = (st.st_size - sizeof(header)) / sizeof(journal_record_t);
+    if (ftruncate(journal_fd, sizeof(header) + records_count * sizeof(journal_record_t)) < 0) {
+        print_error(logger, "Unable to truncate journal %s: %s\n", path, strerror(errno));
+    }
+
+    char* index_path = malloc(strlen(path) + sizeof(JOURNAL_INDEX_SUFFIX));
+    sprintf(index_path, "%s%s", path, JOURNAL_INDEX_SUFFIX);
+
+    index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (index_fd < 0 || fstat(index_fd, &st) < 0) {
+        print_error(logger, "Unable to open journal index %s: %s. Transitions are not logged.\n", index_path, strerror(errno));
+        free(index_path);
+        journal_close();
+        return 0;
+    }
+    free(index_path);
+
+    // continue after the latest complete entry which still points into the journal
+    index_entries = st.st_size / sizeof(journal_index_t);
+    journal_index_t entry;
+
+    while (index_entries > 0) {
+        if (pread(index_fd, &entry, sizeof(entry), (index_entries - 1) * sizeof(entry)) == sizeof(entry) &&
+            entry.record <= records_count)
+        {
+            last_interval = entry.interval_start;
+            break;
+        }
+        index_entries--;
+    }
+    if (ftruncate(index_fd, index_entries * sizeof(journal_index_t)) < 0) {
+        print_error(logger, "Unable to truncate journal index: %s\n", strerror(errno));
+    }
+
+    print_info(logger, "Logging transitions to journal %s (%lu records)\n", path, (unsigned long) records_count);
+
+    return 1;
+}
+
+int journal_append(const connectivity_check_t* check, conn_state_t old_state, const struct timespec* time, double duration) {
+    if (journal_fd < 0) {
+        return 0;
+    }
+
+    journal_record_t record;
+    memset(&record, 0, sizeof(record));
+
+    record.timestamp_sec = time->tv_sec;
+    record.timestamp_nsec = time->tv_nsec;
+    record.old_state = old_state;
+    record.new_state = check->state;
+    record.latency = check->latency >= 0 ? check->latency * 1e3 : -1.0;
+    record.duration = duration > 0 ? duration : 0;
+    snprintf(record.name, sizeof(record.name), "%s", check->name);
+
+    if (check->sockaddr != NULL && check->sockaddr->ss_family == AF_INET) {
+        record.family = AF_INET;
+        memcpy(record.address, &((struct sockaddr_in*) check->sockaddr)->sin_addr, 4);
+    } else if (check->sockaddr != NULL && check->sockaddr->ss_family == AF_INET6) {
+        record.family = AF_INET6;
+        memcpy(record.address, &((struct sockaddr_in6*) check->sockaddr)->sin6_addr, 16);
+    } else {
+        record.family = AF_UNSPEC;
+    }
+
+    int64_t interval = record.timestamp_sec - record.timestamp_sec % JOURNAL_INDEX_INTERVAL;
+    int success = 1;
+
+    pthread_mutex_lock(&journal_mut);
+
+    off_t offset = sizeof(journal_header_t) + records_count * sizeof(journal_record_t);
+
+    if (pwrite(journal_fd, &record, sizeof(record), offset) != sizeof(record)) {
+        success = 0;
+    } else {
+        // the first record of a new interval is indexed
+        if (interval > last_interval) {
+            journal_index_t entry = { .interval_start = interval, .record = records_count };
+
+            if (pwrite(index_fd, &entry, sizeof(entry), index_entries * sizeof(entry)) == sizeof(entry)) {
+                last_interval = interval;
+                index_entries++;
+            }
+        }
+        records_count++;
+    }
+
+    pthread_mutex_unlock(&journal_mut);
+
+    return success;
+}
+
+void journal_close() {
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+    if (index_fd >= 0) {
+        close(index_fd);
+        index_fd = -1;
+    }
+}
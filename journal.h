@@ -0,0 +1,100 @@
+#ifndef SRD_JOURNAL_H
+#define SRD_JOURNAL_H
+
+#include <stdint.h>
+
+#include "srd.h"
+#include "printing.h"
+#include "actions.h"
+
+#define JOURNAL_MAGIC "SRDJRNL"
+#define JOURNAL_VERSION 1
+
+/* The index file is the journal's path with this suffix */
+#define JOURNAL_INDEX_SUFFIX ".idx"
+
+/* One index entry is written for each interval (seconds) containing events */
+#define JOURNAL_INDEX_INTERVAL 3600
+
+/*
+ * Header at the start of the journal.
+ */
+typedef struct journal_header_t
+{
+    // JOURNAL_MAGIC including the null delimiter
+    char magic[8];
+
+    // JOURNAL_VERSION
+    uint32_t version;
+
+    // sizeof(journal_record_t)
+    uint32_t record_size;
+
+    // JOURNAL_INDEX_INTERVAL used for the index
+    uint32_t index_interval;
+
+    uint32_t reserved;
+} journal_header_t;
+
+/*
+ * One state transition of a target. Appended to the journal.
+ */
+typedef struct journal_record_t
+{
+    // time of the transition (unix timestamp)
+    int64_t timestamp_sec;
+    uint32_t timestamp_nsec;
+
+    // conn_state_t before and after the transition
+    uint8_t old_state;
+    uint8_t new_state;
+
+    // AF_INET, AF_INET6 or AF_UNSPEC if the address is not known
+    uint8_t family;
+    uint8_t reserved;
+
+    // target IP address in network byte order; IPv4 uses the first 4 bytes
+    uint8_t address[16];
+
+    // latency in ms of the ping triggering the transition; -1.0 if it failed
+    float latency;
+
+    // seconds the previous state lasted: downtime when switching to UP, uptime when switching to DOWN
+    uint32_t duration;
+
+    // name of the config of the target
+    char name[56];
+} journal_record_t;
+
+_Static_assert(sizeof(journal_record_t) == 96, "journal_record_t must have 96 bytes");
+
+/*
+ * Entry of the index: the first record logged at or after the start of an interval.
+ */
+typedef struct journal_index_t
+{
+    // start of the interval (unix timestamp, multiple of index_interval)
+    int64_t interval_start;
+
+    // number of the record (0 is the first after the header)
+    uint64_t record;
+} journal_index_t;
+
+/*
+ * Opens (or creates) the journal at path and its index.
+ * Returns 1 on success, else 0 (then no transitions are logged).
+ */
+int journal_open(const logger_t* logger, const char* path);
+
+/*
+ * Appends the transition of check from old_state to its current state.
+ * Returns 1 on success, else 0.
+ */
+int journal_append(const connectivity_check_t* check, conn_state_t old_state, const struct timespec* time, double duration);
+
+/*
+ * Closes the journal and its index.
+ */
+void journal_close();
+
+#endif
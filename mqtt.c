@@ -0,0 +1,938 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mqtt.h"
+#include "printing.h"
+#include "srd.h"
+#include "util.h"
+
+#define MQTT_EVENTS 16
+
+/* Largest packet we expect from a broker (CONNACK, PUBACK, PINGRESP) */
+#define MQTT_RECEIVE_SIZE 1024
+
+/* Types of the control packets (upper 4 bits of the first byte) */
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+#define MQTT_FLAG_DUP    0x08
+
+typedef enum mqtt_state_t {
+    MQTT_DISCONNECTED,
+    MQTT_RESOLVING,
+    MQTT_CONNECTING,
+    MQTT_AWAITING_CONNACK,
+    MQTT_CONNECTED,
+} mqtt_state_t;
+
+/*
+ * A PUBLISH packet queued by an action.
+ */
+typedef struct mqtt_message_t {
+    // logger of the check which queued this
+    const logger_t* logger;
+
+    mqtt_broker_t* broker;
+
+    // the whole packet; the packet identifier is set when it is sent
+    uint8_t* packet;
+    size_t length;
+    size_t id_offset;
+
+    int qos;
+    uint16_t id;
+
+    struct mqtt_message_t* next;
+} mqtt_message_t;
+
+struct mqtt_broker_t {
+    // path of the config which used this broker first
+    char* config;
+
+    char* host;
+    int port;
+    char* client_id;
+    char* username;
+    char* password;
+    int keepalive;
+
+    // "host:port" for the log
+    char authority[INET6_ADDRSTRLEN + 256];
+
+    struct sockaddr_storage sockaddr;
+
+    // 1 if host is a hostname, which is resolved again before each connect
+    int is_hostname;
+    struct gaicb* resolving;
+
+    mqtt_state_t state;
+    int fd;
+
+    // end of the current connect, time of the next try and the delay after that
+    int64_t deadline;
+    int64_t reconnect_at;
+    int64_t backoff;
+
+    // for the keepalive
+    int64_t last_sent;
+    // time the PINGREQ was sent at, 0 if it was answered
+    int64_t ping_sent;
+
+    // bytes to send; only complete packets are appended
+    uint8_t* out;
+    size_t out_length;
+    size_t out_sent;
+    size_t out_capacity;
+    int watching_out;
+
+    uint8_t in[MQTT_RECEIVE_SIZE];
+    size_t in_length;
+
+    // messages waiting to be sent, oldest first
+    mqtt_message_t* head;
+    mqtt_message_t* tail;
+
+    // messages with QoS 1 sent but not acknowledged, oldest first
+    mqtt_message_t* inflight;
+    int inflight_count;
+    uint16_t next_id;
+
+    struct mqtt_broker_t* next;
+};
+
+static mqtt_broker_t* brokers = NULL;
+
+static const logger_t* mqtt_logger = NULL;
+static pthread_t mqtt_thread;
+static int started = 0;
+static int epoll_fd = -1;
+
+/* wakes the thread when messages were queued */
+static int wake_fd = -1;
+
+/* protects everything below */
+static pthread_mutex_t mqtt_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* messages queued since the thread looked last, oldest first */
+static mqtt_message_t* incoming_head = NULL;
+static mqtt_message_t* incoming_tail = NULL;
+
+/* messages which are queued or not yet acknowledged */
+static int pending = 0;
+static int capacity = MQTT_QUEUE_SIZE;
+
+/* metrics; dropped_interval is reset when printed */
+static uint64_t published = 0;
+static uint64_t dropped = 0;
+static uint64_t dropped_interval = 0;
+
+#define METRICS_FORMAT "MQTT: %d pending, %lu published, %lu dropped (%lu recently).\n"
+
+static int64_t now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static int same(const char* a, const char* b) {
+    return (a == NULL && b == NULL) || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+mqtt_broker_t* mqtt_broker(const logger_t* logger, const char* config, const char* host, int port, const char* client_id,
+                           const char* username, const char* password, int keepalive) {
+    for (mqtt_broker_t* broker = brokers; broker != NULL; broker = broker->next) {
+        if (broker->port != port || !same(broker->host, host) || !same(broker->client_id, client_id)) {
+            continue;
+        }
+
+        // the broker allows one connection per client id: one of them would be dropped
+        if (!same(broker->username, username) || !same(broker->password, password) || broker->keepalive != keepalive) {
+            print_error(logger, "%s and %s connect to the MQTT broker %s as %s with different username, password or keepalive\n",
+                broker->config, config, broker->authority, client_id);
+            return NULL;
+        }
+
+        return broker;
+    }
+
+    mqtt_broker_t* broker = calloc(1, sizeof(mqtt_broker_t));
+    broker->config = strdup(config);
+    broker->host = strdup(host);
+    broker->port = port;
+    broker->client_id = strdup(client_id);
+    broker->username = username != NULL ? strdup(username) : NULL;
+    broker->password = password != NULL ? strdup(password) : NULL;
+    broker->keepalive = keepalive;
+    broker->fd = -1;
+    broker->backoff = MQTT_BACKOFF_MS;
+    broker->next_id = 1;
+
+    // IPv6 addresses are put in brackets
+    if (strchr(host, ':') != NULL) {
+        snprintf(broker->authority, sizeof(broker->authority), "[%s]:%d", host, port);
+    } else {
+        snprintf(broker->authority, sizeof(broker->authority), "%s:%d", host, port);
+    }
+
+    broker->is_hostname = !to_sockaddr(host, &broker->sockaddr);
+    if (!broker->is_hostname) {
+        set_port(&broker->sockaddr, port);
+    }
+
+    broker->next = brokers;
+    brokers = broker;
+
+    return broker;
+}
+
+/*
+ * Writes the remaining length of a packet; returns the amount of bytes used.
+ */
+static size_t put_length(uint8_t* buffer, size_t length) {
+    size_t i = 0;
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        buffer[i++] = length > 0 ? byte | 0x80 : byte;
+    } while (length > 0);
+
+    return i;
+}
+
+static size_t put_string(uint8_t* buffer, const char* string, size_t length) {
+    buffer[0] = length >> 8;
+    buffer[1] = length & 0xFF;
+    memcpy(buffer + 2, string, length);
+
+    return length + 2;
+}
+
+/*
+ * Appends length bytes to the output of broker.
+ */
+static void append_out(mqtt_broker_t* broker, const uint8_t* data, size_t length) {
+    if (broker->out_length + length > broker->out_capacity) {
+        broker->out_capacity = (broker->out_length + length) * 2;
+        broker->out = realloc(broker->out, broker->out_capacity);
+    }
+    memcpy(broker->out + broker->out_length, data, length);
+    broker->out_length += length;
+}
+
+static void watch(mqtt_broker_t* broker, int out) {
+    struct epoll_event event = { .events = EPOLLIN | (out ? EPOLLOUT : 0), .data.ptr = broker };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, broker->fd, &event);
+    broker->watching_out = out;
+}
+
+/*
+ * Closes the connection to broker and tries again after the backoff. The
+ * messages with QoS 1 which are not acknowledged are sent again then.
+ */
+static void disconnect(mqtt_broker_t* broker, const char* reason, int64_t now) {
+    if (reason != NULL && broker->state == MQTT_CONNECTED) {
+        sprint_error(mqtt_logger, "[MQTT]: Connection to %s lost: %s. Reconnecting in %d ms\n",
+            broker->authority, reason, (int) broker->backoff);
+    } else if (reason != NULL) {
+        sprint_error(mqtt_logger, "[MQTT]: Unable to connect to %s: %s. Trying again in %d ms\n",
+            broker->authority, reason, (int) broker->backoff);
+    }
+
+    if (broker->resolving != NULL) {
+        resolve_cancel(broker->resolving);
+        broker->resolving = NULL;
+    }
+    if (broker->fd >= 0) {
+        close(broker->fd);
+        broker->fd = -1;
+    }
+
+    broker->state = MQTT_DISCONNECTED;
+    broker->out_length = 0;
+    broker->out_sent = 0;
+    broker->in_length = 0;
+    broker->ping_sent = 0;
+
+    broker->reconnect_at = now + broker->backoff;
+    broker->backoff *= 2;
+    if (broker->backoff > MQTT_BACKOFF_MAX_MS) {
+        broker->backoff = MQTT_BACKOFF_MAX_MS;
+    }
+}
+
+/*
+ * Sends as much of the output as the socket takes.
+ */
+static void flush(mqtt_broker_t* broker, int64_t now) {
+    while (broker->out_sent < broker->out_length) {
+        ssize_t n = send(broker->fd, broker->out + broker->out_sent, broker->out_length - broker->out_sent, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            disconnect(broker, strerror(errno), now);
+            return;
+        }
+        broker->out_sent += n;
+        broker->last_sent = now;
+    }
+
+    if (broker->out_sent == broker->out_length) {
+        broker->out_sent = 0;
+        broker->out_length = 0;
+    }
+
+    int out = broker->out_length > 0;
+    if (out != broker->watching_out) {
+        watch(broker, out);
+    }
+}
+
+static void send_connect(mqtt_broker_t* broker, int64_t now) {
+    size_t id_length = strlen(broker->client_id);
+    size_t user_length = broker->username != NULL ? strlen(broker->username) : 0;
+    size_t password_length = broker->password != NULL ? strlen(broker->password) : 0;
+
+    size_t length = 10 + 2 + id_length;
+    uint8_t flags = 0; // no clean session: the broker keeps our session across reconnects
+    if (broker->username != NULL) {
+        flags |= 0x80;
+        length += 2 + user_length;
+    }
+    if (broker->password != NULL) {
+        flags |= 0x40;
+        length += 2 + password_length;
+    }
+
+    uint8_t packet[length + 5];
+    size_t i = 0;
+    packet[i++] = MQTT_CONNECT;
+    i += put_length(packet + i, length);
+    i += put_string(packet + i, "MQTT", 4);
+    packet[i++] = 4; // protocol level of 3.1.1
+    packet[i++] = flags;
+    packet[i++] = broker->keepalive >> 8;
+    packet[i++] = broker->keepalive & 0xFF;
+    i += put_string(packet + i, broker->client_id, id_length);
+    if (broker->username != NULL) {
+        i += put_string(packet + i, broker->username, user_length);
+    }
+    if (broker->password != NULL) {
+        i += put_string(packet + i, broker->password, password_length);
+    }
+
+    append_out(broker, packet, i);
+    broker->state = MQTT_AWAITING_CONNACK;
+    flush(broker, now);
+}
+
+static void open_connection(mqtt_broker_t* broker, int64_t now) {
+    broker->fd = socket(broker->sockaddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (broker->fd < 0) {
+        disconnect(broker, strerror(errno), now);
+        return;
+    }
+
+    socklen_t len = broker->sockaddr.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    if (connect(broker->fd, (struct sockaddr*) &broker->sockaddr, len) < 0 && errno != EINPROGRESS) {
+        disconnect(broker, strerror(errno), now);
+        return;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN | EPOLLOUT, .data.ptr = broker };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, broker->fd, &event);
+    broker->watching_out = 1;
+
+    broker->state = MQTT_CONNECTING;
+    broker->deadline = now + MQTT_CONNECT_TIMEOUT_MS;
+}
+
+/*
+ * Starts connecting to broker, resolving its hostname first.
+ */
+static void reconnect(mqtt_broker_t* broker, int64_t now) {
+    if (!broker->is_hostname) {
+        open_connection(broker, now);
+        return;
+    }
+
+    if (broker->resolving == NULL) {
+        broker->resolving = resolve_start(mqtt_logger, broker->host);
+        if (broker->resolving == NULL) {
+            disconnect(broker, NULL, now);
+            return;
+        }
+        broker->state = MQTT_RESOLVING;
+        broker->deadline = now + DNS_RESOLVE_TIMEOUT * 1000;
+    }
+
+    int resolved = resolve_result(mqtt_logger, broker->resolving, &broker->sockaddr);
+    if (resolved < 0) {
+        if (now >= broker->deadline) {
+            disconnect(broker, "Timeout when resolving the hostname", now);
+        }
+        return;
+    }
+    broker->resolving = NULL;
+
+    if (!resolved) {
+        disconnect(broker, NULL, now);
+        return;
+    }
+
+    set_port(&broker->sockaddr, broker->port);
+    open_connection(broker, now);
+}
+
+/*
+ * Moves queued messages to the output while the broker may take them.
+ */
+static void send_messages(mqtt_broker_t* broker, int64_t now) {
+    while (broker->head != NULL && broker->inflight_count < MQTT_INFLIGHT) {
+        mqtt_message_t* message = broker->head;
+        broker->head = message->next;
+        if (broker->head == NULL) {
+            broker->tail = NULL;
+        }
+
+        if (message->qos > 0) {
+            // 0 is no valid packet identifier
+            if (broker->next_id == 0) {
+                broker->next_id = 1;
+            }
+            message->id = broker->next_id++;
+            message->packet[message->id_offset] = message->id >> 8;
+            message->packet[message->id_offset + 1] = message->id & 0xFF;
+        }
+
+        append_out(broker, message->packet, message->length);
+
+        if (message->qos > 0) {
+            // kept until the PUBACK
+            message->next = NULL;
+            mqtt_message_t** last = &broker->inflight;
+            while (*last != NULL) {
+                last = &(*last)->next;
+            }
+            *last = message;
+            broker->inflight_count++;
+            continue;
+        }
+
+        free(message->packet);
+        free(message);
+
+        pthread_mutex_lock(&mqtt_mut);
+        pending--;
+        published++;
+        pthread_mutex_unlock(&mqtt_mut);
+    }
+
+    flush(broker, now);
+}
+
+static void acknowledged(mqtt_broker_t* broker, uint16_t id) {
+    for (mqtt_message_t** next = &broker->inflight; *next != NULL; next = &(*next)->next) {
+        mqtt_message_t* message = *next;
+        if (message->id != id) {
+            continue;
+        }
+
+        *next = message->next;
+        broker->inflight_count--;
+
+        free(message->packet);
+        free(message);
+
+        pthread_mutex_lock(&mqtt_mut);
+        pending--;
+        published++;
+        pthread_mutex_unlock(&mqtt_mut);
+
+        return;
+    }
+}
+
+static void connected(mqtt_broker_t* broker, uint8_t session_present, uint8_t code, int64_t now) {
+    static const char* errors[] = {
+        [1] = "unacceptable protocol version",
+        [2] = "client identifier rejected",
+        [3] = "server unavailable",
+        [4] = "bad user name or password",
+        [5] = "not authorized",
+    };
+
+    if (code != 0) {
+        disconnect(broker, code <= 5 ? errors[code] : "connection refused", now);
+        return;
+    }
+
+    sprint_info(mqtt_logger, "[MQTT]: Connected to %s as %s%s\n", broker->authority, broker->client_id,
+        session_present ? " (resumed session)" : "");
+
+    broker->state = MQTT_CONNECTED;
+    broker->backoff = MQTT_BACKOFF_MS;
+
+    // send the unacknowledged messages again, marked as duplicates
+    for (mqtt_message_t* message = broker->inflight; message != NULL; message = message->next) {
+        message->packet[0] |= MQTT_FLAG_DUP;
+        append_out(broker, message->packet, message->length);
+    }
+
+    send_messages(broker, now);
+}
+
+/*
+ * Handles all complete packets received from broker.
+ */
+static void receive(mqtt_broker_t* broker, int64_t now) {
+    while (broker->in_length < MQTT_RECEIVE_SIZE) {
+        ssize_t n = recv(broker->fd, broker->in + broker->in_length, MQTT_RECEIVE_SIZE - broker->in_length, 0);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            disconnect(broker, strerror(errno), now);
+            return;
+        }
+        if (n == 0) {
+            disconnect(broker, "Closed by the broker", now);
+            return;
+        }
+        broker->in_length += n;
+    }
+
+    size_t offset = 0;
+    while (broker->state != MQTT_DISCONNECTED && broker->in_length - offset >= 2) {
+        const uint8_t* packet = broker->in + offset;
+        size_t available = broker->in_length - offset;
+
+        // decode the remaining length
+        size_t length = 0;
+        size_t i = 1;
+        size_t multiplier = 1;
+        int complete = 0;
+        while (i < available && i <= 4) {
+            uint8_t byte = packet[i++];
+            length += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+            if (!(byte & 0x80)) {
+                complete = 1;
+                break;
+            }
+        }
+
+        if (!complete) {
+            if (i > 4) {
+                disconnect(broker, "Invalid packet", now);
+                return;
+            }
+            break; // wait for the rest
+        }
+        if (i + length > available) {
+            if (offset == 0 && i + length > MQTT_RECEIVE_SIZE) {
+                disconnect(broker, "Unexpected packet", now);
+                return;
+            }
+            break; // wait for the rest
+        }
+
+        const uint8_t* body = packet + i;
+        switch (packet[0] & 0xF0) {
+            case MQTT_CONNACK:
+                if (broker->state == MQTT_AWAITING_CONNACK && length == 2) {
+                    connected(broker, body[0] & 0x01, body[1], now);
+                }
+                break;
+            case MQTT_PUBACK:
+                if (length == 2) {
+                    acknowledged(broker, body[0] << 8 | body[1]);
+                }
+                break;
+            case MQTT_PINGRESP:
+                broker->ping_sent = 0;
+                break;
+            default:
+                // we don't subscribe to anything
+                break;
+        }
+        offset += i + length;
+    }
+
+    if (broker->state == MQTT_DISCONNECTED) {
+        return;
+    }
+
+    memmove(broker->in, broker->in + offset, broker->in_length - offset);
+    broker->in_length -= offset;
+
+    // messages may be sent now that others were acknowledged
+    if (broker->state == MQTT_CONNECTED && broker->head != NULL) {
+        send_messages(broker, now);
+    }
+}
+
+static void handle_broker(mqtt_broker_t* broker, uint32_t events, int64_t now) {
+    if (broker->state == MQTT_CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(broker->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            disconnect(broker, strerror(error), now);
+            return;
+        }
+
+        send_connect(broker, now);
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        flush(broker, now);
+    }
+    if (broker->state != MQTT_DISCONNECTED && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        receive(broker, now);
+    }
+}
+
+/*
+ * Moves the messages queued by the actions to their brokers.
+ */
+static void take_incoming(int64_t now) {
+    uint64_t value;
+    if (read(wake_fd, &value, sizeof(value)) < 0) {
+        // nothing to do, the eventfd is only a notification
+    }
+
+    pthread_mutex_lock(&mqtt_mut);
+    mqtt_message_t* message = incoming_head;
+    incoming_head = NULL;
+    incoming_tail = NULL;
+    pthread_mutex_unlock(&mqtt_mut);
+
+    while (message != NULL) {
+        mqtt_message_t* next = message->next;
+        mqtt_broker_t* broker = message->broker;
+
+        message->next = NULL;
+        if (broker->tail == NULL) {
+            broker->head = message;
+        } else {
+            broker->tail->next = message;
+        }
+        broker->tail = message;
+
+        message = next;
+    }
+
+    for (mqtt_broker_t* broker = brokers; broker != NULL; broker = broker->next) {
+        if (broker->state == MQTT_CONNECTED && broker->head != NULL) {
+            send_messages(broker, now);
+        }
+    }
+}
+
+/*
+ * Returns the next time a broker needs attention.
+ */
+static int64_t next_deadline(const mqtt_broker_t* broker, int64_t now) {
+    int64_t keepalive_ms = broker->keepalive * 1000LL;
+
+    switch (broker->state) {
+        case MQTT_DISCONNECTED:
+            return broker->reconnect_at;
+        case MQTT_RESOLVING:
+            return now + RESOLVE_POLL_MS;
+        case MQTT_CONNECTING:
+        case MQTT_AWAITING_CONNACK:
+            return broker->deadline;
+        case MQTT_CONNECTED:
+            if (keepalive_ms == 0) {
+                return -1;
+            }
+            // a PINGRESP is expected within half the keepalive
+            return broker->ping_sent > 0 ? broker->ping_sent + keepalive_ms / 2 : broker->last_sent + keepalive_ms;
+    }
+
+    return -1;
+}
+
+static void handle_deadline(mqtt_broker_t* broker, int64_t now) {
+    // the lookup is polled
+    if (broker->state == MQTT_RESOLVING) {
+        reconnect(broker, now);
+        return;
+    }
+
+    int64_t deadline = next_deadline(broker, now);
+    if (deadline < 0 || deadline > now) {
+        return;
+    }
+
+    switch (broker->state) {
+        case MQTT_DISCONNECTED:
+        case MQTT_RESOLVING:
+            reconnect(broker, now);
+            break;
+        case MQTT_CONNECTING:
+        case MQTT_AWAITING_CONNACK:
+            disconnect(broker, "Timeout when connecting", now);
+            break;
+        case MQTT_CONNECTED:
+            if (broker->ping_sent > 0) {
+                disconnect(broker, "No answer to the keepalive", now);
+                break;
+            }
+            uint8_t ping[2] = { MQTT_PINGREQ, 0 };
+            append_out(broker, ping, sizeof(ping));
+            broker->ping_sent = now;
+            flush(broker, now);
+            break;
+    }
+}
+
+static void* mqtt_run(void* arg) {
+    (void) arg;
+    struct epoll_event events[MQTT_EVENTS];
+
+    int64_t now = now_ms();
+    for (mqtt_broker_t* broker = brokers; broker != NULL; broker = broker->next) {
+        reconnect(broker, now);
+    }
+
+    while (running) {
+        now = now_ms();
+
+        int64_t next = -1;
+        for (mqtt_broker_t* broker = brokers; broker != NULL; broker = broker->next) {
+            int64_t deadline = next_deadline(broker, now);
+            if (deadline >= 0 && (next < 0 || deadline < next)) {
+                next = deadline;
+            }
+        }
+        int timeout_ms = next < 0 ? -1 : (next <= now ? 0 : (int) (next - now));
+
+        int num_ready = epoll_wait(epoll_fd, events, MQTT_EVENTS, timeout_ms);
+
+        if (num_ready < 0 && errno != EINTR) {
+            sprint_error(mqtt_logger, "MQTT client is unable to wait: %s\n", strerror(errno));
+            break;
+        }
+
+        now = now_ms();
+        for (int i = 0; i < num_ready && running; i++) {
+            if (events[i].data.ptr == &stop_fd) {
+                continue; // ends the loop
+            }
+            if (events[i].data.ptr == &wake_fd) {
+                take_incoming(now);
+            } else {
+                handle_broker(events[i].data.ptr, events[i].events, now);
+            }
+        }
+
+        for (mqtt_broker_t* broker = brokers; broker != NULL && running; broker = broker->next) {
+            handle_deadline(broker, now);
+        }
+    }
+
+    return NULL;
+}
+
+int mqtt_start(const logger_t* logger, int queue_size) {
+    capacity = queue_size > 0 ? queue_size : MQTT_QUEUE_SIZE;
+    mqtt_logger = logger;
+
+    // no action publishes
+    if (brokers == NULL) {
+        return 1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        sprint_error(logger, "Unable to create the MQTT event loop: %s\n", strerror(errno));
+        return 0;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &wake_fd };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+
+    // ends the loop once we're stopping
+    event.data.ptr = &stop_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
+
+    if (!start_thread(&mqtt_thread, mqtt_run, NULL)) {
+        sprint_error(logger, "Unable to start the MQTT client\n");
+        return 0;
+    }
+    started = 1;
+
+    pthread_setname_np(mqtt_thread, "srd-mqtt");
+
+    print_debug(logger, "Started the MQTT client (queue size %d)\n", capacity);
+
+    return 1;
+}
+
+int mqtt_publish(const logger_t* logger, mqtt_broker_t* broker, const char* topic, const char* payload,
+                 int qos, int retain) {
+    size_t topic_length = strlen(topic);
+    size_t payload_length = strlen(payload);
+
+    if (topic_length == 0 || topic_length > 0xFFFF) {
+        sprint_error(logger, "[MQTT]: Invalid topic: %s\n", topic);
+        return 0;
+    }
+
+    pthread_mutex_lock(&mqtt_mut);
+
+    if (!started || !running || pending >= capacity) {
+        dropped++;
+
+        // print only once per interval of the metrics; a broker may be down for long
+        if (running && dropped_interval++ == 0) {
+            sprint_error(logger, "MQTT queue is full (%d messages). Dropping messages until the brokers caught up.\n", capacity);
+        }
+        pthread_mutex_unlock(&mqtt_mut);
+
+        return 0;
+    }
+    pending++;
+
+    pthread_mutex_unlock(&mqtt_mut);
+
+    size_t length = 2 + topic_length + (qos > 0 ? 2 : 0) + payload_length;
+
+    mqtt_message_t* message = calloc(1, sizeof(mqtt_message_t));
+    message->logger = logger;
+    message->broker = broker;
+    message->qos = qos;
+    message->packet = malloc(length + 5);
+
+    size_t i = 0;
+    message->packet[i++] = MQTT_PUBLISH | (qos << 1) | (retain ? 0x01 : 0);
+    i += put_length(message->packet + i, length);
+    i += put_string(message->packet + i, topic, topic_length);
+    if (qos > 0) {
+        message->id_offset = i;
+        i += 2;
+    }
+    memcpy(message->packet + i, payload, payload_length);
+    message->length = i + payload_length;
+
+    pthread_mutex_lock(&mqtt_mut);
+    if (incoming_tail == NULL) {
+        incoming_head = message;
+    } else {
+        incoming_tail->next = message;
+    }
+    incoming_tail = message;
+    pthread_mutex_unlock(&mqtt_mut);
+
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        sprint_error(logger, "Unable to wake the MQTT client: %s\n", strerror(errno));
+    }
+
+    return 1;
+}
+
+void mqtt_print_metrics(const logger_t* logger) {
+    if (brokers == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&mqtt_mut);
+
+    // messages were lost: that is worth more than a debug message
+    if (dropped_interval > 0) {
+        sprint_info(logger, METRICS_FORMAT, pending, (unsigned long) published,
+            (unsigned long) dropped, (unsigned long) dropped_interval);
+    } else {
+        sprint_debug(logger, METRICS_FORMAT, pending, (unsigned long) published,
+            (unsigned long) dropped, (unsigned long) dropped_interval);
+    }
+    dropped_interval = 0;
+
+    pthread_mutex_unlock(&mqtt_mut);
+}
+
+static void free_messages(mqtt_message_t* message) {
+    while (message != NULL) {
+        mqtt_message_t* next = message->next;
+        free(message->packet);
+        free(message);
+        message = next;
+    }
+}
+
+void mqtt_stop(const logger_t* logger) {
+    if (started) {
+        pthread_join(mqtt_thread, NULL);
+        started = 0;
+    }
+
+    if (pending > 0) {
+        sprint_info(logger, "Dropping %d pending MQTT messages\n", pending);
+    }
+    free_messages(incoming_head);
+    incoming_head = NULL;
+    incoming_tail = NULL;
+
+    while (brokers != NULL) {
+        mqtt_broker_t* broker = brokers;
+        brokers = broker->next;
+
+        // best effort; the broker keeps the session (and the retained messages) anyway
+        if (broker->state == MQTT_CONNECTED) {
+            uint8_t packet[2] = { MQTT_DISCONNECT, 0 };
+            if (send(broker->fd, packet, sizeof(packet), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+                sprint_debug(logger, "[MQTT]: Unable to disconnect from %s: %s\n", broker->authority, strerror(errno));
+            }
+        }
+        if (broker->fd >= 0) {
+            close(broker->fd);
+        }
+        if (broker->resolving != NULL) {
+            resolve_cancel(broker->resolving);
+        }
+
+        free_messages(broker->head);
+        free_messages(broker->inflight);
+        free(broker->out);
+        free(broker->config);
+        free(broker->host);
+        free(broker->client_id);
+        free(broker->username);
+        free(broker->password);
+        free(broker);
+    }
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+}
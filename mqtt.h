@@ -0,0 +1,60 @@
+#ifndef SRD_MQTT_H
+#define SRD_MQTT_H
+
+#include "printing.h"
+
+/* Defaults of the MQTT client; the queue size is configurable in srd.conf */
+#define MQTT_QUEUE_SIZE 1024
+#define MQTT_PORT 1883
+#define MQTT_KEEPALIVE 60
+
+/* Delay before reconnecting to a broker; doubled for each failed try */
+#define MQTT_BACKOFF_MS 1000
+#define MQTT_BACKOFF_MAX_MS 60000
+
+/* Time to establish the connection and to receive the CONNACK */
+#define MQTT_CONNECT_TIMEOUT_MS 10000
+
+/* Messages with QoS 1 sent to one broker but not yet acknowledged */
+#define MQTT_INFLIGHT 64
+
+typedef struct mqtt_broker_t mqtt_broker_t;
+
+/*
+ * Returns the broker at host (IP or hostname) and port for client_id, used by
+ * the actions of config. All actions using the same broker and client_id share
+ * its connection and session, so they must use the same username, password
+ * (both may be NULL) and keepalive (in seconds); else NULL is returned.
+ * Must be called before mqtt_start.
+ */
+mqtt_broker_t* mqtt_broker(const logger_t* logger, const char* config, const char* host, int port, const char* client_id,
+                           const char* username, const char* password, int keepalive);
+
+/*
+ * Starts the thread keeping the connections to all brokers if there is any.
+ * At most queue_size messages are pending; further messages are dropped.
+ * Returns 1 on success, else 0.
+ */
+int mqtt_start(const logger_t* logger, int queue_size);
+
+/*
+ * Queues payload to be published to topic with qos (0 or 1) and the retain
+ * flag. Messages with QoS 1 are kept until the broker acknowledged them and
+ * sent again after a reconnect. Never blocks; returns 0 if the queue is full
+ * and the message was dropped.
+ */
+int mqtt_publish(const logger_t* logger, mqtt_broker_t* broker, const char* topic, const char* payload,
+                 int qos, int retain);
+
+/*
+ * Prints the amount of pending, published and dropped messages.
+ */
+void mqtt_print_metrics(const logger_t* logger);
+
+/*
+ * Waits for the thread, which ends once we're stopping, disconnects from all
+ * brokers, drops the pending messages and frees the brokers.
+ */
+void mqtt_stop(const logger_t* logger);
+
+#endif
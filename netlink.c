@@ -0,0 +1,1051 @@
+#include <arpa/inet.h>
+#include <errno.h>
+// before linux/if.h, which then leaves out its duplicate definitions
+#include <net/if.h>
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "netlink.h"
+#include "srd.h"
+#include "printing.h"
+#include "prober.h"
+#include "util.h"
+
+#define NETLINK_BUFFER_SIZE 16384
+
+/* Time the kernel has to answer a request */
+#define NETLINK_TIMEOUT_MS 1000
+
+/*
+ * A default route of one address family.
+ */
+typedef struct gateway_t
+{
+    // is 1 if there is a default route for this family
+    int valid;
+
+    // IP address of the gateway
+    char address[INET6_ADDRSTRLEN];
+
+    // IP of the gateway, with scope id set for link local IPv6 gateways
+    struct sockaddr_storage sockaddr;
+
+    // metric of the route
+    uint32_t priority;
+} gateway_t;
+
+/* socket on which we receive route changes */
+static int nl_socket = -1;
+
+/* gateways[0] is the IPv4, gateways[1] the IPv6 default gateway */
+static gateway_t gateways[2];
+static pthread_mutex_t gateways_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* incremented each time one of the gateways changes */
+static _Atomic unsigned int gateways_generation = 1;
+
+/* incremented each time a unicast route of the main table or the carrier of an interface changes */
+static _Atomic unsigned int routes_generation = 1;
+
+/*
+ * The interface an address was reached through in one routes_generation.
+ */
+typedef struct route_entry_t
+{
+    struct sockaddr_storage address;
+
+    int oif;
+} route_entry_t;
+
+struct route_cache_t
+{
+    // netlink socket of the lookups; -1 until used
+    int fd;
+
+    // sequence number of the latest request; older answers are skipped
+    uint32_t sequence;
+
+    // routes_generation of the entries
+    unsigned int generation;
+
+    // open addressing by the hash of the address; empty entries have AF_UNSPEC
+    route_entry_t* entries;
+    uint32_t capacity;
+    uint32_t used;
+};
+
+/*
+ * Carrier state of one interface.
+ */
+typedef struct link_t
+{
+    int ifindex;
+
+    // is 1 if the interface is up and has a carrier
+    int up;
+} link_t;
+
+/* state of all interfaces we know of */
+static link_t* links = NULL;
+static int links_count = 0;
+static pthread_mutex_t links_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* all checks; these get notified when the carrier of their interface changes */
+static connectivity_check_t** watched_checks = NULL;
+static int watched_count = 0;
+
+/*
+ * Parses the route in nh. Returns 1 if it is a default route of the main
+ * table with a gateway and fills gw, else 0.
+ */
+static int parse_default_route(struct nlmsghdr* nh, gateway_t* gw) {
+    struct rtmsg* rtm = NLMSG_DATA(nh);
+
+    if (rtm->rtm_dst_len != 0 || rtm->rtm_type != RTN_UNICAST) {
+        return 0;
+    }
+    if (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) {
+        return 0;
+    }
+
+    uint32_t table = rtm->rtm_table;
+    int oif = 0;
+    void* gateway = NULL;
+
+    memset(gw, 0, sizeof(gateway_t));
+
+    int len = RTM_PAYLOAD(nh);
+    for (struct rtattr* attr = RTM_RTA(rtm); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+        switch (attr->rta_type) {
+            case RTA_TABLE:
+                table = *(uint32_t*) RTA_DATA(attr);
+                break;
+            case RTA_GATEWAY:
+                gateway = RTA_DATA(attr);
+                break;
+            case RTA_OIF:
+                oif = *(int*) RTA_DATA(attr);
+                break;
+            case RTA_PRIORITY:
+                gw->priority = *(uint32_t*) RTA_DATA(attr);
+                break;
+        }
+    }
+
+    if (table != RT_TABLE_MAIN || gateway == NULL) {
+        return 0;
+    }
+
+    if (rtm->rtm_family == AF_INET) {
+        struct sockaddr_in* addr = (struct sockaddr_in*) &gw->sockaddr;
+
+        addr->sin_family = AF_INET;
+        memcpy(&addr->sin_addr, gateway, sizeof(struct in_addr));
+    } else {
+        struct sockaddr_in6* addr = (struct sockaddr_in6*) &gw->sockaddr;
+
+        addr->sin6_family = AF_INET6;
+        memcpy(&addr->sin6_addr, gateway, sizeof(struct in6_addr));
+
+        // link local gateways are only reachable via the interface of the route
+        if (IN6_IS_ADDR_LINKLOCAL(&addr->sin6_addr)) {
+            addr->sin6_scope_id = oif;
+        }
+    }
+    inet_ntop(rtm->rtm_family, gateway, gw->address, INET6_ADDRSTRLEN);
+    gw->valid = 1;
+
+    return 1;
+}
+
+/*
+ * Returns 1 if the route in nh is a unicast route of the main table, else 0.
+ */
+static int is_main_unicast(struct nlmsghdr* nh) {
+    struct rtmsg* rtm = NLMSG_DATA(nh);
+
+    if (rtm->rtm_type != RTN_UNICAST) {
+        return 0;
+    }
+
+    uint32_t table = rtm->rtm_table;
+    int len = RTM_PAYLOAD(nh);
+    for (struct rtattr* attr = RTM_RTA(rtm); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+        if (attr->rta_type == RTA_TABLE) {
+            table = *(uint32_t*) RTA_DATA(attr);
+        }
+    }
+
+    return table == RT_TABLE_MAIN;
+}
+
+/*
+ * Requests a dump of type (RTM_GETROUTE or RTM_GETLINK) for family and calls
+ * handle for each message of the answer. Returns 1 on success, else 0.
+ */
+static int dump(const logger_t* logger, const int type, const int family,
+                void (*handle)(const logger_t*, struct nlmsghdr*, void*), void* ctx) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        sprint_error(logger, "Unable to open netlink socket: %s\n", strerror(errno));
+        return 0;
+    }
+
+    struct {
+        struct nlmsghdr nh;
+        union {
+            struct rtmsg rtm;
+            struct ifinfomsg ifi;
+        };
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.nh.nlmsg_type = type;
+    request.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+
+    if (type == RTM_GETLINK) {
+        request.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+        request.ifi.ifi_family = family;
+    } else {
+        request.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+        request.rtm.rtm_family = family;
+    }
+
+    if (send(fd, &request, request.nh.nlmsg_len, 0) < 0) {
+        sprint_error(logger, "Unable to request dump from the kernel: %s\n", strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    char buffer[NETLINK_BUFFER_SIZE];
+    int done = 0;
+
+    while (!done) {
+        ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (len < 0) {
+            if (errno == EINTR) continue;
+
+            sprint_error(logger, "Unable to receive dump from the kernel: %s\n", strerror(errno));
+            close(fd);
+            return 0;
+        }
+
+        for (struct nlmsghdr* nh = (struct nlmsghdr*) buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == NLMSG_DONE || nh->nlmsg_type == NLMSG_ERROR) {
+                done = 1;
+                break;
+            }
+            handle(logger, nh, ctx);
+        }
+    }
+    close(fd);
+
+    return 1;
+}
+
+/*
+ * Stores the default route in nh inside ctx (a gateway_t) if it has
+ * a lower metric than the one stored.
+ */
+static void handle_default_route(const logger_t* logger, struct nlmsghdr* nh, void* ctx) {
+    (void) logger;
+    gateway_t* best = (gateway_t*) ctx;
+    gateway_t current;
+
+    if (nh->nlmsg_type != RTM_NEWROUTE) {
+        return;
+    }
+    if (parse_default_route(nh, &current) && (!best->valid || current.priority < best->priority)) {
+        *best = current;
+    }
+}
+
+/*
+ * Dumps the routes of family and stores the default route with the
+ * lowest metric. Returns 1 on success, else 0.
+ */
+static int load_gateway(const logger_t* logger, const int family) {
+    gateway_t best = { .valid = 0 };
+
+    if (!dump(logger, RTM_GETROUTE, family, handle_default_route, &best)) {
+        return 0;
+    }
+
+    gateway_t* gw = &gateways[family == AF_INET ? 0 : 1];
+
+    pthread_mutex_lock(&gateways_mut);
+    if (gw->valid != best.valid || strcmp(gw->address, best.address) != 0) {
+        *gw = best;
+        gateways_generation++;
+
+        if (best.valid) {
+            sprint_info(logger, "Default gateway (%s) is now %s\n", family == AF_INET ? "IPv4" : "IPv6", best.address);
+        } else {
+            sprint_info(logger, "No default gateway (%s)\n", family == AF_INET ? "IPv4" : "IPv6");
+        }
+    }
+    pthread_mutex_unlock(&gateways_mut);
+
+    return 1;
+}
+
+/*
+ * Returns 1 if the interface ifindex is up and has a carrier (or if we
+ * do not know it), else 0.
+ */
+static int is_link_up(const int ifindex) {
+    int up = 1;
+
+    pthread_mutex_lock(&links_mut);
+    for (int i = 0; i < links_count; i++) {
+        if (links[i].ifindex == ifindex) {
+            up = links[i].up;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&links_mut);
+
+    return up;
+}
+
+/*
+ * Updates the state of the link in nh and notifies all checks reached through it
+ * (or depending on such a check) if its carrier changed.
+ */
+static void handle_link(const logger_t* logger, struct nlmsghdr* nh, void* ctx) {
+    (void) ctx;
+
+    if (nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK) {
+        return;
+    }
+
+    struct ifinfomsg* ifi = NLMSG_DATA(nh);
+    int up = nh->nlmsg_type == RTM_NEWLINK && (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_LOWER_UP);
+    int changed = 0;
+    int i;
+
+    pthread_mutex_lock(&links_mut);
+    for (i = 0; i < links_count; i++) {
+        if (links[i].ifindex == ifi->ifi_index) {
+            changed = links[i].up != up;
+            links[i].up = up;
+            break;
+        }
+    }
+    if (i == links_count) {
+        links = realloc(links, (links_count + 1) * sizeof(link_t));
+        links[links_count].ifindex = ifi->ifi_index;
+        links[links_count].up = up;
+        links_count++;
+    }
+    pthread_mutex_unlock(&links_mut);
+
+    if (!changed) {
+        return;
+    }
+
+    sprint_info(logger, "Interface %d is now %s\n", ifi->ifi_index, up ? "UP" : "DOWN (no carrier)");
+
+    // the kernel may pick other routes now
+    routes_generation++;
+
+    for (int j = 0; j < watched_count; j++) {
+        connectivity_check_t* check = watched_checks[j];
+
+        if (check->oif == ifi->ifi_index) {
+            check->link_down = !up;
+            prober_wake(check);
+        }
+    }
+
+    // dependents await their dependency or check again
+    for (int j = 0; j < watched_count; j++) {
+        connectivity_check_t* check = watched_checks[j];
+
+        if (check->dependency != NULL && check->dependency->oif == ifi->ifi_index) {
+            prober_wake(check);
+        }
+    }
+}
+
+int netlink_init(const logger_t* logger) {
+    nl_socket = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (nl_socket < 0) {
+        print_error(logger, "Unable to open netlink socket: %s\n", strerror(errno));
+        return 0;
+    }
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE | RTMGRP_LINK;
+
+    if (bind(nl_socket, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        print_error(logger, "Unable to subscribe to route changes: %s\n", strerror(errno));
+        close(nl_socket);
+        nl_socket = -1;
+        return 0;
+    }
+
+    // load after subscribing to not miss a change in between
+    return load_gateway(logger, AF_INET) &&
+            load_gateway(logger, AF_INET6) &&
+            dump(logger, RTM_GETLINK, AF_UNSPEC, handle_link, NULL);
+}
+
+void netlink_watch(connectivity_check_t** checks, const int n) {
+    watched_checks = checks;
+    watched_count = n;
+}
+
+void netlink_close() {
+    if (nl_socket >= 0) {
+        close(nl_socket);
+        nl_socket = -1;
+    }
+
+    free(links);
+    links = NULL;
+    links_count = 0;
+}
+
+/*
+ * Waits for up to timeout_ms for route changes (or until we're stopping) and
+ * reloads the gateway of each family which had its default route changed.
+ * Returns 0 if an error occured, -1 if interrupt_fd (may be -1) became
+ * readable, else 1.
+ */
+static int process_events(const logger_t* logger, const int timeout_ms, const int interrupt_fd) {
+    struct pollfd pfds[3] = {
+        { .fd = nl_socket, .events = POLLIN },
+        { .fd = stop_fd, .events = POLLIN }, // we're stopping
+        { .fd = interrupt_fd, .events = POLLIN },
+    };
+
+    int num_ready = poll(pfds, 3, timeout_ms);
+    if (num_ready < 0) {
+        return errno == EINTR;
+    } else if (pfds[2].revents) {
+        return -1;
+    } else if (num_ready == 0 || pfds[1].revents) {
+        return 1;
+    }
+
+    char buffer[NETLINK_BUFFER_SIZE];
+    int reload_v4 = 0;
+    int reload_v6 = 0;
+    ssize_t len;
+
+    while ((len = recv(nl_socket, buffer, sizeof(buffer), 0)) > 0) {
+        for (struct nlmsghdr* nh = (struct nlmsghdr*) buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK) {
+                handle_link(logger, nh, NULL);
+                continue;
+            }
+            if (nh->nlmsg_type != RTM_NEWROUTE && nh->nlmsg_type != RTM_DELROUTE) {
+                continue;
+            }
+
+            // checks need to look up their interface again; they only
+            // follow unicast routes of the main table
+            if (is_main_unicast(nh)) {
+                routes_generation++;
+            }
+
+            gateway_t gw;
+            if (!parse_default_route(nh, &gw)) {
+                continue;
+            }
+
+            // a default route changed: reload it as there may be others with a higher metric
+            if (gw.sockaddr.ss_family == AF_INET) {
+                reload_v4 = 1;
+            } else {
+                reload_v6 = 1;
+            }
+        }
+    }
+
+    // the kernel dropped messages: we do not know what changed
+    if (len < 0 && errno == ENOBUFS) {
+        reload_v4 = 1;
+        reload_v6 = 1;
+        routes_generation++;
+        dump(logger, RTM_GETLINK, AF_UNSPEC, handle_link, NULL);
+    }
+
+    if (reload_v4) {
+        load_gateway(logger, AF_INET);
+    }
+    if (reload_v6) {
+        load_gateway(logger, AF_INET6);
+    }
+
+    return 1;
+}
+
+int netlink_wait_gateway(const logger_t* logger, const int interrupt_fd) {
+    int announced = 0;
+
+    while (running) {
+        pthread_mutex_lock(&gateways_mut);
+        int found = gateways[0].valid || gateways[1].valid;
+        pthread_mutex_unlock(&gateways_mut);
+
+        if (found) {
+            return 1;
+        }
+
+        if (!announced) {
+            print_error(logger, "Unable to get default gateway. Waiting for one... \n");
+            announced = 1;
+        }
+
+        int s = process_events(logger, 1000, interrupt_fd);
+        if (s < 0) {
+            return -1;
+        } else if (s == 0) {
+            print_error(logger, "Unable to receive route changes: %s\n", strerror(errno));
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+void* netlink_run(void* arg) {
+    const logger_t* logger = (const logger_t*) arg;
+
+    while (running) {
+        if (!process_events(logger, -1, -1)) {
+            sprint_error(logger, "Unable to receive route changes: %s\n", strerror(errno));
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int get_gateway(char* address, const size_t len, struct sockaddr_storage* sockaddr) {
+    int found = 0;
+
+    pthread_mutex_lock(&gateways_mut);
+    for (int i = 0; i < 2; i++) {
+        if (gateways[i].valid) {
+            strncpy(address, gateways[i].address, len - 1);
+            address[len - 1] = '\0';
+
+            if (sockaddr != NULL) {
+                *sockaddr = gateways[i].sockaddr;
+            }
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gateways_mut);
+
+    return found;
+}
+
+void follow_gateway(const logger_t* logger, connectivity_check_t* check) {
+    unsigned int generation = gateways_generation;
+
+    if (check->gateway_generation == generation) {
+        return;
+    }
+    check->gateway_generation = generation;
+
+    char address[INET6_ADDRSTRLEN];
+    struct sockaddr_storage sockaddr;
+
+    if (!get_gateway(address, INET6_ADDRSTRLEN, &sockaddr)) {
+        sprint_error(logger, "There is no default gateway. Keep pinging %s\n", check->address);
+        return;
+    }
+
+    if (strcmp(address, check->address) == 0) {
+        return;
+    }
+
+    sprint_info(logger, "Gateway changed from %s to %s\n", check->address, address);
+
+    // address has space for any IP (see load_config)
+    strcpy((char*) check->address, address);
+    *check->sockaddr = sockaddr;
+
+    // the address is part of the packet template
+    check->template_family = 0;
+
+    // and it may be reached through another interface
+    check->route_generation = 0;
+}
+
+/*
+ * Appends the attribute type with len bytes of data to the message nh.
+ * Returns the offset of the data inside the message.
+ */
+static size_t add_attribute(struct nlmsghdr* nh, const int type, const void* data, const size_t len) {
+    struct rtattr* attr = (struct rtattr*) (((char*) nh) + NLMSG_ALIGN(nh->nlmsg_len));
+    attr->rta_type = type;
+    attr->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(attr), data, len);
+
+    size_t offset = (char*) RTA_DATA(attr) - (char*) nh;
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(attr->rta_len);
+
+    return offset;
+}
+
+static const void* address_of(const struct sockaddr_storage* sockaddr, size_t* len) {
+    if (sockaddr->ss_family == AF_INET) {
+        *len = sizeof(struct in_addr);
+        return &((const struct sockaddr_in*) sockaddr)->sin_addr;
+    }
+
+    *len = sizeof(struct in6_addr);
+    return &((const struct sockaddr_in6*) sockaddr)->sin6_addr;
+}
+
+route_cache_t* route_cache_new(const uint32_t n) {
+    route_cache_t* cache = calloc(1, sizeof(route_cache_t));
+    cache->fd = -1;
+
+    // at most half full if each check has its own address
+    cache->capacity = 16;
+    while (cache->capacity < 2 * n) {
+        cache->capacity *= 2;
+    }
+    cache->entries = calloc(cache->capacity, sizeof(route_entry_t));
+
+    return cache;
+}
+
+void route_cache_free(route_cache_t* cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    if (cache->fd >= 0) {
+        close(cache->fd);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+/*
+ * Returns the entry of address in cache: the one holding it or the empty one
+ * where it belongs. Returns NULL if it is not in the full cache.
+ */
+static route_entry_t* find_route(route_cache_t* cache, const struct sockaddr_storage* address) {
+    size_t len;
+    const uint8_t* bytes = address_of(address, &len);
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    for (uint32_t i = 0; i < cache->capacity; i++) {
+        route_entry_t* entry = &cache->entries[(hash + i) & (cache->capacity - 1)];
+        size_t entry_len;
+
+        if (entry->address.ss_family == AF_UNSPEC) {
+            return entry;
+        }
+        if (entry->address.ss_family == address->ss_family &&
+                memcmp(address_of(&entry->address, &entry_len), bytes, len) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Asks the kernel through the socket of cache through which interface sockaddr
+ * is reached. Returns the index of the interface, 0 if it is unknown.
+ */
+static int lookup_oif(const logger_t* logger, route_cache_t* cache, const struct sockaddr_storage* sockaddr) {
+    if (cache->fd < 0) {
+        cache->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    }
+    if (cache->fd < 0) {
+        sprint_error(logger, "Unable to open netlink socket: %s\n", strerror(errno));
+        return 0;
+    }
+
+    struct {
+        struct nlmsghdr nh;
+        struct rtmsg rtm;
+        char attributes[RTA_SPACE(sizeof(struct in6_addr))];
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    request.nh.nlmsg_type = RTM_GETROUTE;
+    request.nh.nlmsg_flags = NLM_F_REQUEST;
+    request.nh.nlmsg_seq = ++cache->sequence;
+    request.rtm.rtm_family = sockaddr->ss_family;
+
+    size_t address_len;
+    const void* address = address_of(sockaddr, &address_len);
+    request.rtm.rtm_dst_len = address_len * 8;
+    add_attribute(&request.nh, RTA_DST, address, address_len);
+
+    if (send(cache->fd, &request, request.nh.nlmsg_len, 0) < 0) {
+        sprint_error(logger, "Unable to look up the route: %s\n", strerror(errno));
+        return 0;
+    }
+
+    char buffer[NETLINK_BUFFER_SIZE];
+    int oif = 0;
+    int done = 0;
+
+    // answers to earlier requests which timed out may still be queued
+    while (!done) {
+        if (wait_fd(cache->fd, POLLIN, NETLINK_TIMEOUT_MS) <= 0) {
+            sprint_error(logger, "No answer from the kernel to the route lookup\n");
+            break;
+        }
+
+        ssize_t len = recv(cache->fd, buffer, sizeof(buffer), 0);
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+
+            sprint_error(logger, "Unable to receive the route: %s\n", strerror(errno));
+            break;
+        }
+
+        for (struct nlmsghdr* nh = (struct nlmsghdr*) buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_seq != cache->sequence) {
+                continue;
+            }
+            done = 1;
+
+            if (nh->nlmsg_type != RTM_NEWROUTE) {
+                // NLMSG_ERROR, f.ex. the network is unreachable
+                continue;
+            }
+
+            int attr_len = RTM_PAYLOAD(nh);
+            for (struct rtattr* rta = RTM_RTA(NLMSG_DATA(nh)); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+                if (rta->rta_type == RTA_OIF) {
+                    oif = *(int*) RTA_DATA(rta);
+                }
+            }
+        }
+    }
+
+    return oif;
+}
+
+void follow_route(const logger_t* logger, connectivity_check_t* check, route_cache_t* cache) {
+    unsigned int generation = routes_generation;
+
+    if (check->route_generation == generation || check->sockaddr->ss_family == AF_UNSPEC) {
+        return;
+    }
+    check->route_generation = generation;
+
+    // the interfaces of the previous generation are outdated
+    if (cache->generation != generation) {
+        memset(cache->entries, 0, cache->capacity * sizeof(route_entry_t));
+        cache->used = 0;
+        cache->generation = generation;
+    }
+
+    int oif;
+    route_entry_t* entry = find_route(cache, check->sockaddr);
+
+    if (entry != NULL && entry->address.ss_family != AF_UNSPEC) {
+        oif = entry->oif;
+    } else {
+        oif = lookup_oif(logger, cache, check->sockaddr);
+
+        // keep a free entry, else find_route would not end for unknown addresses
+        if (entry != NULL && cache->used + 1 < cache->capacity) {
+            entry->address = *check->sockaddr;
+            entry->oif = oif;
+            cache->used++;
+        }
+    }
+
+    if (oif != check->oif) {
+        sprint_debug(logger, "Reached through interface %d\n", oif);
+    }
+
+    check->oif = oif;
+    check->link_down = oif != 0 && !is_link_up(oif);
+}
+
+void netlink_build_route(action_route_t* route) {
+    // header, destination, gateway, interface, metric and table
+    size_t size = NLMSG_SPACE(sizeof(struct rtmsg)) + 2 * RTA_SPACE(sizeof(struct in6_addr)) + 3 * RTA_SPACE(sizeof(uint32_t));
+    struct nlmsghdr* nh = calloc(1, size);
+
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    switch (route->operation) {
+        case ROUTE_REPLACE:
+            nh->nlmsg_type = RTM_NEWROUTE;
+            nh->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+            break;
+        case ROUTE_ADD:
+            nh->nlmsg_type = RTM_NEWROUTE;
+            nh->nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+            break;
+        case ROUTE_DELETE:
+            nh->nlmsg_type = RTM_DELROUTE;
+            break;
+    }
+
+    struct rtmsg* rtm = NLMSG_DATA(nh);
+    rtm->rtm_family = route->destination.ss_family;
+    rtm->rtm_dst_len = route->prefix;
+    rtm->rtm_table = route->table < 256 ? route->table : RT_TABLE_UNSPEC;
+    if (route->operation != ROUTE_DELETE) {
+        rtm->rtm_protocol = RTPROT_STATIC;
+        rtm->rtm_type = RTN_UNICAST;
+        // routes without a next hop are on the link
+        rtm->rtm_scope = route->gateway.ss_family == AF_UNSPEC ? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE;
+    } else {
+        rtm->rtm_scope = RT_SCOPE_NOWHERE;
+    }
+
+    size_t len;
+    const void* address;
+    if (route->prefix > 0) {
+        address = address_of(&route->destination, &len);
+        add_attribute(nh, RTA_DST, address, len);
+    }
+    if (route->gateway.ss_family != AF_UNSPEC) {
+        address = address_of(&route->gateway, &len);
+        add_attribute(nh, RTA_GATEWAY, address, len);
+    }
+
+    // the index is looked up before each send as the interface may be recreated
+    uint32_t value = 0;
+    route->oif_offset = route->interface != NULL ? add_attribute(nh, RTA_OIF, &value, sizeof(value)) : 0;
+
+    if (route->metric >= 0) {
+        value = route->metric;
+        add_attribute(nh, RTA_PRIORITY, &value, sizeof(value));
+    }
+    value = route->table;
+    add_attribute(nh, RTA_TABLE, &value, sizeof(value));
+
+    route->request = nh;
+}
+
+/*
+ * Sends request on fd and waits for the kernel to acknowledge it; other
+ * messages received meanwhile are skipped.
+ * Returns 1 on success, else 0 and sets errno.
+ */
+static int send_acknowledged(const int fd, struct nlmsghdr* request) {
+    if (send(fd, request, request->nlmsg_len, 0) < 0) {
+        return 0;
+    }
+
+    char buffer[NETLINK_BUFFER_SIZE];
+    while (1) {
+        int ready = wait_fd(fd, POLLIN, NETLINK_TIMEOUT_MS);
+        if (ready <= 0) {
+            if (ready == 0) {
+                errno = ETIMEDOUT;
+            }
+            return 0;
+        }
+
+        ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+        if (len < 0) {
+            // notifications were dropped, the answer may still come
+            if (errno == EINTR || errno == ENOBUFS) continue;
+            return 0;
+        }
+
+        for (struct nlmsghdr* nh = (struct nlmsghdr*) buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == NLMSG_ERROR && nh->nlmsg_seq == request->nlmsg_seq) {
+                int error = -((struct nlmsgerr*) NLMSG_DATA(nh))->error;
+                if (error != 0) {
+                    errno = error;
+                    return 0;
+                }
+                return 1;
+            }
+        }
+    }
+}
+
+int netlink_route(action_route_t* route) {
+    struct nlmsghdr* request = route->request;
+
+    // filled in place; the pipeline runs an action only in one worker at a time
+    if (route->interface != NULL) {
+        uint32_t oif = if_nametoindex(route->interface);
+        if (oif == 0) {
+            return 0; // errno is ENODEV
+        }
+        memcpy((char*) request + route->oif_offset, &oif, sizeof(oif));
+    }
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        return 0;
+    }
+
+    int success = send_acknowledged(fd, request);
+
+    int error = errno;
+    close(fd);
+    errno = error;
+
+    return success;
+}
+
+/*
+ * Sets or clears IFF_UP of the interface ifindex.
+ * Returns 1 on success, else 0 and sets errno.
+ */
+static int set_link_up(const int fd, const int ifindex, const int up, const uint32_t seq) {
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request.nh.nlmsg_type = RTM_NEWLINK;
+    request.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    request.nh.nlmsg_seq = seq;
+    request.ifi.ifi_family = AF_UNSPEC;
+    request.ifi.ifi_index = ifindex;
+    request.ifi.ifi_change = IFF_UP;
+    request.ifi.ifi_flags = up ? IFF_UP : 0;
+
+    return send_acknowledged(fd, &request.nh);
+}
+
+/*
+ * Waits up to timeout_ms until the interface ifindex has a carrier. fd has to
+ * be subscribed to the changes of the links.
+ * Returns 1 once it has one, else 0 and sets errno (ETIMEDOUT on timeout).
+ */
+static int wait_carrier(const int fd, const int ifindex, const int timeout_ms, const uint32_t seq) {
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } request;
+
+    // asks for the current state; the carrier may have returned before
+    memset(&request, 0, sizeof(request));
+    request.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request.nh.nlmsg_type = RTM_GETLINK;
+    request.nh.nlmsg_flags = NLM_F_REQUEST;
+    request.nh.nlmsg_seq = seq;
+    request.ifi.ifi_family = AF_UNSPEC;
+    request.ifi.ifi_index = ifindex;
+
+    if (send(fd, &request, request.nh.nlmsg_len, 0) < 0) {
+        return 0;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char buffer[NETLINK_BUFFER_SIZE];
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int remaining_ms = timeout_ms - calculate_difference_ms(start, now);
+        if (remaining_ms <= 0) {
+            errno = ETIMEDOUT;
+            return 0;
+        }
+
+        int ready = wait_fd(fd, POLLIN, remaining_ms);
+        if (ready < 0) {
+            return 0;
+        } else if (ready == 0) {
+            continue;
+        }
+
+        ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+        if (len < 0) {
+            // notifications were dropped: ask again
+            if (errno == ENOBUFS && send(fd, &request, request.nh.nlmsg_len, 0) < 0) {
+                return 0;
+            }
+            continue;
+        }
+
+        for (struct nlmsghdr* nh = (struct nlmsghdr*) buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type != RTM_NEWLINK) {
+                continue;
+            }
+
+            struct ifinfomsg* ifi = NLMSG_DATA(nh);
+            if (ifi->ifi_index == ifindex && (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_LOWER_UP)) {
+                return 1;
+            }
+        }
+    }
+}
+
+int netlink_reset_link(const char* interface, const int down_ms, const int timeout_ms) {
+    int ifindex = if_nametoindex(interface);
+    if (ifindex == 0) {
+        return 0; // errno is ENODEV
+    }
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        return 0;
+    }
+
+    // subscribed before the link goes up to not miss the carrier
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = timeout_ms > 0 ? RTMGRP_LINK : 0;
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return 0;
+    }
+
+    int success = set_link_up(fd, ifindex, 0, 1);
+    int error = errno;
+    if (success && down_ms > 0) {
+        wait_fd(-1, 0, down_ms);
+    }
+
+    // always brought up again: the answer to taking it down may only be missing as we're stopping
+    if (!set_link_up(fd, ifindex, 1, 2) && success) {
+        success = 0;
+        error = errno;
+    }
+
+    if (success && timeout_ms > 0) {
+        success = wait_carrier(fd, ifindex, timeout_ms, 3);
+        error = errno;
+    }
+    close(fd);
+    errno = error;
+
+    return success;
+}
@@ -0,0 +1,96 @@
+#ifndef SRD_NETLINK_H
+#define SRD_NETLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+struct sockaddr_storage;
+
+#include "srd.h"
+#include "printing.h"
+
+/*
+ * Opens the rtnetlink socket on which we get notified about route changes
+ * and loads the current default gateways (IPv4 and IPv6).
+ * Returns 1 on success, else 0.
+ */
+int netlink_init(const logger_t* logger);
+
+/*
+ * Sets the checks which are notified if the carrier of the interface
+ * they are reached through changes.
+ */
+void netlink_watch(connectivity_check_t** checks, const int n);
+
+/*
+ * Closes the rtnetlink socket.
+ */
+void netlink_close();
+
+/*
+ * Blocks until a default gateway is known or interrupt_fd (f.ex. a signalfd)
+ * becomes readable. Returns 1 if there is one, -1 if interrupted and 0 if
+ * we're stopping before one appeared.
+ */
+int netlink_wait_gateway(const logger_t* logger, const int interrupt_fd);
+
+/*
+ * Processes route changes until we stop. This is run in its own thread
+ * and takes the logger as argument.
+ */
+void* netlink_run(void* logger);
+
+/*
+ * Writes the current default gateway into address (at least INET6_ADDRSTRLEN chars)
+ * and sockaddr. The IPv4 gateway is preferred over the IPv6 one.
+ * Returns 1 if there is a default gateway, else 0.
+ */
+int get_gateway(char* address, const size_t len, struct sockaddr_storage* sockaddr);
+
+/*
+ * Updates the address of check if the default gateway changed since
+ * the last call. Only call this for checks with FLAG_IS_GATEWAY
+ * from the thread running the check.
+ */
+void follow_gateway(const logger_t* logger, connectivity_check_t* check);
+
+/*
+ * The interfaces through which the addresses of the checks of one probe loop
+ * are reached, looked up through its own netlink socket. Checks with the same
+ * address share one lookup after each route change. Only used by one thread.
+ */
+typedef struct route_cache_t route_cache_t;
+
+/*
+ * Returns an empty cache for about n addresses.
+ */
+route_cache_t* route_cache_new(const uint32_t n);
+
+void route_cache_free(route_cache_t* cache);
+
+/*
+ * Looks up through which interface check is reached (in cache) if the routes
+ * changed since the last call and sets link_down accordingly. Only call this
+ * from the thread running the check.
+ */
+void follow_route(const logger_t* logger, connectivity_check_t* check, route_cache_t* cache);
+
+/*
+ * Builds the rtnetlink request of route from its other fields.
+ */
+void netlink_build_route(action_route_t* route);
+
+/*
+ * Sends the request of route to the kernel and waits for its answer.
+ * Returns 1 if the route was installed or deleted, else 0 and sets errno.
+ */
+int netlink_route(action_route_t* route);
+
+/*
+ * Takes interface down and, after down_ms, up again. If timeout_ms is above 0
+ * it waits up to timeout_ms for the carrier to return.
+ * Returns 1 on success, else 0 and sets errno (ETIMEDOUT if the interface is
+ * up but has no carrier).
+ */
+int netlink_reset_link(const char* interface, const int down_ms, const int timeout_ms);
+
+#endif
@@ -0,0 +1,298 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pipeline.h"
+#include "actions.h"
+#include "printing.h"
+#include "srd.h"
+#include "util.h"
+
+/*
+ * An action queued by a check.
+ */
+typedef struct job_t {
+    // logger of the check which queued this
+    const logger_t* logger;
+
+    action_t* action;
+
+    // message, command or line with the placeholders inserted; may be NULL
+    char* text;
+
+    // when this was queued (CLOCK_MONOTONIC)
+    struct timespec queued;
+
+    struct job_t* next;
+} job_t;
+
+/* limit of concurrent actions per type; 0 means as many as there are workers */
+static int limits[ACTION_TYPES] = {
+    [ACTION_SERVICE_RESTART] = 1,
+    [ACTION_REBOOT] = 1,
+};
+
+/* protects everything below */
+static pthread_mutex_t pipeline_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipeline_cond = PTHREAD_COND_INITIALIZER;
+
+static int stopping = 0;
+
+/* queued jobs, oldest first */
+static job_t* head = NULL;
+static job_t* tail = NULL;
+static int queued = 0;
+static int capacity = PIPELINE_QUEUE_SIZE;
+
+static pthread_t* workers = NULL;
+static int workers_count = 0;
+
+/* amount of running actions per type */
+static int running_actions[ACTION_TYPES];
+
+/* metrics; the max_* and *_interval values are reset when printed */
+static uint64_t done = 0;
+static uint64_t dropped = 0;
+static uint64_t dropped_interval = 0;
+static int max_queued = 0;
+static uint64_t waited_count = 0;
+static double waited_ms = 0.0;
+static double max_waited_ms = 0.0;
+
+#define METRICS_FORMAT "Actions: %d queued (at most %d), %d running, %lu done, %lu dropped (%lu recently). Waited %1.1f ms on average, at most %1.1f ms.\n"
+
+int pipeline_set_limit(const char* type, int limit) {
+    int t = action_type(type);
+    if (t < 0) {
+        return 0;
+    }
+    limits[t] = limit > 0 ? limit : 0;
+
+    return 1;
+}
+
+/*
+ * Removes and returns the oldest job which may run now: its action is not
+ * being performed and its type is below the limit. Jobs of the same action
+ * keep their order as a busy action blocks all of its jobs.
+ * Needs pipeline_mut.
+ */
+static job_t* take_job() {
+    job_t* prev = NULL;
+
+    for (job_t* job = head; job != NULL; prev = job, job = job->next) {
+        int limit = limits[job->action->type] > 0 ? limits[job->action->type] : workers_count;
+
+        if (job->action->busy || running_actions[job->action->type] >= limit) {
+            continue;
+        }
+
+        if (prev == NULL) {
+            head = job->next;
+        } else {
+            prev->next = job->next;
+        }
+        if (tail == job) {
+            tail = prev;
+        }
+        queued--;
+
+        return job;
+    }
+
+    return NULL;
+}
+
+static void run_action(const job_t* job) {
+    const logger_t* logger = job->logger;
+    action_t* action = job->action;
+
+    char description[64];
+    action->ops->describe(action, description, sizeof(description));
+    sprint_info(logger, "Performing action: %s (%s)\n", action->ops->name, description);
+
+    action->ops->execute(logger, action, job->text);
+}
+
+static void* worker_run(void* arg) {
+    (void) arg;
+
+    pthread_mutex_lock(&pipeline_mut);
+
+    // do not start any more actions once we're stopping
+    while (!stopping && running) {
+        job_t* job = take_job();
+
+        if (job == NULL) {
+            pthread_cond_wait(&pipeline_cond, &pipeline_mut);
+            continue;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double waited = (now.tv_sec - job->queued.tv_sec) * 1e3 + (now.tv_nsec - job->queued.tv_nsec) / 1e6;
+
+        waited_count++;
+        waited_ms += waited;
+        if (waited > max_waited_ms) {
+            max_waited_ms = waited;
+        }
+
+        running_actions[job->action->type]++;
+        job->action->busy = 1;
+
+        pthread_mutex_unlock(&pipeline_mut);
+
+        run_action(job);
+
+        pthread_mutex_lock(&pipeline_mut);
+
+        running_actions[job->action->type]--;
+        job->action->busy = 0;
+        done++;
+
+        // jobs waiting for this action or type may run now
+        pthread_cond_broadcast(&pipeline_cond);
+
+        free(job->text);
+        free(job);
+    }
+
+    pthread_mutex_unlock(&pipeline_mut);
+
+    return NULL;
+}
+
+int pipeline_start(const logger_t* logger, int count, int queue_size) {
+    capacity = queue_size > 0 ? queue_size : PIPELINE_QUEUE_SIZE;
+
+    if (count <= 0) {
+        count = PIPELINE_WORKERS;
+    }
+
+    workers = calloc(count, sizeof(pthread_t));
+
+    for (workers_count = 0; workers_count < count; workers_count++) {
+        if (!start_thread(&workers[workers_count], worker_run, NULL)) {
+            print_error(logger, "Unable to start action worker %d\n", workers_count);
+            break;
+        }
+    }
+
+    if (workers_count == 0) {
+        return 0;
+    }
+
+    print_debug(logger, "Started %d action workers (queue size %d)\n", workers_count, capacity);
+
+    return 1;
+}
+
+int pipeline_submit(const logger_t* logger, action_t* action, char* text) {
+    pthread_mutex_lock(&pipeline_mut);
+
+    if (stopping || queued >= capacity) {
+        dropped++;
+
+        // print only once per interval of the metrics; the queue may be full for long
+        if (!stopping && dropped_interval++ == 0) {
+            sprint_error(logger, "Action queue is full (%d actions). Dropping actions until the workers caught up.\n", capacity);
+        }
+
+        pthread_mutex_unlock(&pipeline_mut);
+        free(text);
+
+        return 0;
+    }
+
+    job_t* job = malloc(sizeof(job_t));
+    job->logger = logger;
+    job->action = action;
+    job->text = text;
+    job->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &job->queued);
+
+    if (tail == NULL) {
+        head = job;
+    } else {
+        tail->next = job;
+    }
+    tail = job;
+
+    queued++;
+    if (queued > max_queued) {
+        max_queued = queued;
+    }
+
+    pthread_cond_signal(&pipeline_cond);
+    pthread_mutex_unlock(&pipeline_mut);
+
+    sprint_debug(logger, "Queued action: %s\n", action->ops->name);
+
+    return 1;
+}
+
+void pipeline_print_metrics(const logger_t* logger) {
+    pthread_mutex_lock(&pipeline_mut);
+
+    int running_total = 0;
+    for (int i = 0; i < ACTION_TYPES; i++) {
+        running_total += running_actions[i];
+    }
+
+    double average = waited_count > 0 ? waited_ms / waited_count : 0.0;
+
+    // actions were lost: that is worth more than a debug message
+    if (dropped_interval > 0) {
+        sprint_info(logger, METRICS_FORMAT, queued, max_queued, running_total, (unsigned long) done,
+            (unsigned long) dropped, (unsigned long) dropped_interval, average, max_waited_ms);
+    } else {
+        sprint_debug(logger, METRICS_FORMAT, queued, max_queued, running_total, (unsigned long) done,
+            (unsigned long) dropped, (unsigned long) dropped_interval, average, max_waited_ms);
+    }
+
+    for (int i = 0; i < ACTION_TYPES; i++) {
+        if (running_actions[i] > 0) {
+            sprint_debug(logger, "\t%s: %d running (limit %d)\n", action_ops[i].name, running_actions[i], limits[i] > 0 ? limits[i] : workers_count);
+        }
+    }
+
+    max_queued = queued;
+    max_waited_ms = 0.0;
+    dropped_interval = 0;
+
+    pthread_mutex_unlock(&pipeline_mut);
+}
+
+void pipeline_stop(const logger_t* logger) {
+    pthread_mutex_lock(&pipeline_mut);
+    stopping = 1;
+    pthread_cond_broadcast(&pipeline_cond);
+    pthread_mutex_unlock(&pipeline_mut);
+
+    // a worker may be in a command, which run_command kills once stop_fd fires,
+    // or in a call to systemd, which times out after SD_BUS_TIMEOUT_MS
+    for (int i = 0; i < workers_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    workers = NULL;
+    workers_count = 0;
+
+    int discarded = 0;
+    while (head != NULL) {
+        job_t* job = head;
+        head = job->next;
+
+        free(job->text);
+        free(job);
+        discarded++;
+    }
+    tail = NULL;
+    queued = 0;
+
+    if (discarded > 0) {
+        sprint_info(logger, "Dropped %d queued actions.\n", discarded);
+    }
+}
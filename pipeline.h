@@ -0,0 +1,43 @@
+#ifndef SRD_PIPELINE_H
+#define SRD_PIPELINE_H
+
+#include "actions.h"
+#include "printing.h"
+
+/* Defaults of the action pipeline; configurable in srd.conf */
+#define PIPELINE_WORKERS 4
+#define PIPELINE_QUEUE_SIZE 1024
+
+/*
+ * Starts worker threads performing the queued actions. At most queue_size
+ * actions wait; further actions are dropped until the workers caught up.
+ * Returns 1 on success, else 0.
+ */
+int pipeline_start(const logger_t* logger, int workers, int queue_size);
+
+/*
+ * Sets how many actions of type (f.ex. "command") run at the same time.
+ * Returns 1 on success, 0 if the type is unknown.
+ */
+int pipeline_set_limit(const char* type, int limit);
+
+/*
+ * Queues action to be performed by a worker. text is the message, command or
+ * line with all placeholders inserted (or NULL) and is freed by the pipeline.
+ * Never blocks; returns 0 if the queue is full and the action was dropped.
+ */
+int pipeline_submit(const logger_t* logger, action_t* action, char* text);
+
+/*
+ * Prints the backpressure metrics: queued, running and dropped actions and
+ * the time actions waited in the queue.
+ */
+void pipeline_print_metrics(const logger_t* logger);
+
+/*
+ * Lets the workers finish their current action, joins them and drops the
+ * actions still queued.
+ */
+void pipeline_stop(const logger_t* logger);
+
+#endif
@@ -0,0 +1,923 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "prober.h"
+#include "srd.h"
+#include "printing.h"
+#include "scheduler.h"
+#include "collector.h"
+#include "netlink.h"
+#include "util.h"
+
+/* What the probe loop waits for with a check */
+#define PROBE_IDLE          0 // the next period
+#define PROBE_RESOLVING     1 // the address of the hostname
+#define PROBE_PINGING       2 // the reply to a ping
+#define PROBE_SHARED        3 // the result of the ping of another check of its group
+
+/* Receive buffer of the ping sockets; replies of many targets may arrive at once */
+#define PROBER_RCVBUF (4 * 1024 * 1024)
+
+#define PROBER_EVENTS 64
+
+/* data of the epoll events */
+#define EVENT_WAKEUP    2
+#define EVENT_SOCKET4   0
+#define EVENT_SOCKET6   1
+
+/*
+ * One probe loop: a thread running many checks.
+ */
+typedef struct prober_t
+{
+    pthread_t thread;
+
+    // is 1 if thread was started
+    int started;
+
+    int index;
+
+    const logger_t* logger;
+
+    int epoll_fd;
+
+    // eventfd to wake up this loop (prober_wake and prober_stop)
+    int wakeup_fd;
+
+    // ping sockets for AF_INET and AF_INET6; -1 until used
+    int sockets[2];
+
+    // interfaces the addresses of the checks are reached through
+    route_cache_t* routes;
+
+    // checks of this loop
+    connectivity_check_t** checks;
+    uint32_t count;
+
+    // min-heap of the checks by their deadline
+    connectivity_check_t** heap;
+    uint32_t heap_size;
+
+    // checks other threads want to be handled right away (prober_wake); a lock-free
+    // stack linked through wake_next which the loop takes as a whole
+    _Atomic(connectivity_check_t*) mailbox;
+
+    // CPU this loop is pinned to; -1 if not pinned
+    int cpu;
+
+    // per family: the check awaiting the reply to the ping with each sequence number
+    connectivity_check_t* in_flight[2][UINT16_MAX + 1];
+    uint16_t next_sequence[2];
+} prober_t;
+
+/*
+ * Checks of different configs with the same address, timeout and amount of
+ * pings. Only one of them pings at a time and the others take its result, so
+ * the address is pinged as often as the finest period of them demands. All
+ * checks of a group run on the same probe loop.
+ */
+typedef struct probe_group_t
+{
+    // check whose ping is in flight; NULL if none
+    connectivity_check_t* pinging;
+
+    // checks awaiting the result of pinging, linked through group_next
+    connectivity_check_t* waiting;
+
+    // latest result as passed to end_check, its latency and the first failed ping
+    int connected;
+    float latency;
+    struct timespec first_failed;
+
+    // when the latest result arrived and whose ping it was; it is taken by the
+    // other checks until it is older than period
+    struct timespec result_time;
+    const connectivity_check_t* producer;
+
+    // finest period of the checks of this group
+    uint8_t period;
+} probe_group_t;
+
+static prober_t* probers = NULL;
+static int probers_count = 0;
+
+static probe_group_t* groups = NULL;
+static uint32_t groups_count = 0;
+
+static _Atomic int stopping = 0;
+
+static inline int family_index(const connectivity_check_t* check) {
+    return check->sockaddr->ss_family == AF_INET6 ? 1 : 0;
+}
+
+static inline int earlier(const struct timespec a, const struct timespec b) {
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+static void heap_swap(prober_t* prober, uint32_t i, uint32_t j) {
+    connectivity_check_t* tmp = prober->heap[i];
+
+    prober->heap[i] = prober->heap[j];
+    prober->heap[j] = tmp;
+    prober->heap[i]->heap_index = i;
+    prober->heap[j]->heap_index = j;
+}
+
+/*
+ * Restores the order of the heap after the deadline of check changed.
+ */
+static void heap_update(prober_t* prober, connectivity_check_t* check) {
+    uint32_t i = check->heap_index;
+
+    while (i > 0 && earlier(prober->heap[i]->deadline, prober->heap[(i - 1) / 2]->deadline)) {
+        heap_swap(prober, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    while (1) {
+        uint32_t smallest = i;
+        uint32_t left = 2 * i + 1;
+        uint32_t right = 2 * i + 2;
+
+        if (left < prober->heap_size && earlier(prober->heap[left]->deadline, prober->heap[smallest]->deadline)) {
+            smallest = left;
+        }
+        if (right < prober->heap_size && earlier(prober->heap[right]->deadline, prober->heap[smallest]->deadline)) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        heap_swap(prober, i, smallest);
+        i = smallest;
+    }
+}
+
+static void set_deadline(prober_t* prober, connectivity_check_t* check, const struct timespec deadline) {
+    check->deadline = deadline;
+    heap_update(prober, check);
+}
+
+static struct timespec in_ms(const int32_t ms) {
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    struct timespec add = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+
+    return timespec_add(now, add);
+}
+
+/*
+ * Waits for the next period of check. Prints if we're behind in schedule.
+ */
+static void schedule(prober_t* prober, connectivity_check_t* check, int report_behind) {
+    const logger_t* logger = &check->logger;
+    struct timespec fire_time;
+
+    check->probe_phase = PROBE_IDLE;
+
+    int32_t behind = schedule_next(check, &check->next_check_time, &fire_time);
+
+    // Print warning if we're behind in schedule
+    if (report_behind && behind > 0) {
+        char str_time[32];
+        struct timespec now;
+        clock_gettime(CLOCK, &now);
+        format_time(datetime_ph, str_time, 32, &now);
+
+        sprint_error(logger, "Behind in schedule by %d ms at %s. Check your period and your timeouts of the actions.\n", behind, str_time);
+    }
+
+    set_deadline(prober, check, fire_time);
+}
+
+static void share_result(prober_t* prober, connectivity_check_t* check, const int connected, const struct timespec first_failed);
+
+static void finish(prober_t* prober, connectivity_check_t* check, const int connected, const struct timespec first_failed) {
+    end_check(check, connected, first_failed);
+
+    schedule(prober, check, 1);
+
+    if (check->group != NULL && check->group->pinging == check) {
+        share_result(prober, check, connected, first_failed);
+    }
+}
+
+/*
+ * Ends the period of check with the latest result of its group.
+ */
+static void take_result(prober_t* prober, connectivity_check_t* check) {
+    const probe_group_t* group = check->group;
+    struct timespec first_failed = check->period_first_failed;
+
+    check->latency = group->latency;
+
+    // as if our own ping failed: first_failed is only set if we were UP
+    if (group->connected == 0 && check->state == STATE_UP && first_failed.tv_sec == startup_time) {
+        first_failed = group->first_failed;
+    }
+
+    sprint_debug((&check->logger), "Took the result of the shared ping: %d\n", group->connected);
+
+    finish(prober, check, group->connected, first_failed);
+}
+
+/*
+ * Stores the result of the ping of check in its group and ends the period of
+ * the checks awaiting it.
+ */
+static void share_result(prober_t* prober, connectivity_check_t* check, const int connected, const struct timespec first_failed) {
+    probe_group_t* group = check->group;
+
+    group->pinging = NULL;
+    group->connected = connected;
+    group->latency = connected == 1 ? check->latency : -1.0;
+    clock_gettime(CLOCK, &group->result_time);
+    group->first_failed = first_failed.tv_sec != startup_time ? first_failed : group->result_time;
+    group->producer = check;
+
+    connectivity_check_t* next = group->waiting;
+    group->waiting = NULL;
+
+    while (next != NULL) {
+        connectivity_check_t* waiting = next;
+        next = waiting->group_next;
+        waiting->group_next = NULL;
+
+        take_result(prober, waiting);
+    }
+}
+
+/*
+ * Lets check take the result of its group instead of pinging: the latest one
+ * of another check if it is younger than the finest period, else the one of the
+ * ping in flight. Otherwise check pings for the group.
+ * Returns 1 if check takes the result of another check, 0 if it pings.
+ */
+static int join_group(prober_t* prober, connectivity_check_t* check) {
+    probe_group_t* group = check->group;
+
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    // never our own result: the checks with the finest period ping for all others
+    if (group->producer != NULL && group->producer != check &&
+        calculate_difference_ms(group->result_time, now) < group->period * 1000) {
+        take_result(prober, check);
+        return 1;
+    }
+
+    if (group->pinging != NULL) {
+        check->probe_phase = PROBE_SHARED;
+        check->group_next = group->waiting;
+        group->waiting = check;
+
+        // the longest the ping may take; then we ping on our own
+        int32_t longest_ms = (int32_t) ((DNS_RESOLVE_TIMEOUT + check->num_pings * check->timeout + 1) * 1000);
+        set_deadline(prober, check, in_ms(longest_ms));
+
+        return 1;
+    }
+
+    group->pinging = check;
+    return 0;
+}
+
+/*
+ * Removes check from the checks awaiting the ping of its group.
+ */
+static void leave_group(connectivity_check_t* check) {
+    for (connectivity_check_t** next = &check->group->waiting; *next != NULL; next = &(*next)->group_next) {
+        if (*next == check) {
+            *next = check->group_next;
+            check->group_next = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * Opens the ping socket of the family with index f.
+ */
+static int open_socket(prober_t* prober, const int f) {
+    int sd = create_socket(prober->logger, f == 0 ? AF_INET : AF_INET6);
+    if (sd < 0) {
+        return -1;
+    }
+
+    // needs CAP_NET_ADMIN; otherwise it's limited by net.core.rmem_max
+    int size = PROBER_RCVBUF;
+    if (setsockopt(sd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = f == 0 ? EVENT_SOCKET4 : EVENT_SOCKET6 };
+    epoll_ctl(prober->epoll_fd, EPOLL_CTL_ADD, sd, &event);
+
+    prober->sockets[f] = sd;
+
+    return sd;
+}
+
+/*
+ * Sends the next ping to check.
+ */
+static void send_probe(prober_t* prober, connectivity_check_t* check) {
+    const logger_t* logger = &check->logger;
+    const int f = family_index(check);
+
+    if (prober->sockets[f] < 0 && open_socket(prober, f) < 0) {
+        finish(prober, check, -1, check->period_first_failed);
+        return;
+    }
+
+    // the sequence numbers identify the pings of all checks of this loop
+    uint16_t sequence = prober->next_sequence[f];
+    for (uint32_t tries = 0; tries < UINT16_MAX && prober->in_flight[f][sequence] != NULL; tries++) {
+        sequence++;
+    }
+    if (prober->in_flight[f][sequence] != NULL) {
+        sprint_error(logger, "Too many pings in flight. Use more probe_threads.\n");
+        finish(prober, check, -1, check->period_first_failed);
+        return;
+    }
+    prober->next_sequence[f] = sequence + 1;
+    check->sequence = sequence;
+
+    if (send_ping(logger, check, prober->sockets[f]) < 0) {
+        finish(prober, check, -1, check->period_first_failed);
+        return;
+    }
+
+    prober->in_flight[f][sequence] = check;
+    check->pings_sent++;
+    check->probe_phase = PROBE_PINGING;
+
+    struct timespec timeout = { .tv_sec = (time_t) check->timeout, .tv_nsec = (long) ((check->timeout - (time_t) check->timeout) * 1e9) };
+    set_deadline(prober, check, timespec_add(check->sent_time, timeout));
+}
+
+/*
+ * Looks up the address of check if it is a hostname, then pings it.
+ */
+static void probe(prober_t* prober, connectivity_check_t* check) {
+    const logger_t* logger = &check->logger;
+
+    // resolve the hostname each period; the lookup of the previous one may still be pending
+    if ((check->flags & FLAG_IS_HOSTNAME) && check->pings_sent == 0) {
+        if (check->resolving == NULL) {
+            sprint_debug(logger, "Trying as a hostname: %s\n", check->address);
+
+            check->resolving = resolve_start(logger, check->address);
+            if (check->resolving == NULL) {
+                finish(prober, check, -1, check->period_first_failed);
+                return;
+            }
+        }
+        check->resolve_deadline = in_ms(DNS_RESOLVE_TIMEOUT * 1000);
+        check->probe_phase = PROBE_RESOLVING;
+        set_deadline(prober, check, in_ms(RESOLVE_POLL_MS));
+
+        return;
+    }
+
+    send_probe(prober, check);
+}
+
+static void poll_resolve(prober_t* prober, connectivity_check_t* check) {
+    const logger_t* logger = &check->logger;
+
+    int resolved = resolve_result(logger, check->resolving, check->sockaddr);
+
+    if (resolved < 0) {
+        struct timespec now;
+        clock_gettime(CLOCK, &now);
+
+        if (earlier(now, check->resolve_deadline)) {
+            set_deadline(prober, check, in_ms(RESOLVE_POLL_MS));
+        } else {
+            // the request is kept and awaited again in the next period
+            sprint_error(logger, "Timeout when resolving %s\n", check->address);
+            finish(prober, check, -1, check->period_first_failed);
+        }
+        return;
+    }
+    check->resolving = NULL;
+
+    if (resolved == 0) {
+        finish(prober, check, -1, check->period_first_failed);
+        return;
+    }
+
+    send_probe(prober, check);
+}
+
+static void start_period(prober_t* prober, connectivity_check_t* check) {
+    const logger_t* logger = &check->logger;
+
+    if (!begin_check(check, prober->routes)) {
+        // awaiting the dependency
+        schedule(prober, check, 0);
+        return;
+    }
+
+    check->pings_sent = 0;
+    check->period_first_failed = (struct timespec) { .tv_nsec = 0, .tv_sec = startup_time };
+
+    if (check->flags & FLAG_IS_COLLECTED) {
+        // the state is reported by the agents
+        struct timespec first_failed = check->period_first_failed;
+        int connected = collector_evaluate(logger, check, &first_failed);
+
+        finish(prober, check, connected, first_failed);
+    } else if (check->link_down) {
+        // the interface has no carrier: we're down without waiting for any timeout
+        sprint_debug(logger, "Interface %d has no carrier\n", check->oif);
+
+        if (check->state & STATE_UP) {
+            clock_gettime(CLOCK, &check->period_first_failed);
+        }
+        check->latency = -1.0;
+
+        finish(prober, check, 0, check->period_first_failed);
+    } else if (check->group != NULL && join_group(prober, check)) {
+        // served by the ping of another check of its group
+    } else {
+        probe(prober, check);
+    }
+}
+
+/*
+ * The latest ping to check failed. Retries or ends the period.
+ */
+static void ping_failed(prober_t* prober, connectivity_check_t* check) {
+    const int f = family_index(check);
+
+    if (prober->in_flight[f][check->sequence] == check) {
+        prober->in_flight[f][check->sequence] = NULL;
+    }
+
+    check->latency = -1.0;
+
+    // set first_failed exactly once, and if we end up not reaching we pass it on
+    if (check->state == STATE_UP && check->period_first_failed.tv_sec == startup_time) {
+        clock_gettime(CLOCK, &check->period_first_failed);
+    }
+
+    // no need to retry if the interface lost its carrier
+    if (check->pings_sent < check->num_pings && !check->link_down && running) {
+        probe(prober, check);
+    } else {
+        finish(prober, check, 0, check->period_first_failed);
+    }
+}
+
+static void handle_deadline(prober_t* prober, connectivity_check_t* check) {
+    switch (check->probe_phase) {
+        case PROBE_IDLE:
+            start_period(prober, check);
+            break;
+        case PROBE_RESOLVING:
+            poll_resolve(prober, check);
+            break;
+        case PROBE_PINGING:
+            sprint_debug((&check->logger), "Timeout after %1.2fms\n", check->timeout * 1e3);
+            ping_failed(prober, check);
+            break;
+        case PROBE_SHARED:
+            sprint_debug((&check->logger), "No result of the shared ping. Pinging on our own\n");
+            leave_group(check);
+            probe(prober, check);
+            break;
+    }
+}
+
+/*
+ * Receives all pending replies on the socket of the family with index f.
+ */
+static void receive_replies(prober_t* prober, const int f) {
+    char buffer[2 * PACKETSIZE];
+    ssize_t len;
+
+    while ((len = recv(prober->sockets[f], buffer, sizeof(buffer), 0)) >= 0 || errno == EINTR) {
+        if (len < 0) {
+            continue;
+        }
+
+        struct timespec rcvd_time;
+        clock_gettime(CLOCK_REALTIME, &rcvd_time);
+
+        uint16_t sequence;
+        struct timespec sent_time;
+
+        if (!parse_reply(buffer, len, f == 0 ? AF_INET : AF_INET6, &sequence, &sent_time)) {
+            continue;
+        }
+
+        // the timestamp in the payload tells late replies apart from the current ping
+        connectivity_check_t* check = prober->in_flight[f][sequence];
+        if (check == NULL || check->sent_time.tv_sec != sent_time.tv_sec || check->sent_time.tv_nsec != sent_time.tv_nsec) {
+            continue;
+        }
+        prober->in_flight[f][sequence] = NULL;
+
+        const logger_t* logger = &check->logger;
+
+        check->latency = calculate_difference(check->sent_time, rcvd_time);
+
+        sprint_debug(logger, "Ping has success: %d with latency: %2.3fms\n", 1, check->latency * 1000);
+
+        finish(prober, check, 1, check->period_first_failed);
+    }
+}
+
+/*
+ * Handles the checks other threads requested to be woken up.
+ */
+static void handle_wakes(prober_t* prober) {
+    uint64_t value;
+    if (read(prober->wakeup_fd, &value, sizeof(value)) < 0) {
+        // nothing to do; it was already reset
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    // take all checks at once; others push new ones meanwhile
+    connectivity_check_t* next = atomic_exchange(&prober->mailbox, NULL);
+
+    while (next != NULL) {
+        connectivity_check_t* check = next;
+        next = check->wake_next;
+
+        // from now on it may be pushed again
+        atomic_store(&check->wake_requested, 0);
+
+        if (check->probe_phase == PROBE_PINGING && check->link_down) {
+            sprint_debug((&check->logger), "Link is down. Stop waiting for a reply\n");
+
+            // do not retry
+            check->pings_sent = check->num_pings;
+            ping_failed(prober, check);
+        } else if (check->probe_phase == PROBE_IDLE) {
+            set_deadline(prober, check, now);
+        }
+    }
+}
+
+static void* prober_run(void* arg) {
+    prober_t* prober = arg;
+    struct epoll_event events[PROBER_EVENTS];
+
+    while (running && !stopping) {
+        int timeout_ms = -1;
+
+        if (prober->heap_size > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK, &now);
+
+            // round up, else we wake up just before the deadline
+            int64_t wait_ns = (prober->heap[0]->deadline.tv_sec - now.tv_sec) * 1000000000LL + (prober->heap[0]->deadline.tv_nsec - now.tv_nsec);
+            timeout_ms = wait_ns <= 0 ? 0 : (int) ((wait_ns + 999999) / 1000000);
+        }
+
+        int num_ready = epoll_wait(prober->epoll_fd, events, PROBER_EVENTS, timeout_ms);
+
+        if (num_ready < 0 && errno != EINTR) {
+            sprint_error(prober->logger, "Probe loop %d is unable to wait: %s\n", prober->index, strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < num_ready && running; i++) {
+            if (events[i].data.u32 == EVENT_WAKEUP) {
+                handle_wakes(prober);
+            } else {
+                receive_replies(prober, events[i].data.u32);
+            }
+        }
+
+        // handle all checks whose deadline passed
+        struct timespec now;
+        clock_gettime(CLOCK, &now);
+
+        while (running && !stopping && prober->heap_size > 0 && !earlier(now, prober->heap[0]->deadline)) {
+            handle_deadline(prober, prober->heap[0]);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the FNV-1a hash of the key of check: its config and destination.
+ * Checks of a group are hashed by their address only to run on one loop.
+ */
+static uint64_t check_hash(const connectivity_check_t* check) {
+    const char* parts[3] = { check->name, "-", (check->flags & FLAG_IS_GATEWAY) ? "%gw" : check->address };
+    int first = check->group != NULL ? 2 : 0;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int i = first; i < 3; i++) {
+        for (const char* c = parts[i]; *c != '\0'; c++) {
+            hash ^= (uint8_t) *c;
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+/*
+ * Orders checks by what their pings have to be equal in to be shared.
+ */
+static int compare_pings(const void* a, const void* b) {
+    const connectivity_check_t* check_a = *(connectivity_check_t* const*) a;
+    const connectivity_check_t* check_b = *(connectivity_check_t* const*) b;
+
+    int order = strcmp(check_a->address, check_b->address);
+    if (order != 0) {
+        return order;
+    }
+    if (check_a->timeout != check_b->timeout) {
+        return check_a->timeout < check_b->timeout ? -1 : 1;
+    }
+
+    return (int) check_a->num_pings - (int) check_b->num_pings;
+}
+
+/*
+ * Groups the checks of different configs which ping the same address with the
+ * same timeout and amount of pings. The default gateway changes and collected
+ * checks do not ping, so these are never grouped.
+ * Returns the amount of grouped checks.
+ */
+static uint32_t group_checks(connectivity_check_t** checks, const uint32_t n) {
+    connectivity_check_t** sorted = malloc(n * sizeof(connectivity_check_t*));
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if ((checks[i]->flags & (FLAG_IS_GATEWAY | FLAG_IS_COLLECTED)) == 0) {
+            sorted[count++] = checks[i];
+        }
+    }
+    qsort(sorted, count, sizeof(connectivity_check_t*), compare_pings);
+
+    // at most one group per two checks; the pointers in the checks stay valid
+    groups = calloc(count / 2 + 1, sizeof(probe_group_t));
+    groups_count = 0;
+
+    uint32_t grouped = 0;
+    uint32_t start = 0;
+    for (uint32_t i = 1; i <= count; i++) {
+        if (i < count && compare_pings(&sorted[start], &sorted[i]) == 0) {
+            continue;
+        }
+
+        if (i - start > 1) {
+            probe_group_t* group = &groups[groups_count++];
+            group->period = UINT8_MAX;
+
+            for (uint32_t j = start; j < i; j++) {
+                sorted[j]->group = group;
+                if (sorted[j]->period < group->period) {
+                    group->period = sorted[j]->period;
+                }
+            }
+            grouped += i - start;
+        }
+        start = i;
+    }
+    free(sorted);
+
+    return grouped;
+}
+
+/*
+ * Jump consistent hash (Lamping, Veach): maps key to one of buckets. If the
+ * amount of buckets changes only the keys of the added or removed ones move.
+ */
+static int32_t jump_hash(uint64_t key, const int32_t buckets) {
+    int64_t b = -1;
+    int64_t j = 0;
+
+    while (j < buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (b + 1) * ((double) (1LL << 31) / (double) ((key >> 33) + 1));
+    }
+
+    return b;
+}
+
+/*
+ * Returns the CPU for loop p: the p-th of the CPUs we may run on,
+ * -1 if they are unknown.
+ */
+static int choose_cpu(const prober_t* prober) {
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return -1;
+    }
+
+    int nth = prober->index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && nth-- == 0) {
+            return cpu;
+        }
+    }
+
+    return -1;
+}
+
+int prober_start(const logger_t* logger, connectivity_check_t** checks, const uint32_t n, int threads, int pinned) {
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+    if (n > 0 && (uint32_t) threads > n) {
+        threads = n;
+    }
+
+    probers = calloc(threads, sizeof(prober_t));
+    probers_count = threads;
+
+    // checks of different configs pinging the same address share their pings
+    uint32_t grouped = group_checks(checks, n);
+
+    // a check stays on its loop as long as the amount of loops does not change
+    int32_t* shards = malloc(n * sizeof(int32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        shards[i] = jump_hash(check_hash(checks[i]), threads);
+        probers[shards[i]].count++;
+    }
+
+    for (int p = 0; p < threads; p++) {
+        prober_t* prober = &probers[p];
+
+        prober->index = p;
+        prober->logger = logger;
+        prober->sockets[0] = -1;
+        prober->sockets[1] = -1;
+        prober->checks = malloc(prober->count * sizeof(connectivity_check_t*));
+        prober->heap = malloc(prober->count * sizeof(connectivity_check_t*));
+        prober->routes = route_cache_new(prober->count);
+        prober->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        prober->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (prober->epoll_fd < 0 || prober->wakeup_fd < 0) {
+            print_error(logger, "Unable to create probe loop: %s\n", strerror(errno));
+            free(shards);
+            return 0;
+        }
+
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = EVENT_WAKEUP };
+        epoll_ctl(prober->epoll_fd, EPOLL_CTL_ADD, prober->wakeup_fd, &event);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    for (uint32_t i = 0; i < n; i++) {
+        connectivity_check_t* check = checks[i];
+        prober_t* prober = &probers[shards[i]];
+
+        check->prober = prober;
+        check->probe_phase = PROBE_IDLE;
+
+        // first slot of its schedule
+        // the stall detection counts from the start until then
+        check->next_check_time = schedule_first(check, now);
+        check->deadline = check->next_check_time;
+        set_latest_try(check, now);
+
+        check->heap_index = prober->heap_size;
+        prober->checks[prober->heap_size] = check;
+        prober->heap[prober->heap_size++] = check;
+        heap_update(prober, check);
+    }
+    free(shards);
+
+    for (int p = 0; p < threads; p++) {
+        prober_t* prober = &probers[p];
+
+        prober->cpu = pinned ? choose_cpu(prober) : -1;
+
+        int started = start_pinned_thread(&prober->thread, prober_run, prober, prober->cpu);
+        if (!started && prober->cpu >= 0) {
+            print_error(logger, "Unable to pin probe loop %d to CPU %d\n", p, prober->cpu);
+            prober->cpu = -1;
+            started = start_thread(&prober->thread, prober_run, prober);
+        }
+        if (!started) {
+            print_error(logger, "Unable to start probe loop %d\n", p);
+            return 0;
+        }
+        prober->started = 1;
+
+        char name[16];
+        snprintf(name, sizeof(name), "srd-probe-%hu", (unsigned short) p);
+        pthread_setname_np(prober->thread, name);
+
+        print_debug(logger, "Probe loop %d runs %u targets on CPU %d\n", p, prober->count, prober->cpu);
+    }
+
+    print_info(logger, "Running %u targets on %d probe loops\n", n, threads);
+    if (groups_count > 0) {
+        print_info(logger, "%u targets share the pings to %u addresses with targets of other configs\n", grouped, groups_count);
+    }
+
+    return 1;
+}
+
+void prober_wake(connectivity_check_t* check) {
+    prober_t* prober = check->prober;
+
+    if (prober == NULL) {
+        return;
+    }
+
+    // already in the mailbox
+    if (atomic_exchange(&check->wake_requested, 1)) {
+        return;
+    }
+
+    connectivity_check_t* head = atomic_load(&prober->mailbox);
+    do {
+        check->wake_next = head;
+    } while (!atomic_compare_exchange_weak(&prober->mailbox, &head, check));
+
+    uint64_t value = 1;
+    if (write(prober->wakeup_fd, &value, sizeof(value)) < 0) {
+        // the counter would overflow; thus it is already woken up
+    }
+}
+
+void prober_stop() {
+    stopping = 1;
+
+    for (int p = 0; p < probers_count; p++) {
+        uint64_t value = 1;
+        if (probers[p].wakeup_fd >= 0 && write(probers[p].wakeup_fd, &value, sizeof(value)) < 0) {
+            // already woken up
+        }
+    }
+
+    // join all first; loops wake checks of other loops
+    for (int p = 0; p < probers_count; p++) {
+        if (probers[p].started) {
+            pthread_join(probers[p].thread, NULL);
+        }
+    }
+
+    for (int p = 0; p < probers_count; p++) {
+        prober_t* prober = &probers[p];
+
+        for (uint32_t i = 0; i < prober->count; i++) {
+            if (prober->checks[i]->resolving != NULL) {
+                resolve_cancel(prober->checks[i]->resolving);
+                prober->checks[i]->resolving = NULL;
+            }
+            prober->checks[i]->prober = NULL;
+            prober->checks[i]->group = NULL;
+            prober->checks[i]->group_next = NULL;
+        }
+
+        for (int f = 0; f < 2; f++) {
+            if (prober->sockets[f] >= 0) {
+                close(prober->sockets[f]);
+            }
+        }
+        if (prober->epoll_fd >= 0) {
+            close(prober->epoll_fd);
+        }
+        if (prober->wakeup_fd >= 0) {
+            close(prober->wakeup_fd);
+        }
+        route_cache_free(prober->routes);
+        free(prober->checks);
+        free(prober->heap);
+    }
+
+    free(probers);
+    probers = NULL;
+    probers_count = 0;
+
+    free(groups);
+    groups = NULL;
+    groups_count = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SRD_PROBER_H
+#define SRD_PROBER_H
+
+#include <stdint.h>
+
+#include "srd.h"
+#include "printing.h"
+
+/*
+ * Starts `threads` probe loops (one per online CPU if 0) and distributes
+ * all started checks across them by a consistent hash of their config and
+ * destination. Each loop pings its checks through one socket per address
+ * family and waits for the replies and the schedules of all of them at once,
+ * so the amount of threads and file descriptors does not grow with the
+ * amount of targets. If pinned is set, each loop is pinned to one CPU.
+ * Returns 1 on success, else 0.
+ */
+int prober_start(const logger_t* logger, connectivity_check_t** checks, const uint32_t n, int threads, int pinned);
+
+/*
+ * Makes the probe loop handle check right away: it stops waiting for the reply
+ * if the link of check is down, otherwise the next period of check starts now.
+ * Can be called from any thread; it does not block.
+ */
+void prober_wake(connectivity_check_t* check);
+
+/*
+ * Stops all probe loops and waits until they ended.
+ */
+void prober_stop();
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scheduler.h"
+#include "srd.h"
+#include "util.h"
+
+void schedule_init(connectivity_check_t** checks, const int n) {
+    // amount of spread checks per period (a period has at most 255 seconds)
+    uint32_t amount[UINT8_MAX + 1] = { 0 };
+    uint32_t assigned[UINT8_MAX + 1] = { 0 };
+
+    for (int i = 0; i < n; i++) {
+        connectivity_check_t* check = checks[i];
+
+        check->seed = (unsigned int) time(NULL) ^ (unsigned int) i;
+
+        if (check->schedule == SCHEDULE_SPREAD && check->phase.tv_sec == 0 && check->phase.tv_nsec == 0) {
+            amount[check->period]++;
+        }
+    }
+
+    // distribute the checks sharing a period evenly; the first one keeps phase 0
+    for (int i = 0; i < n; i++) {
+        connectivity_check_t* check = checks[i];
+
+        if (check->schedule != SCHEDULE_SPREAD || check->phase.tv_sec != 0 || check->phase.tv_nsec != 0) {
+            continue;
+        }
+
+        int64_t phase_ns = (int64_t) check->period * 1000000000 * assigned[check->period] / amount[check->period];
+
+        check->phase.tv_sec = phase_ns / 1000000000;
+        check->phase.tv_nsec = phase_ns % 1000000000;
+        assigned[check->period]++;
+    }
+}
+
+/*
+ * Returns a random offset in [0, max_s) seconds.
+ */
+static struct timespec random_offset(connectivity_check_t* check, const float max_s) {
+    double offset = max_s * (rand_r(&check->seed) / (RAND_MAX + 1.0));
+
+    struct timespec result = { .tv_sec = (time_t) offset, .tv_nsec = (long) ((offset - (time_t) offset) * 1e9) };
+
+    return result;
+}
+
+struct timespec schedule_first(const connectivity_check_t* check, const struct timespec now) {
+    struct timespec first = now;
+
+    switch (check->schedule) {
+        case SCHEDULE_SPREAD:
+            first = timespec_add(now, check->phase);
+            break;
+        case SCHEDULE_ALIGNED:
+            // next multiple of period on the wall clock
+            first.tv_sec = ((now.tv_sec / check->period) + 1) * check->period;
+            first.tv_nsec = 0;
+            break;
+        case SCHEDULE_JITTER: {
+            // random phase, such that targets started together do not fire together
+            unsigned int seed = check->seed;
+            double offset = check->period * (rand_r(&seed) / (RAND_MAX + 1.0));
+            struct timespec phase = { .tv_sec = (time_t) offset, .tv_nsec = (long) ((offset - (time_t) offset) * 1e9) };
+
+            first = timespec_add(now, phase);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return first;
+}
+
+int32_t schedule_next(connectivity_check_t* check, struct timespec* next_check_time, struct timespec* fire_time) {
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
+
+    // diff is the amount of time passed since the last slot
+    int32_t diff = calculate_difference_ms(*next_check_time, now);
+
+    // calculate the next slot (a multiple of period) after now
+    if (diff >= 0) {
+        size_t amount = (size_t) ((diff / 1e3 - 1e-10) / check->period) + 1;
+
+        struct timespec add = { .tv_sec = check->period * amount, .tv_nsec = 0 };
+        *next_check_time = timespec_add(*next_check_time, add);
+    }
+
+    *fire_time = *next_check_time;
+    if (check->schedule == SCHEDULE_JITTER) {
+        *fire_time = timespec_add(*fire_time, random_offset(check, check->jitter));
+    }
+
+    // report if we're behind in schedule
+    if (diff / 1e3 > check->period) {
+        return diff - check->period * 1000;
+    }
+
+    return 0;
+}
+
+schedule_policy_t to_schedule_policy(const char* str_policy) {
+    if (strcmp("immediate", str_policy) == 0)
+    {
+        return SCHEDULE_IMMEDIATE;
+    }
+    else if (strcmp("spread", str_policy) == 0)
+    {
+        return SCHEDULE_SPREAD;
+    }
+    else if (strcmp("aligned", str_policy) == 0)
+    {
+        return SCHEDULE_ALIGNED;
+    }
+    else if (strcmp("jitter", str_policy) == 0)
+    {
+        return SCHEDULE_JITTER;
+    }
+    else
+    {
+        return SCHEDULE_INVALID;
+    }
+}
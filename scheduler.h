@@ -0,0 +1,37 @@
+#ifndef SRD_SCHEDULER_H
+#define SRD_SCHEDULER_H
+
+#include <stdint.h>
+#include <time.h>
+struct timespec;
+
+#include "srd.h"
+
+/*
+ * Assigns the phase of every check using SCHEDULE_SPREAD. Checks with the
+ * same period are distributed evenly across that period. Also seeds the
+ * random generator of checks using SCHEDULE_JITTER.
+ */
+void schedule_init(connectivity_check_t** checks, const int n);
+
+/*
+ * Returns the first slot at which check should be run, given it is
+ * started at now.
+ */
+struct timespec schedule_first(const connectivity_check_t* check, const struct timespec now);
+
+/*
+ * Advances next_check_time to the next slot of the schedule of check which
+ * lies in the future and sets fire_time to the time the check is run then
+ * (plus the random offset if the check uses SCHEDULE_JITTER).
+ * Returns by how many milliseconds we overran the period, 0 if we are on time.
+ */
+int32_t schedule_next(connectivity_check_t* check, struct timespec* next_check_time, struct timespec* fire_time);
+
+/*
+ * Converts the value of the `schedule` setting into a schedule_policy_t.
+ * Returns SCHEDULE_INVALID if the value is unknown.
+ */
+schedule_policy_t to_schedule_policy(const char* str_policy);
+
+#endif
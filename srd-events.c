@@ -0,0 +1,421 @@
+/*
+ * srd-events: query the journal of state transitions written by srd.
+ *
+ * Uses the index of the journal to seek to the requested time range instead
+ * of reading the whole journal.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "actions.h"
+
+#define DEFAULT_JOURNAL "/var/lib/srd/journal"
+
+/* records read at once */
+#define BUFFER_RECORDS 1024
+
+/*
+ * Filter given on the command line.
+ */
+typedef struct query_t
+{
+    int64_t since;
+    int64_t until;
+
+    // network to match; family is AF_UNSPEC for all
+    uint8_t family;
+    uint8_t network[16];
+    int prefix;
+
+    // only transitions to this state; STATE_NONE for all
+    conn_state_t state;
+
+    // minimum duration of the previous state in seconds
+    uint32_t min_duration;
+} query_t;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [-f journal] [-s since] [-u until] [-n network] [-t up|down] [-m duration]\n"
+        "  -f  journal written by srd (default %s)\n"
+        "  -s  only transitions since this time\n"
+        "  -u  only transitions until this time\n"
+        "      times are \"YYYY-MM-DD[ HH:MM[:SS]]\", a unix timestamp \"@SECONDS\"\n"
+        "      or relative to now like \"-7d\" (suffixes s, m, h, d, w)\n"
+        "  -n  only targets in this network, f.ex. 10.10.0.0/24 or fd00::/64\n"
+        "  -t  only transitions to UP (the duration is the downtime) or to DOWN (the duration is the uptime)\n"
+        "  -m  only transitions whose previous state lasted at least this long, f.ex. 300 or 5m\n"
+        "Example, all outages longer than 5 minutes during the last week in 10.10.0.0/24:\n"
+        "  %s -s -7d -n 10.10.0.0/24 -t up -m 5m\n",
+        name, DEFAULT_JOURNAL, name);
+}
+
+/*
+ * Parses a duration like "90", "5m" or "2d" into seconds.
+ * Returns 1 on success, else 0.
+ */
+static int parse_duration(const char* str, int64_t* seconds) {
+    char* end;
+    errno = 0;
+    long long value = strtoll(str, &end, 10);
+
+    if (errno != 0 || end == str || value < 0) {
+        return 0;
+    }
+
+    switch (*end) {
+        case '\0':
+        case 's': break;
+        case 'm': value *= 60; break;
+        case 'h': value *= 3600; break;
+        case 'd': value *= 86400; break;
+        case 'w': value *= 604800; break;
+        default: return 0;
+    }
+    if (*end != '\0' && *(end + 1) != '\0') {
+        return 0;
+    }
+
+    *seconds = value;
+    return 1;
+}
+
+/*
+ * Parses a point in time into a unix timestamp.
+ * Returns 1 on success, else 0.
+ */
+static int parse_time(const char* str, int64_t* timestamp) {
+    if (*str == '@') {
+        char* end;
+        *timestamp = strtoll(str + 1, &end, 10);
+
+        return end != str + 1 && *end == '\0';
+    }
+
+    int64_t ago;
+    if (*str == '-' && parse_duration(str + 1, &ago)) {
+        *timestamp = time(NULL) - ago;
+        return 1;
+    }
+
+    const char* formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d" };
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+
+        const char* end = strptime(str, formats[i], &tm);
+        if (end != NULL && *end == '\0') {
+            tm.tm_isdst = -1;
+            *timestamp = mktime(&tm);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Parses a network like 10.10.0.0/24 into query.
+ * Returns 1 on success, else 0.
+ */
+static int parse_network(const char* str, query_t* query) {
+    char address[INET6_ADDRSTRLEN];
+    const char* slash = strchr(str, '/');
+    size_t length = slash ? (size_t) (slash - str) : strlen(str);
+
+    if (length >= sizeof(address)) {
+        return 0;
+    }
+    memcpy(address, str, length);
+    address[length] = '\0';
+
+    if (inet_pton(AF_INET, address, query->network) == 1) {
+        query->family = AF_INET;
+        query->prefix = 32;
+    } else if (inet_pton(AF_INET6, address, query->network) == 1) {
+        query->family = AF_INET6;
+        query->prefix = 128;
+    } else {
+        return 0;
+    }
+
+    if (slash) {
+        char* end;
+        long prefix = strtol(slash + 1, &end, 10);
+
+        if (end == slash + 1 || *end != '\0' || prefix < 0 || prefix > query->prefix) {
+            return 0;
+        }
+        query->prefix = prefix;
+    }
+
+    return 1;
+}
+
+/*
+ * Returns 1 if address of family is inside the network of query.
+ */
+static int in_network(const query_t* query, uint8_t family, const uint8_t* address) {
+    if (query->family == AF_UNSPEC) {
+        return 1;
+    }
+    if (family != query->family) {
+        return 0;
+    }
+
+    int bytes = query->prefix / 8;
+    int bits = query->prefix % 8;
+
+    if (memcmp(address, query->network, bytes) != 0) {
+        return 0;
+    }
+    if (bits == 0) {
+        return 1;
+    }
+
+    uint8_t mask = 0xff << (8 - bits);
+    return (address[bytes] & mask) == (query->network[bytes] & mask);
+}
+
+static int matches(const query_t* query, const journal_record_t* record) {
+    return record->timestamp_sec >= query->since &&
+           record->timestamp_sec <= query->until &&
+           (query->state == STATE_NONE || record->new_state == query->state) &&
+           record->duration >= query->min_duration &&
+           in_network(query, record->family, record->address);
+}
+
+static const char* state_name(uint8_t state) {
+    switch (state) {
+        case STATE_UP: return "UP";
+        case STATE_DOWN: return "DOWN";
+        case STATE_NONE: return "NONE";
+        default: return "UNKNOWN";
+    }
+}
+
+static void print_record(const journal_record_t* record) {
+    char time_str[32];
+    time_t time = record->timestamp_sec;
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&time));
+
+    char address[INET6_ADDRSTRLEN] = "-";
+    if (record->family == AF_INET || record->family == AF_INET6) {
+        inet_ntop(record->family, record->address, address, sizeof(address));
+    }
+
+    uint32_t d = record->duration;
+
+    printf("%s.%03u %-24s %-39s %4s -> %-4s %s %ud %02u:%02u:%02u latency %.2f ms\n",
+        time_str, record->timestamp_nsec / 1000000,
+        record->name, address,
+        state_name(record->old_state), state_name(record->new_state),
+        record->new_state == STATE_UP ? "downtime" : "uptime",
+        d / 86400, d / 3600 % 24, d / 60 % 60, d % 60,
+        record->latency);
+}
+
+/*
+ * Returns the number of the first record of the interval containing timestamp
+ * using the index, or 0 if the index has no entry for an earlier interval.
+ */
+static uint64_t seek_start(int index_fd, uint64_t entries, int64_t timestamp) {
+    journal_index_t entry;
+    uint64_t low = 0, high = entries;
+    uint64_t record = 0;
+
+    // last entry with interval_start <= timestamp
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+
+        if (pread(index_fd, &entry, sizeof(entry), mid * sizeof(entry)) != sizeof(entry)) {
+            return record;
+        }
+
+        if (entry.interval_start <= timestamp) {
+            record = entry.record;
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return record;
+}
+
+/*
+ * Returns the number of the first record of the second interval after timestamp
+ * using the index, or total if there is none. Records are appended in the order
+ * they are logged, so one logged just before an interval starts or after the
+ * clock stepped back may follow the first record of the next interval; the
+ * extra interval is read for them and filtered out by matches().
+ */
+static uint64_t seek_end(int index_fd, uint64_t entries, int64_t timestamp, uint64_t total) {
+    journal_index_t entry;
+    uint64_t low = 0, high = entries;
+
+    // first entry with interval_start > timestamp
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+
+        if (pread(index_fd, &entry, sizeof(entry), mid * sizeof(entry)) != sizeof(entry)) {
+            return total;
+        }
+
+        if (entry.interval_start > timestamp) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    // the entry after it
+    if (low + 1 >= entries || pread(index_fd, &entry, sizeof(entry), (low + 1) * sizeof(entry)) != sizeof(entry)) {
+        return total;
+    }
+
+    return entry.record < total ? entry.record : total;
+}
+
+int main(int argc, char** argv) {
+    const char* path = DEFAULT_JOURNAL;
+    query_t query = { .since = INT64_MIN, .until = INT64_MAX, .family = AF_UNSPEC, .state = STATE_NONE };
+    int64_t value;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:s:u:n:t:m:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                path = optarg;
+                break;
+            case 's':
+                if (!parse_time(optarg, &query.since)) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'u':
+                if (!parse_time(optarg, &query.until)) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                if (!parse_network(optarg, &query)) {
+                    fprintf(stderr, "Invalid network: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                if (strcasecmp(optarg, "up") == 0) {
+                    query.state = STATE_UP;
+                } else if (strcasecmp(optarg, "down") == 0) {
+                    query.state = STATE_DOWN;
+                } else {
+                    fprintf(stderr, "Invalid state: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                if (!parse_duration(optarg, &value) || value > UINT32_MAX) {
+                    fprintf(stderr, "Invalid duration: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                query.min_duration = value;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    journal_header_t header;
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != JOURNAL_VERSION ||
+        header.record_size != sizeof(journal_record_t))
+    {
+        fprintf(stderr, "%s is not a journal of this version of srd\n", path);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t total = (st.st_size - sizeof(header)) / sizeof(journal_record_t);
+    uint64_t first = 0;
+    uint64_t last = total;
+
+    // without index all records are read
+    char* index_path = malloc(strlen(path) + sizeof(JOURNAL_INDEX_SUFFIX));
+    sprintf(index_path, "%s%s", path, JOURNAL_INDEX_SUFFIX);
+
+    int index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (index_fd >= 0 && fstat(index_fd, &st) == 0) {
+        uint64_t entries = st.st_size / sizeof(journal_index_t);
+
+        if (query.since != INT64_MIN) {
+            first = seek_start(index_fd, entries, query.since);
+        }
+        if (query.until != INT64_MAX) {
+            last = seek_end(index_fd, entries, query.until, total);
+        }
+    } else {
+        fprintf(stderr, "Unable to open index %s: %s. Reading the whole journal.\n", index_path, strerror(errno));
+    }
+    if (index_fd >= 0) {
+        close(index_fd);
+    }
+    free(index_path);
+
+    if (last < first) {
+        last = first;
+    }
+
+    journal_record_t* buffer = malloc(BUFFER_RECORDS * sizeof(journal_record_t));
+    uint64_t found = 0;
+
+    for (uint64_t i = first; i < last; ) {
+        size_t count = last - i < BUFFER_RECORDS ? last - i : BUFFER_RECORDS;
+        ssize_t bytes = pread(fd, buffer, count * sizeof(journal_record_t), sizeof(header) + i * sizeof(journal_record_t));
+
+        if (bytes <= 0) {
+            break;
+        }
+        count = bytes / sizeof(journal_record_t);
+
+        for (size_t j = 0; j < count; j++) {
+            if (matches(&query, &buffer[j])) {
+                print_record(&buffer[j]);
+                found++;
+            }
+        }
+        i += count;
+    }
+
+    free(buffer);
+    close(fd);
+
+    fprintf(stderr, "%lu transitions (read %lu of %lu records)\n", (unsigned long) found, (unsigned long) (last - first), (unsigned long) total);
+
+    return EXIT_SUCCESS;
+}
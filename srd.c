@@ -1,5 +1,7 @@
 #include <errno.h>
 #include <fts.h>
+#include <limits.h>
+#include <arpa/inet.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +10,9 @@
 #include <signal.h>
 #include <stdint.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <pthread.h>
 
@@ -16,8 +21,19 @@
 #include "srd.h"
 #include "printing.h"
 #include "actions.h"
-
-char *const configd_path = "/etc/srd/";
+#include "scheduler.h"
+#include "netlink.h"
+#include "statefile.h"
+#include "statetable.h"
+#include "journal.h"
+#include "collector.h"
+#include "pipeline.h"
+#include "http.h"
+#include "mqtt.h"
+#include "prober.h"
+
+// directory of the configs; can be set with -c
+char* configd_path = "/etc/srd/";
 char *const config_main = "/srd.conf";
 char *const version = "0.0.8";
 
@@ -25,7 +41,10 @@ char *const version = "0.0.8";
 enum loglevel loglevel = LOGLEVEL_DEBUG;
 
 /* used to exit the main loop and stop all threads */
-int running = 1;
+_Atomic int running = 1;
+
+/* readable once we're stopping; wakes up all blocking waits */
+int stop_fd = -1;
 
 const placeholder_t* datetime_ph;
 
@@ -39,19 +58,97 @@ char* default_gw;
 const char* datetime_format = "%Y-%m-%d %H:%M:%S";
 int use_custom_datetime_format = 0;
 
+// file the state of the targets is kept in across restarts
+const char* state_file = "/var/lib/srd/state";
+int use_custom_state_file = 0;
+
+// file the transitions of the targets are appended to
+const char* journal_file = "/var/lib/srd/journal";
+int use_custom_journal_file = 0;
+
+// name of the shared memory the state is published in
+const char* state_table = STATETABLE_NAME;
+int use_custom_state_table = 0;
+
+// agent: endpoint of the collector the results are sent to; NULL if none
+const char* collector = NULL;
+const char* agent_name = NULL;
+
+// collector: endpoint the results of the agents are received on; NULL if none
+const char* collector_listen = NULL;
+
+// threads performing the actions and the amount of actions waiting for them
+int action_workers = PIPELINE_WORKERS;
+int action_queue_size = PIPELINE_QUEUE_SIZE;
+
+// requests of the influx and webhook actions waiting to be sent
+int http_queue_size = HTTP_QUEUE_SIZE;
+
+// CAs verifying the servers of https requests; NULL for the ones of the system
+const char* http_ca_file = NULL;
+
+// messages of the mqtt actions waiting to be published
+int mqtt_queue_size = MQTT_QUEUE_SIZE;
+
+// threads probing the targets; 0 means one per online CPU
+int probe_threads = 0;
+
+// pin each probe loop to one CPU
+int probe_affinity = 1;
+
+// addresses of all checks, sorted; used by get_dependency
+typedef struct address_entry_t {
+    const char* address;
+    uint32_t idx;
+} address_entry_t;
+
+static address_entry_t* address_index = NULL;
+static uint32_t address_index_size = 0;
 
 time_t startup_time;
 
 // used for printing to stdout
 logger_t* logger;
 
-int main()
+int main(int argc, char** argv)
 {
-    // await stop signal, then we stop (set running = 0)
-    signal(SIGALRM, signal_handler); 
-    signal(SIGINT, signal_handler);
-    signal(SIGPIPE, signal_handler);
-    
+    int opt;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                configd_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c config directory (default /etc/srd/)]\n", argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // all blocking waits end once this becomes readable; created before any thread
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd < 0) {
+        fprintf(stderr, "Unable to create eventfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // the signals are blocked in all threads (they inherit the mask) and read by main from signal_fd
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM); // sent by systemd
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        fprintf(stderr, "Unable to create signalfd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // writing to closed sockets or pipes fails with EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
     time(&startup_time);
 
     char time[32];
@@ -72,22 +169,31 @@ int main()
         return EXIT_FAILURE;
     }
 
+    // subscribe to route changes to follow the default gateway
+    if (!netlink_init(logger)) {
+        return EXIT_FAILURE;
+    }
+
     /* Try to get default gateway
     * Use localhost as gateway when debugging and no gateway is available.
     */
-    while ((default_gw = get_default_gw()) == NULL) {
+    default_gw = malloc(INET6_ADDRSTRLEN * sizeof(char));
+    while (!get_gateway(default_gw, INET6_ADDRSTRLEN, NULL)) {
 #ifdef DEBUG
-        char* debug_gw = "127.0.0.1";
-        default_gw = malloc((1 + strlen(debug_gw)) * sizeof(char));
-        memcpy(default_gw, debug_gw, 1 + strlen(debug_gw));
+        strcpy(default_gw, "127.0.0.1");
         break;
 #else
-        print_error(logger, "Unable to get default gateway. Retrying in 60 seconds... \n");
-
-        sleep(60);
+        // wait until the kernel notifies us about a default route
+        int waited = netlink_wait_gateway(logger, signal_fd);
+        if (waited < 0) {
+            handle_signals(signal_fd, NULL, 0);
+            continue;
+        }
+        if (!waited) {
+            free(default_gw);
+            netlink_close();
 
-        if (!running) {
-            return EXIT_SUCCESS;
+            return running ? EXIT_FAILURE : EXIT_SUCCESS;
         }
 #endif
     }
@@ -116,19 +222,55 @@ int main()
 
     print_debug(logger, "default gateway %s\n", default_gw);
 
+    // assign the phases of the schedules
+    schedule_init(connectivity_checks, connectivity_targets);
+
+    // restore the state of the previous run; continue without it on failure
+    int state_persisted = statefile_open(logger, state_file, connectivity_checks, connectivity_targets);
+
+    // publish the state in /dev/shm/srd for local readers
+    int state_published = statetable_open(logger, state_table, connectivity_checks, connectivity_targets);
+
+    // append all transitions to the journal; continue without it on failure
+    journal_open(logger, journal_file);
+
     // Create placeholder for datetime_format
     placeholder_t placeholder = { .info = get_replacements(datetime_format), .raw_message = datetime_format };
     datetime_ph = &placeholder;
 
-    pthread_t threads[connectivity_targets];
-    check_arguments_t args[connectivity_targets];
+    // receive the results of agents; before the checks evaluate them
+    int collecting = collector_listen != NULL && collector_listen_init(logger, collector_listen, connectivity_checks, connectivity_targets);
+    if (collector_listen != NULL && !collecting) {
+        running = 0;
+    }
+
+    // perform the actions of the checks; started before them
+    int pipeline_started = running && pipeline_start(logger, action_workers, action_queue_size);
+    if (!pipeline_started) {
+        running = 0;
+    }
+
+    // send the requests of the influx and webhook actions
+    if (running && !http_start(logger, http_queue_size, http_ca_file)) {
+        running = 0;
+    }
+
+    // keep the connections to the brokers of the mqtt actions
+    if (running && !mqtt_start(logger, mqtt_queue_size)) {
+        running = 0;
+    }
+
+    // send our results to a collector
+    int reporting = collector != NULL && collector_agent_init(logger, collector, agent_name);
 
-    // Start threads for each connectivity target
-    // for each target in `connectivity_checks` we create one thread
+    // look up the dependencies by address instead of scanning all targets for each
+    index_addresses(connectivity_checks, connectivity_targets);
+
+    // prepare each connectivity target; the probe loops run all of them
     int i;
-    for (i = 0; i < connectivity_targets; i++)
+    for (i = 0; running && i < connectivity_targets; i++)
     {
-        int s = start_check(threads, args, connectivity_checks, connectivity_targets, i);
+        int s = start_check(connectivity_checks, connectivity_targets, i);
         if (s < 0) {
             running = 0;
             sprint_error(logger, "Unable to start\n");
@@ -136,185 +278,174 @@ int main()
         }
     }
 
-    if (i == connectivity_targets) {
+    int probing = running && prober_start(logger, connectivity_checks, connectivity_targets, probe_threads, probe_affinity);
+    if (!probing) {
+        running = 0;
+    }
+
+    if (probing) {
         print_info(logger, "Started all target checks (%d).\n", connectivity_targets);
     }
 
-    // used to await only specific signals
-    sigset_t waitset;
-    siginfo_t info;
+    // follow changes of the default gateway and of the links
+    netlink_watch(connectivity_checks, connectivity_targets);
+
+    pthread_t netlink_thread;
+    int netlink_started = running && start_thread(&netlink_thread, netlink_run, logger);
+
+    pthread_t collector_thread;
+    pthread_t agent_thread;
+    collecting = collecting && running && start_thread(&collector_thread, collector_listen_run, logger);
+    reporting = reporting && running && start_thread(&agent_thread, collector_agent_run, logger);
 
     if (running)
     {
-        sigemptyset(&waitset);
+        print_info(logger, "Awaiting shutdown signal\n");
 
-        sigaddset(&waitset, SIGINT);
-        sigaddset(&waitset, SIGALRM);
-        sigaddset(&waitset, SIGTERM); // sent by systemd
-        sigaddset(&waitset, SIGABRT);
-        sigaddset(&waitset, SIGKILL);
-        sigaddset(&waitset, SIGSTOP);
+        // check if threads are stalled every minute
+        struct timespec next_stall_check;
+        clock_gettime(CLOCK_MONOTONIC, &next_stall_check);
+        next_stall_check.tv_sec += STALL_CHECK_INTERVAL;
 
-        sigprocmask(SIG_BLOCK, &waitset, NULL);
+        // write the buffered lines of the jsonl actions every second
+        int flushing = actions_flush_files() > 0;
+        struct timespec next_flush;
+        clock_gettime(CLOCK_MONOTONIC, &next_flush);
 
-        print_info(logger, "Awaiting shutdown signal\n");
+        struct pollfd pfd = { .fd = signal_fd, .events = POLLIN };
 
-        // waits until a signal arrives
-        int result;
+        while (running) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
 
-        const struct timespec timeout = { .tv_nsec = 0, .tv_sec = 60 };
+            if (flushing && calculate_difference_ms(now, next_flush) <= 0) {
+                actions_flush_files();
+                next_flush = timespec_add(now, (struct timespec) { .tv_sec = JSONL_FLUSH_MS / 1000, .tv_nsec = (JSONL_FLUSH_MS % 1000) * 1000000L });
+            }
 
-        struct timespec now;
-        
-        while ((result = sigtimedwait(&waitset, &info, &timeout)) < 0) {
-            if (!running) {
+            int32_t timeout_ms = calculate_difference_ms(now, next_stall_check);
+            if (flushing && calculate_difference_ms(now, next_flush) < timeout_ms) {
+                timeout_ms = calculate_difference_ms(now, next_flush);
+            }
+
+            if (timeout_ms <= 0) {
+                check_stalled(connectivity_checks, connectivity_targets);
+                pipeline_print_metrics(logger);
+                http_print_metrics(logger);
+                mqtt_print_metrics(logger);
+
+                next_stall_check.tv_sec += STALL_CHECK_INTERVAL;
+                continue;
+            }
+
+            int num_ready = poll(&pfd, 1, timeout_ms);
+            if (num_ready < 0 && errno != EINTR) {
+                sprint_error(logger, "Unable to wait for signals: %s\n", strerror(errno));
                 break;
             }
-            if (errno == EINTR) continue;
-            if (errno == EAGAIN) {
-                clock_gettime(CLOCK, &now);
+            if (num_ready > 0) {
+                handle_signals(signal_fd, connectivity_checks, connectivity_targets);
+            }
+        }
+    }
 
-                for (int i = 0; i < connectivity_targets; i++)
-                {
-                    const connectivity_check_t* check = connectivity_checks[i];
+    sprint_info(logger, "Shutting down Simple Reaction Daemon\n");
+    fflush(stdout);
 
-                    double diff = calculate_difference(check->timestamp_latest_try, now);
+    // every thread waits on stop_fd as well, thus they all end within milliseconds
+    stop_running();
 
-                    // + 1 to not report some small overhead occured
-                    if (check->period + 1 < diff && ((check->flags & FLAG_AWAITING_DEPENDENCY) == 0)) {
+    struct timespec shutdown_start;
+    clock_gettime(CLOCK_MONOTONIC, &shutdown_start);
 
-                        char str_now[32];
-                        struct timespec now;
-                        clock_gettime(CLOCK, &now);
-                        format_time(datetime_ph, str_now, 32, &now);
+    // stop the probe loops; they do not wait for any reply
+    prober_stop();
 
-                        sprint_error(logger, "%s: thread for %s-%s is stalled. Period is %d but last check was %1.2f seconds ago \n", str_now, connectivity_checks[i]->name, connectivity_checks[i]->address, check->period, diff);
-                    }
-                }
-                sprint_debug(logger, "Checking threads...\n");
-                continue;
-            }
-            sprint_debug(logger, "Received another signal: %s\n", strerror(errno));
-        }
+    // the checks do not queue actions anymore
+    if (pipeline_started) {
+        pipeline_stop(logger);
+    }
 
-        running = 0;
+    // the actions do not queue requests anymore; pending ones are aborted
+    http_stop(logger);
+    mqtt_stop(logger);
 
-        sprint_debug(logger, "Got signal %d\n", info.si_signo);
-    } // end of while(running)
+    if (netlink_started) {
+        pthread_join(netlink_thread, NULL);
+    }
+    netlink_close();
 
-    sprint_info(logger, "Shutting down Simple Reaction Daemon\n");
-    fflush(stdout);
+    if (collecting) {
+        pthread_join(collector_thread, NULL);
+    }
+    if (reporting) {
+        collector_stop();
+        pthread_join(agent_thread, NULL);
+    }
+    collector_close();
 
-    // kill and join all threads
-    for (int i = 0; i < connectivity_targets; i++)
-    {
-        if (connectivity_checks[i]->flags & FLAG_STARTED) {
-            pthread_kill(threads[i], SIGALRM);
-        }
+    if (state_persisted) {
+        statefile_close();
     }
-    // Iterate over all threads and see if they exited. Kill them if they are still running (instead of joining which may run forever)
-    for (int i = 0; i < connectivity_targets; i++)
-    {
-        if ((connectivity_checks[i]->flags & FLAG_ENDED) == 0) {
-            usleep(5e5); // 500ms
-            if ((connectivity_checks[i]->flags & FLAG_ENDED) == 0) {
-                sprint_debug(logger, "Thread %d is still running: %s %s\n", i, connectivity_checks[i]->name, connectivity_checks[i]->address);
-                pthread_kill(threads[i], SIGALRM);
-            }
-        }
+    if (state_published) {
+        statetable_close();
     }
+    journal_close();
 
-    sprint_debug(logger, "Killed all threads\n");
+    struct timespec shutdown_end;
+    clock_gettime(CLOCK_MONOTONIC, &shutdown_end);
+
+    sprint_debug(logger, "Stopped all threads in %d ms\n", calculate_difference_ms(shutdown_start, shutdown_end));
 
     // free all memory
     for (int i = 0; i < connectivity_targets; i++) {
-        // args
-        if (connectivity_checks[i]->flags & FLAG_STARTED) {
-            check_arguments_t cur_args = args[i];
-            free(cur_args.logger.prefix);
-        }
-
         // connectivity_checks
         connectivity_check_t* ptr = connectivity_checks[i];
 
+        // set by start_check
+        if (ptr->flags & FLAG_STARTED) {
+            free(ptr->logger.prefix);
+        }
+
         free((char *)ptr->address);
         free((char *)ptr->depend_ip);
         free((char *)ptr->name);
         free((char *)ptr->snd_buffer);
-        free((char *)ptr->rcv_buffer);
-
-        if (ptr->epoll_fd > 0) {
-            close(ptr->epoll_fd);
-        }
-        if (ptr->socket > 0) {
-            close(ptr->socket);
-        }
 
-        // free cmd if it is a command (contains the command) or service-restart (contains service name)
+        // free the objects of the actions and close their files
         for (int i = 0; i < ptr->actions_count; i++) {
-            if (strcmp(ptr->actions[i].name, "command") == 0) {
-                action_cmd_t* cmd = (action_cmd_t*) ptr->actions[i].object;
-                free ((char *)cmd->cmd_ph.raw_message);
-                free ((char *)cmd->user);
-                free(ptr->actions[i].object);
-            } else if (strcmp(ptr->actions[i].name, "reboot") == 0) {
-                free(ptr->actions[i].object);
-            } else if (strcmp(ptr->actions[i].name, "service-restart") == 0) {
-                free(ptr->actions[i].object);
-            } else if (strcmp(ptr->actions[i].name, "log") == 0) {
-                action_log_t* action_log = (action_log_t*) ptr->actions[i].object;
-
-                free((char *)action_log->message_ph.raw_message);
-                free((char *)action_log->path);
-                if (action_log->username) {
-                    free((char *)action_log->username);
-                }
-                if (action_log->header) {
-                    free((char *)action_log->header);
-                }
-                if (action_log->file) {
-                    fclose(action_log->file);
-                }
-                free(ptr->actions[i].object);
-            } else if (strcmp(ptr->actions[i].name, "influx") == 0) {
-                action_influx_t* influx = (action_influx_t*) ptr->actions[i].object;
-
-                free((char *)influx->host);
-                free(influx->sockaddr);
-                free((char *)influx->authorization);
-                free((char *)influx->endpoint);
-                free((char *)influx->line.raw_message);
-                if (influx->conn_epoll_read_fd > 0) {
-                    close(influx->conn_epoll_read_fd);
-                }
-                if (influx->conn_epoll_write_fd > 0) {
-                    close(influx->conn_epoll_write_fd);
-                }
-                if (influx->conn_socket > 0) {
-                    close(influx->conn_socket);
-                }
-                if (influx->backup_path) {
-                    free((char *)influx->backup_path);
-                }
-                if (influx->backup_username) {
-                    free((char *)influx->backup_username);
-                }
-                free(ptr->actions[i].object);
-            }
-            free((char *)ptr->actions[i].name);
+            ptr->actions[i].ops->free(&ptr->actions[i]);
         }
         free(ptr->actions);
+        free(ptr->dependents);
         free(ptr->sockaddr);
         free(ptr);
     }
     free(connectivity_checks);
+    actions_close_files();
+    free(address_index);
     free(default_gw);
 
     if (use_custom_datetime_format) {
         free((char *) datetime_format);
     }
+    if (use_custom_state_file) {
+        free((char *) state_file);
+    }
+    if (use_custom_journal_file) {
+        free((char *) journal_file);
+    }
+    if (use_custom_state_table) {
+        free((char *) state_table);
+    }
+    free((char *) collector);
+    free((char *) agent_name);
+    free((char *) collector_listen);
+    free((char *) http_ca_file);
 
     pthread_mutex_destroy(&stdout_mut);
+    close(stop_fd);
+    close(signal_fd);
 
     print_info(logger, "Finished Simple Reaction Daemon.\n");
     fflush(stdout);
@@ -322,23 +453,72 @@ int main()
     return EXIT_SUCCESS;
 } // main end
 
-connectivity_check_t* get_dependency(connectivity_check_t **ccs, const uint16_t n, char const *ip, uint16_t* idx) {
+static int compare_address_entries(const void* a, const void* b) {
+    const address_entry_t* x = a;
+    const address_entry_t* y = b;
+
+    int c = strcmp(x->address, y->address);
+    if (c != 0) {
+        return c;
+    }
+
+    return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
 
-    for (int i = 0; i < n; i++) {
-        connectivity_check_t* ptr = ccs[i];
+void index_addresses(connectivity_check_t **ccs, const uint32_t n) {
+    free(address_index);
 
-        if (strcmp(ip, ptr->address) == 0) {
-            if (idx != NULL) {
-                *idx = i;
+    address_index = malloc(n * sizeof(address_entry_t));
+    for (uint32_t i = 0; i < n; i++) {
+        address_index[i] = (address_entry_t) { ccs[i]->address, i };
+    }
+    qsort(address_index, n, sizeof(address_entry_t), compare_address_entries);
+    address_index_size = n;
+}
+
+connectivity_check_t* get_dependency(connectivity_check_t **ccs, const uint32_t n, char const *ip, uint32_t* idx) {
+
+    // without an index (or a stale one) scan all checks
+    if (address_index == NULL || address_index_size != n) {
+        for (uint32_t i = 0; i < n; i++) {
+            connectivity_check_t* ptr = ccs[i];
+
+            if (strcmp(ip, ptr->address) == 0) {
+                if (idx != NULL) {
+                    *idx = i;
+                }
+                return ptr;
             }
-            return ptr;
         }
+
+        return NULL;
     }
 
-    return NULL;
+    // entries with the same address are sorted by index; the first one is the lowest
+    size_t low = 0;
+    size_t high = address_index_size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (strcmp(address_index[mid].address, ip) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == address_index_size || strcmp(address_index[low].address, ip) != 0) {
+        return NULL;
+    }
+
+    if (idx != NULL) {
+        *idx = address_index[low].idx;
+    }
+
+    return ccs[address_index[low].idx];
 }
 
-int start_check(pthread_t* threads, check_arguments_t* args, connectivity_check_t** ccs, const uint16_t n, const uint16_t idx) {
+int start_check(connectivity_check_t** ccs, const uint32_t n, const uint32_t idx) {
     connectivity_check_t* check = ccs[idx];
     // return success if already started
     if (check->flags & FLAG_STARTED) {
@@ -355,7 +535,7 @@ int start_check(pthread_t* threads, check_arguments_t* args, connectivity_check_
 
     // check if it has a dependency
     if (check->depend_ip != NULL) {
-        uint16_t dep_idx = -1;
+        uint32_t dep_idx = 0;
         check->flags |= FLAG_STARTING_DEPENDENCY;
 
         if (get_dependency(ccs, n, check->depend_ip, &dep_idx) == NULL) {
@@ -363,10 +543,16 @@ int start_check(pthread_t* threads, check_arguments_t* args, connectivity_check_
             return -1;
         }
 
-        if (start_check(threads, args, ccs, n, dep_idx) < 0) {
+        if (start_check(ccs, n, dep_idx) < 0) {
             return -1;
         }
-        // now the dependency is running
+        check->dependency = ccs[dep_idx];
+        // now the dependency is started
+
+        // the dependency wakes us up once its state changes
+        connectivity_check_t* dependency = check->dependency;
+        dependency->dependents = realloc(dependency->dependents, (dependency->dependents_count + 1) * sizeof(connectivity_check_t*));
+        dependency->dependents[dependency->dependents_count++] = check;
     }
 
     // If this check has no own loglevel, take that from srd.conf
@@ -376,8 +562,8 @@ int start_check(pthread_t* threads, check_arguments_t* args, connectivity_check_
     /*
      * Create a logger with the prefix CONFIG_NAME-TARGET_IP
      */
-    logger_t thread_logger = *logger;
-    thread_logger.level = &check->loglevel;
+    check->logger = *logger;
+    check->logger.level = &check->loglevel;
 
     size_t confname_length = strlen(check->name);
     size_t hostname_length = strlen(check->address);
@@ -390,18 +576,19 @@ int start_check(pthread_t* threads, check_arguments_t* args, connectivity_check_
     memcpy(prefix + 2 + confname_length + hostname_length, "]: ", 3 * sizeof(char));
 
     prefix[5 + confname_length + hostname_length] = '\0';
-    thread_logger.prefix = prefix;
- 
-    args[idx] = (check_arguments_t) { ccs, idx, n, thread_logger };
+    check->logger.prefix = prefix;
 
-    print_debug(logger, "Starting thread for %s.\n", check->address);
     check->flags |= FLAG_STARTED;
-    pthread_create(&threads[idx], NULL, (void *)run_check, (void *)&args[idx]);
-    
+
     return 1;
 }
 
 int is_available(connectivity_check_t *check, int strict) {
+    // the interface to this target has no carrier
+    if (check->link_down) {
+        return 0;
+    }
+
     // status could be STATE_UP or STATE_UP_NEW
     if (check->state & STATE_UP || (check->state == STATE_NONE && strict == 0)) {
         return 1;
@@ -410,386 +597,287 @@ int is_available(connectivity_check_t *check, int strict) {
     return 0;
 }
 
-void run_check(check_arguments_t *args)
+int begin_check(connectivity_check_t* check, route_cache_t* routes)
 {
-    const int idx = args->idx;
-    connectivity_check_t* check = args->connectivity_checks[idx];
-
-    check->flags |= FLAG_STARTED;
+    const logger_t* logger = &check->logger;
 
-#if DEBUG
-    // Sets the name for this thread (useful for gdb)
-    pthread_setname_np(pthread_self(), check->address);
-#endif
-
-    logger_t* logger = &args->logger;
-
-    // store time to calculate the time of the next ping
-    struct timespec now;
-    clock_gettime(CLOCK, &now);
+    // ping the current gateway
+    if (check->flags & FLAG_IS_GATEWAY) {
+        follow_gateway(logger, check);
+    }
 
-    const struct timespec period = { .tv_nsec = 0, .tv_sec = check->period };
+    // look up the interface we reach the target through if routes changed
+    // the agents reach collected targets through their own interfaces
+    if ((check->flags & FLAG_IS_COLLECTED) == 0) {
+        follow_route(logger, check, routes);
+    }
 
-    struct timespec next_check_time = now;
+    // check if our dependency is available
+    if (check->dependency != NULL) {
+        sprint_debug(logger, "Checking for dependency %s\n", check->depend_ip);
 
-    connectivity_check_t* dependency = NULL;
-    
-    if (check->depend_ip != NULL) {
-        dependency = get_dependency(args->connectivity_checks, args->amount_targets, check->depend_ip, NULL);
+        int available = is_available(check->dependency, 1);
 
-        if (dependency == NULL) {
-            sprint_error(logger, "Unable to find check: %s\n",  check->depend_ip);
+        if (available == 0) {
+            sprint_info(logger, "Awaiting dependency %s\n", check->depend_ip);
 
-            // Stop srd
-            running = 0;
-            kill(getpid(), SIGALRM);
+            check->flags |= FLAG_AWAITING_DEPENDENCY;
 
-            check->flags |= FLAG_ENDED;
-            return;
+            return 0;
         }
+
+        // Remove flag FLAG_AWAITING_DEPENDENCY
+        check->flags &= ~FLAG_AWAITING_DEPENDENCY;
     }
 
-    // main loop: check connectivity repeatedly
-    // next_period is the current time of check and needs to be updated before sleeping for the next iteration
-    while (running)
-    {
-        // check if our dependency is available
-        if (check->depend_ip != NULL) {
-            sprint_debug(logger, "Checking for dependency %s\n",check->depend_ip);
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
 
-            int available = is_available(dependency, 1);
+    // Set latest try. Used to calculate if a target check is stalled
+    set_latest_try(check, now);
 
-            if (available == 0) {
-                sprint_info(logger, "Awaiting dependency %s\n", check->depend_ip);
+    return 1;
+}
 
-                check->flags |= FLAG_AWAITING_DEPENDENCY;
+void end_check(connectivity_check_t* check, const int connected, const struct timespec first_failed)
+{
+    const logger_t* logger = &check->logger;
 
-                next_check_time = timespec_add(next_check_time, period);
-                sleep(check->period);
-                
-                continue;
-            }
+    if (!running) {
+        return;
+    }
 
-            // Remove flag FLAG_AWAITING_DEPENDENCY
-            check->flags &= ~FLAG_AWAITING_DEPENDENCY;
-        }
-        clock_gettime(CLOCK, &now);
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
 
-        // Set latest try. Used to calculate if a target check is stalled
-        check->timestamp_latest_try = now;
-        
-        struct timespec first_failed = { .tv_nsec = 0, .tv_sec = startup_time };
-        int connected = check_connectivity(logger, check, &first_failed);
-        if (!running) {
-            break;
-        }
-        
-        char current_time[32];
-        format_time(datetime_ph, current_time, 32, &now);
-        clock_gettime(CLOCK, &now);
+    char current_time[32];
+    format_time(datetime_ph, current_time, 32, &now);
 
-        double downtime_s = -1.0;
-        double uptime_s = -1.0;
-        conn_state_t prev_state = check->state;
+    double downtime_s = -1.0;
+    double uptime_s = -1.0;
+    conn_state_t prev_state = check->state;
 
-        if (connected == 1)
-        {
-            // set timestamp_first_reply when we're not in STATE_UP
-            if (!(check->state & STATE_UP)) {
-                check->timestamp_first_reply = now;
-            }
+    if (connected == 1)
+    {
+        // set timestamp_first_reply when we're not in STATE_UP
+        if (!(check->state & STATE_UP)) {
+            check->timestamp_first_reply = now;
+        }
 
-            // when we're UP, the downtime is the previous downtime
-            downtime_s = calculate_difference(check->timestamp_first_failed, check->timestamp_first_reply);
+        // when we're UP, the downtime is the previous downtime
+        downtime_s = calculate_difference(check->timestamp_first_failed, check->timestamp_first_reply);
 
-            // normal
-            uptime_s = calculate_difference(check->timestamp_first_reply, now); 
+        // normal
+        uptime_s = calculate_difference(check->timestamp_first_reply, now); 
 
-            // only print if we were not up previously
-            if (check->state != STATE_UP) {
-                sprint_info(logger, "%s: State is now UP.\n", current_time);
-            }
+        // only print if we were not up previously
+        if (check->state != STATE_UP) {
+            sprint_info(logger, "%s: State is now UP.\n", current_time);
+        }
 
-            check->timestamp_last_reply = now;
+        check->timestamp_last_reply = now;
 
-            check->state = STATE_UP;
+        check->state = STATE_UP;
+    }
+    else if (connected == 0)
+    {
+        // set timestamp_first_failed when we're not in STATE_DOWN
+        if (check->state != STATE_DOWN) {
+            sprint_debug(logger, "Setting first failed\n");
+            check->timestamp_first_failed = first_failed;
         }
-        else if (connected == 0)
-        {
-            // set timestamp_first_failed when we're not in STATE_DOWN
-            if (check->state != STATE_DOWN) {
-                sprint_debug(logger, "Setting first failed\n");
-                check->timestamp_first_failed = first_failed;
-            }
 
-            // when we're DOWN the uptime is the previous uptime
-            uptime_s = calculate_difference(check->timestamp_first_reply, check->timestamp_last_reply);
+        // when we're DOWN the uptime is the previous uptime
+        uptime_s = calculate_difference(check->timestamp_first_reply, check->timestamp_last_reply);
 
-            // normal
-            downtime_s = calculate_difference(check->timestamp_first_failed, now);
+        // normal
+        downtime_s = calculate_difference(check->timestamp_first_failed, now);
 
-            // only print if we were not down previously
-            if (check->state != STATE_DOWN) {
-                sprint_info(logger, "%s: State is now DOWN.\n", current_time);
-            }
+        // only print if we were not down previously
+        if (check->state != STATE_DOWN) {
+            sprint_info(logger, "%s: State is now DOWN.\n", current_time);
+        }
 
-            check->state = STATE_DOWN;
-        } else if (!running) {
-            break; 
-        } else {
-            sprint_error(logger, "%s: Error when checking connectivity. Retry in next period.\n", current_time);
-
-            // it is unknown if we are at fault or the other endpoint
-            // so we do not touch the state
-            clock_gettime(CLOCK, &now);
-
-            // diff is the amount of time passed since the last check
-            int32_t diff = calculate_difference_ms(next_check_time, now);
-            // calculate next period multiple of diff
-
-            size_t amount = (size_t) ((diff / 1e3 - 1e-10)/period.tv_sec) + 1;
-            struct timespec add = { .tv_sec = period.tv_sec * amount, .tv_nsec = 0};
-            next_check_time = timespec_add(next_check_time, add);
-
-            int32_t wait_time = calculate_difference_ms(now, next_check_time);
-            
-            if (wait_time > 0) {
-                usleep(wait_time * 1000);
-                continue; // as we do not execute actions when there is an error
-            } else if (wait_time < 0) {
-                sprint_error(logger, "Negative wait time should not be possible\n");
-                continue;
-            }
-            // Print warning if we're behind in schedule
-            if (diff/1e3 > period.tv_sec) {
-                char str_time[32];
-                format_time(datetime_ph, str_time, 32, &now);
+        check->state = STATE_DOWN;
+    } else {
+        sprint_error(logger, "%s: Error when checking connectivity. Retry in next period.\n", current_time);
 
-                sprint_error(logger, "Behind in schedule by %ld ms at %s. Check your period and your timeouts of the actions.\n", diff - period.tv_sec * 1000, str_time);
+        // it is unknown if we are at fault or the other endpoint
+        // so we do not touch the state
+        return; // as we do not execute actions when there is an error
+    }
 
-                continue;
-            }
+    // log the transition; the duration is that of the previous state
+    if (check->state != prev_state) {
+        double duration = 0.0;
+        if (prev_state != STATE_NONE) {
+            duration = check->state == STATE_UP ? downtime_s : uptime_s;
         }
+        journal_append(check, prev_state, &now, duration);
 
-        // check if any action is required
-        for (int i = 0; running && i < check->actions_count; i++)
-        {
-            action_t* this_action = &check->actions[i];
-
-            if (check->state == STATE_DOWN) {
-                this_action->flags &= ~FLAG_RAN_UP_NEW;
-            }
-            if (check->state == STATE_UP) {
-                this_action->flags &= ~FLAG_RAN_DOWN_NEW;
-            }
-            
-            // is 1 if we need to run this action
-            int run = -1;
-            
-            // the state matches or the action is run in ALL states
-            if (check->state == this_action->run_state || this_action->run_state == STATE_ALL) {
-                run = 1;
-            } else if (!(prev_state == STATE_NONE)) {
-                // is now DOWN for longer than 'delay'
-                if (check->state == STATE_DOWN && 
-                    this_action->run_state == STATE_DOWN_NEW &&
-                    this_action->delay <= downtime_s &&
-                    !(this_action->flags & FLAG_RAN_DOWN_NEW))
-                {
-                    run = 1;
-                    this_action->flags |= FLAG_RAN_DOWN_NEW;
-                }
-                // the target is now UP again and downtime was greater than 'delay'
-                // not immediately run STATE_UP_NEW, but regard 'delay'
-                else if (check->state == STATE_UP &&
-                    this_action->run_state == STATE_UP_NEW && 
-                    this_action->delay <= downtime_s &&
-                    !(this_action->flags & FLAG_RAN_UP_NEW))
-                {
-                    run = 1;
-                    this_action->flags |= FLAG_RAN_UP_NEW;
-                }
+        // dependents awaiting us check right away instead of in their next period
+        for (uint32_t i = 0; i < check->dependents_count; i++) {
+            if (check->dependents[i]->flags & FLAG_AWAITING_DEPENDENCY) {
+                prober_wake(check->dependents[i]);
             }
+        }
+    }
 
-            // not immediately print STATE_DOWN, but regard 'delay'
-            int state_down_diff = this_action->run_state != STATE_DOWN || 
-                                check->actions[i].delay <= downtime_s;
-
-            if (run == 1 &&
-                state_down_diff)
-            {
-                sprint_info(logger, "Performing action: %s\n", check->actions[i].name);
-
-                if (strcmp(this_action->name, "service-restart") == 0)
-                {
-                    restart_service(logger, this_action->object);
-                }
-                else if (strcmp(this_action->name, "reboot") == 0)
-                {
-                    sprint_info(logger, "Sending restart signal\n");
-                    int res = restart_system(logger);
-
-                    if (res == 0) { // unable to restart
-                        sprint_error(logger, "Unable to restart using dbus. Will try command\n");
-
-                        placeholder_t placeholder = {.raw_message = "reboot", .info = 0};
-                        
-                        const char* cmd = "reboot";
-                        action_cmd_t cmd_reboot = {.cmd_ph = placeholder};
-
-                        run_command(logger, &cmd_reboot, 5e3, cmd);
-                    } else {
-                        sprint_info(logger, "Reboot scheduled. \n");
-                    }
-                }
-                else if (strcmp(this_action->name, "command") == 0)
-                {
-                    action_cmd_t *cmd = this_action->object;
-
-                    double downtime;
-
-                    // if we are newly up; set downtime to previous downtime
-                    if (check->state == STATE_UP_NEW) {
-                        downtime = check->previous_downtime;
-                    } else {
-                        downtime = downtime_s; // we are still down (or up)
-                    }
-
-                    const char* actual_command = insert_placeholders(&cmd->cmd_ph, check, downtime, uptime_s, connected);
-                    
-                    sprint_debug(logger, "\tCommand: %s\n", actual_command);
-
-                    run_command(logger, cmd, cmd->timeout * 1e3, actual_command);
-
-                    free((char*)actual_command);
-                } else if (strcmp(this_action->name, "log") == 0) { 
-                    action_log_t* action_log = (action_log_t*) this_action->object;
-
-                    double downtime;
-                    // set previous_downtime as downtime when we're newly up
-                    if (check->state == STATE_UP_NEW) {
-                        downtime = check->previous_downtime;
-                    } else {
-                        downtime = downtime_s; // we are still down (or up)
-                    }
-
-                    const char* message = insert_placeholders(&action_log->message_ph, check, downtime, uptime_s, connected);
-
-                    int r = log_to_file(logger, action_log, message);
-                    if (r == 0) {
-                        sprint_error(logger, "Unable to log to file %s\n", action_log->path);
-                    }
-                    
-                    free((char *)message);
-                } else if (strcmp(this_action->name, "influx") == 0) {
-                    action_influx_t* action = this_action->object;
-
-                    char* actual_line_data = insert_placeholders(&action->line, check, downtime_s, uptime_s, connected);
-
-                    influx(logger, action, actual_line_data);
+    // report the result to the collector
+    if ((check->flags & FLAG_IS_COLLECTED) == 0) {
+        collector_submit(check, &now);
+    }
 
-                    free(actual_line_data);
-                }
-                else
-                {
-                    sprint_error(logger, "This action is NOT implemented: %s\n", this_action->name);
-                } 
-            }
-        } // end for loop. (to check if any action has to be taken)
+    // actions which may run in the current state; up-new and down-new not after the start
+    uint64_t candidates = 0;
+    int newly = prev_state != STATE_NONE;
 
-        if (running) {
-            fflush(stdout);
+    if (check->state == STATE_DOWN) {
+        candidates = check->actions_down | (newly ? check->actions_down_new : 0);
 
-            // calculate time until next check should be performed
-            clock_gettime(CLOCK, &now);
+        // up-new may run again once we're back up
+        for (uint64_t m = check->actions_up_new; m != 0; m &= m - 1) {
+            check->actions[__builtin_ctzll(m)].flags &= ~FLAG_RAN_UP_NEW;
+        }
+    } else if (check->state == STATE_UP) {
+        candidates = check->actions_up | (newly ? check->actions_up_new : 0);
 
-            // diff is the amount of time passed since the last check
-            int32_t diff = calculate_difference_ms(next_check_time, now);
-            // calculate next period multiple of diff
+        for (uint64_t m = check->actions_down_new; m != 0; m &= m - 1) {
+            check->actions[__builtin_ctzll(m)].flags &= ~FLAG_RAN_DOWN_NEW;
+        }
+    }
 
-            size_t amount = (size_t) ((diff / 1e3 - 1e-10)/period.tv_sec) + 1;
+    // check if any action is required
+    for (; running && candidates != 0; candidates &= candidates - 1)
+    {
+        action_t* this_action = &check->actions[__builtin_ctzll(candidates)];
 
-            struct timespec add = { .tv_sec = period.tv_sec * amount, .tv_nsec = 0};
-            next_check_time = timespec_add(next_check_time, add);
+        // not immediately run down, down-new and up-new, but regard 'delay'
+        if (this_action->run_state != STATE_UP && this_action->run_state != STATE_ALL &&
+            this_action->delay > downtime_s)
+        {
+            continue;
+        }
 
-            int32_t wait_time = calculate_difference_ms(now, next_check_time);
-            
-            if (wait_time > 0) {
-                usleep(wait_time * 1000);
-            } else if (wait_time < 0) {
-                sprint_error(logger, "Negative wait time should not be possible\n");
+        // run down-new and up-new only once per transition
+        if (this_action->run_state == STATE_DOWN_NEW) {
+            if (this_action->flags & FLAG_RAN_DOWN_NEW) {
                 continue;
             }
-            // Print warning if we're behind in schedule
-            if (diff/1e3 > period.tv_sec) {
-                char str_time[32];
-                format_time(datetime_ph, str_time, 32, &now);
-
-                sprint_error(logger, "Behind in schedule by %ld ms at %s. Check your period and your timeouts of the actions.\n", diff - period.tv_sec * 1000, str_time);
-
+            this_action->flags |= FLAG_RAN_DOWN_NEW;
+        } else if (this_action->run_state == STATE_UP_NEW) {
+            if (this_action->flags & FLAG_RAN_UP_NEW) {
                 continue;
             }
+            this_action->flags |= FLAG_RAN_UP_NEW;
+        }
+
+        // insert the placeholders now; the action may wait for a worker
+        char* text = NULL;
+        if (this_action->ops->prepare != NULL) {
+            text = this_action->ops->prepare(this_action, check, downtime_s, uptime_s, connected);
         }
-    } // end check while(running)
 
-    check->flags |= FLAG_ENDED;
-    print_debug(logger, "Shutting this target check down.\n");
+        // performed by the workers of the pipeline so slow actions do not delay the checks
+        pipeline_submit(logger, this_action, text);
+    } // end for loop. (to check if any action has to be taken)
+
+    // keep the state for the next start of srd
+    statefile_update(check);
+    statetable_update(check);
 }
 
-void signal_handler(int s)
+void stop_running()
 {
-    // stop if we receive one of those signals
-    if (s == SIGALRM || s == SIGINT || s == SIGKILL || s == SIGSTOP || s == SIGTERM || s == SIGABRT)
-    {
-        running = 0;
-        print_debug(logger, "Received %d\n", s);
-        signal(SIGPIPE, SIG_DFL);
-        return;
+    running = 0;
+
+    // the counter is never read, thus it stays readable
+    uint64_t value = 1;
+    if (write(stop_fd, &value, sizeof(value)) < 0) {
+        // only fails if the counter would overflow
     }
-    char str_now[32];
+}
 
+void check_stalled(connectivity_check_t** checks, const int n)
+{
     struct timespec now;
     clock_gettime(CLOCK, &now);
-    format_time(datetime_ph, str_now, 32, &now);
 
-    print_error(logger, "Unhandled signal %d at %s\n", s, str_now);
-    fflush(stdout);
+    for (int i = 0; i < n; i++)
+    {
+        const connectivity_check_t* check = checks[i];
+
+        double diff = calculate_difference(get_latest_try(check), now);
+
+        // + 1 to not report some small overhead occured
+        if (check->period + check->jitter + 1 < diff && ((check->flags & FLAG_AWAITING_DEPENDENCY) == 0)) {
+
+            char str_now[32];
+            format_time(datetime_ph, str_now, 32, &now);
+
+            sprint_error(logger, "%s: check of %s-%s is stalled. Period is %d but last check was %1.2f seconds ago \n", str_now, check->name, (check->flags & FLAG_IS_GATEWAY) ? "%gw" : check->address, check->period, diff);
+        }
+    }
+    sprint_debug(logger, "Checking threads...\n");
 }
 
-int check_connectivity(const logger_t* logger, connectivity_check_t *target, struct timespec* first_failed)
+void print_status(connectivity_check_t** checks, const int n)
 {
-    int success = 0;
-    int i;
-    struct timespec loc_first_failed = { .tv_nsec = 0, .tv_sec = startup_time };
+    struct timespec now;
+    clock_gettime(CLOCK, &now);
 
-    for (i = 0; i < target->num_pings; i++) {
-        int ping_success = ping(logger, target);
+    int up = 0;
+    int down = 0;
+    int awaiting = 0;
 
-        if (ping_success == 1) {
-            success = 1;
-            break;
-        } else if (ping_success < 0) {
-            return (-1);
-        } else if (!running) {
-            return (-1);
-        } else if (ping_success == 0) {
-
-            // set loc_first_failed exactly once, and if we end up not reaching we set it as
-            // first_failed
-            if (target->state == STATE_UP && loc_first_failed.tv_sec == startup_time) {
-                clock_gettime(CLOCK, &loc_first_failed);
-            }
+    for (int i = 0; i < n; i++)
+    {
+        const connectivity_check_t* check = checks[i];
+        conn_state_t state = check->state;
+        const char* str_state = "UNKNOWN";
+
+        if (check->flags & FLAG_AWAITING_DEPENDENCY) {
+            str_state = "AWAITING DEPENDENCY";
+            awaiting++;
+        } else if (state & STATE_UP) {
+            str_state = "UP";
+            up++;
+        } else if (state & STATE_DOWN) {
+            str_state = "DOWN";
+            down++;
         }
-    }
-    if (i == target->num_pings && success == 0) {
-        *first_failed = loc_first_failed;
 
-        return 0;
+        sprint_info(logger, "\t%s-%s: %s, checked %1.1f seconds ago\n", check->name, (check->flags & FLAG_IS_GATEWAY) ? "%gw" : check->address,
+            str_state, calculate_difference(get_latest_try(check), now));
     }
 
-    sprint_debug(logger, "Ping has success: %d with latency: %2.3fms\n", success, target->latency * 1000);
+    sprint_info(logger, "Status: %d targets, %d UP, %d DOWN, %d awaiting their dependency, %d unknown\n", n, up, down, awaiting, n - up - down - awaiting);
+    pipeline_print_metrics(logger);
+    http_print_metrics(logger);
+    mqtt_print_metrics(logger);
+}
 
-    return success;
+void handle_signals(const int signal_fd, connectivity_check_t** checks, const int n)
+{
+    struct signalfd_siginfo info;
+
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGTERM:
+            case SIGINT:
+                sprint_debug(logger, "Got signal %d\n", info.ssi_signo);
+                stop_running();
+                break;
+            case SIGHUP:
+                // f.ex. sent by logrotate
+                sprint_info(logger, "Reopening the files of the log actions\n");
+                actions_reopen_files();
+                break;
+            case SIGUSR1:
+                print_status(checks, n);
+                break;
+        }
+    }
 }
 
 connectivity_check_t **load(char *directory, int *success, int *count)
@@ -859,6 +947,19 @@ connectivity_check_t **load(char *directory, int *success, int *count)
     return conns;
 }
 
+/*
+ * Returns a copy of str where %ip is replaced with the address of cc.
+ * If cc follows the gateway %ip is left and replaced when inserting the
+ * placeholders, as the address may change.
+ */
+static char* replace_ip(const char* str, const connectivity_check_t* cc) {
+    if (cc->flags & FLAG_IS_GATEWAY) {
+        return strdup(str);
+    }
+
+    return str_replace(str, "%ip", cc->address);
+}
+
 int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_size, int* max_conns_size)
 {
     config_t cfg;
@@ -893,10 +994,6 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
 
             connectivity_check_t* cc = (connectivity_check_t* )calloc(1, sizeof(connectivity_check_t));
 
-            // initial values for a target
-            cc->socket = -1;
-            cc->epoll_fd = -1;
-
             // set the configuration name
             char* path = strdup(cfg_path);
             char* base = basename(path);
@@ -904,9 +1001,8 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
             strcpy(cc->name, base);
             free((char *)path);
 
-            // allocate buffers
+            // allocate the buffer; the replies are received by the probe loops
             cc->snd_buffer = malloc(PACKETSIZE * sizeof(char));
-            cc->rcv_buffer = malloc(PACKETSIZE * sizeof(char));
 
             // initialize timestamps which store first success; last (latest) reply, ...
             const struct timespec time_zero = { .tv_nsec = 0, .tv_sec = startup_time};
@@ -927,15 +1023,55 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
             memcpy(ip, cur_ip_start, length);
             *(ip + length) = '\0';
 
-            cc->address = str_replace(ip, "%gw", default_gw);
+            if (strcmp(ip, "%gw") == 0) {
+                // follows the gateway; has space for any IP as it may change
+                cc->address = calloc(INET6_ADDRSTRLEN, sizeof(char));
+                strcpy((char *)cc->address, default_gw);
+                cc->flags |= FLAG_IS_GATEWAY;
+            } else {
+                cc->address = str_replace(ip, "%gw", default_gw);
+            }
             free(ip);
 
             // try to load as sockaddr
             cc->sockaddr = calloc(1, sizeof(struct sockaddr_storage));
             int is_addr = to_sockaddr(cc->address, cc->sockaddr);
 
+            // also sets the scope of link local gateways
+            if (cc->flags & FLAG_IS_GATEWAY) {
+                get_gateway((char *)cc->address, INET6_ADDRSTRLEN, cc->sockaddr);
+            }
+
+            // source: "ping" (default) or "agents" when their results are collected
+            const char* source;
+            if (config_lookup_string(&cfg, "source", &source) && strcmp(source, "ping") != 0) {
+                if (strcmp(source, "agents") != 0) {
+                    print_error(logger, "%s contains unknown source: %s\n", cfg_path, source);
+                    config_destroy(&cfg);
+                    return 0;
+                }
+                if (!is_addr || (cc->flags & FLAG_IS_GATEWAY)) {
+                    print_error(logger, "%s: destinations reported by agents must be IPs\n", cfg_path);
+                    config_destroy(&cfg);
+                    return 0;
+                }
+                cc->flags |= FLAG_IS_COLLECTED;
+
+                int quorum = 1;
+                config_lookup_int(&cfg, "quorum", &quorum);
+                if (quorum < 1) {
+                    print_error(logger, "%s quorum must be at least 1\n", cfg_path);
+                    config_destroy(&cfg);
+                    return 0;
+                }
+                cc->quorum = quorum;
+            }
+
             if (!is_addr) {
                 cc->flags |= FLAG_IS_HOSTNAME;
+            } else if ((cc->flags & FLAG_IS_COLLECTED) == 0) {
+                // hostnames get their template once resolved
+                build_packet_template(cc);
             }
 
             // set initial connectivity_check values
@@ -947,8 +1083,13 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                 print_error(logger, "%s is missing setting: period\n", cfg_path);
                 config_destroy(&cfg);
                 return 0;
+            } else if (period < 1 || period > UINT8_MAX) {
+                // the scheduler divides by the period and it's stored in a uint8_t
+                print_error(logger, "%s period must be between 1 and %d s\n", cfg_path, UINT8_MAX);
+                config_destroy(&cfg);
+                return 0;
             } else {
-                cc->period = period; 
+                cc->period = period;
             }
 
             // timeout (can be an integer or double)
@@ -986,6 +1127,48 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
             config_lookup_int(&cfg, "num_pings", &num_pings);
             cc->num_pings = num_pings;
 
+            // schedule configuration
+            const char* setting_schedule = NULL;
+            if (config_lookup_string(&cfg, "schedule", &setting_schedule))
+            {
+                cc->schedule = to_schedule_policy(setting_schedule);
+
+                if (cc->schedule == SCHEDULE_INVALID)
+                {
+                    print_error(logger, "%s contains unknown schedule: %s\n", cfg_path, setting_schedule);
+                    config_destroy(&cfg);
+                    return 0;
+                }
+            } else {
+                cc->schedule = SCHEDULE_IMMEDIATE;
+            }
+
+            // jitter (can be an integer or double); defaults to a tenth of the period
+            int jitter;
+            double jitter_dbl;
+            if (cc->schedule != SCHEDULE_JITTER) {
+                cc->jitter = 0.0;
+            } else if (config_lookup_int(&cfg, "jitter", &jitter)) {
+                cc->jitter = (float) jitter;
+            } else if (config_lookup_float(&cfg, "jitter", &jitter_dbl)) {
+                cc->jitter = jitter_dbl;
+            } else {
+                cc->jitter = cc->period / 10.0;
+            }
+
+            if (cc->jitter < 0) {
+                print_error(logger, "%s jitter cannot be negative\n", cfg_path);
+                config_destroy(&cfg);
+                return 0;
+            }
+
+            // the ping must stay in its period, else the next slot is skipped
+            if (cc->jitter >= cc->period) {
+                print_error(logger, "%s jitter must be below the period (%d s)\n", cfg_path, cc->period);
+                config_destroy(&cfg);
+                return 0;
+            }
+
             // loglevel configuration
             const char* setting_loglevel = NULL;
             if (config_lookup_string(&cfg, "loglevel", &setting_loglevel))
@@ -1024,6 +1207,69 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                     datetime_format = strdup(format);
                     use_custom_datetime_format = 1;
                 }
+
+                // state_file
+                const char* path;
+                if (!use_custom_state_file && config_lookup_string(&cfg, "state_file", &path)) {
+                    state_file = strdup(path);
+                    use_custom_state_file = 1;
+                }
+
+                // journal_file
+                if (!use_custom_journal_file && config_lookup_string(&cfg, "journal_file", &path)) {
+                    journal_file = strdup(path);
+                    use_custom_journal_file = 1;
+                }
+
+                // state_table
+                if (!use_custom_state_table && config_lookup_string(&cfg, "state_table", &path)) {
+                    state_table = strdup(path);
+                    use_custom_state_table = 1;
+                }
+
+                // agent: collector and agent_name
+                const char* endpoint;
+                if (collector == NULL && config_lookup_string(&cfg, "collector", &endpoint)) {
+                    collector = strdup(endpoint);
+
+                    const char* name;
+                    if (config_lookup_string(&cfg, "agent_name", &name)) {
+                        agent_name = strdup(name);
+                    }
+                }
+
+                // collector: collector_listen
+                if (collector_listen == NULL && config_lookup_string(&cfg, "collector_listen", &endpoint)) {
+                    collector_listen = strdup(endpoint);
+                }
+
+                // action pipeline: action_workers, action_queue_size and action_limits
+                config_lookup_int(&cfg, "action_workers", &action_workers);
+                config_lookup_int(&cfg, "action_queue_size", &action_queue_size);
+
+                // requests of the influx and webhook actions waiting to be sent
+                config_lookup_int(&cfg, "http_queue_size", &http_queue_size);
+                if (http_ca_file == NULL && config_lookup_string(&cfg, "http_ca_file", &path)) {
+                    http_ca_file = strdup(path);
+                }
+
+                // messages of the mqtt actions waiting to be published
+                config_lookup_int(&cfg, "mqtt_queue_size", &mqtt_queue_size);
+
+                // probe loops: probe_threads and probe_affinity
+                config_lookup_int(&cfg, "probe_threads", &probe_threads);
+                config_lookup_bool(&cfg, "probe_affinity", &probe_affinity);
+
+                const config_setting_t* limits = config_lookup(&cfg, "action_limits");
+                for (int i = 0; limits != NULL && i < config_setting_length(limits); i++) {
+                    const config_setting_t* limit = config_setting_get_elem(limits, i);
+
+                    if (!pipeline_set_limit(config_setting_name(limit), config_setting_get_int(limit))) {
+                        print_error(logger, "%s: unknown action in action_limits: %s\n", cfg_path, config_setting_name(limit));
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                }
             } // end if for "srd.conf"
 
             // load the actions
@@ -1034,6 +1280,11 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                 config_destroy(&cfg);
                 return 1;
             }
+            if (config_setting_length(setting) > MAX_ACTIONS) {
+                print_error(logger, "%s: more than %d actions.\n", cfg_path, MAX_ACTIONS);
+                config_destroy(&cfg);
+                return 0;
+            }
             cc->actions_count = config_setting_length(setting);
             cc->actions = calloc(cc->actions_count, sizeof(action_t));
 
@@ -1054,9 +1305,19 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                     config_destroy(&cfg);
                     return 0;
                 }
-                int action_len = strlen(action_name) + 1;
-                cc->actions[i].name = (char *)malloc(action_len * sizeof(char));
-                strcpy((char *)cc->actions[i].name, action_name);
+                int type = action_type(action_name);
+                if (type < 0) {
+                    print_error(logger, "%s: unknown element in configuration on line %d\n", cfg_path, action->line);
+                    config_destroy(&cfg);
+                    return 0;
+                }
+                if (action_ops[type].execute == NULL) {
+                    print_error(logger, "%s: srd was built without support for %s actions (line %d)\n", cfg_path, action_name, action->line);
+                    config_destroy(&cfg);
+                    return 0;
+                }
+                this_action->type = type;
+                this_action->ops = &action_ops[type];
 
                 // run_if configuration
                 const char *run_if_str;
@@ -1081,6 +1342,21 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         return 0;
                     }
                 }
+
+                // index the action by the states it may run in
+                const uint64_t bit = (uint64_t) 1 << i;
+                if (this_action->run_state == STATE_UP || this_action->run_state == STATE_ALL) {
+                    cc->actions_up |= bit;
+                }
+                if (this_action->run_state == STATE_DOWN || this_action->run_state == STATE_ALL) {
+                    cc->actions_down |= bit;
+                }
+                if (this_action->run_state == STATE_UP_NEW) {
+                    cc->actions_up_new |= bit;
+                }
+                if (this_action->run_state == STATE_DOWN_NEW) {
+                    cc->actions_down_new |= bit;
+                }
                 
                 // delay configuration
                 int delay;
@@ -1092,11 +1368,11 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                 }
 
                 // Load the properties for action_name
-                if (strcmp(action_name, "reboot") == 0)
+                if (this_action->type == ACTION_REBOOT)
                 {
                     // nothing to do
                 }
-                else if (strcmp(action_name, "service-restart") == 0)
+                else if (this_action->type == ACTION_SERVICE_RESTART)
                 {
                     if (!config_setting_lookup_string(action, "name", (const char **)&cc->actions[i].object))
                     {
@@ -1115,7 +1391,7 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                     
                     cc->actions[i].object = escaped_servicename;
                 }
-                else if (strcmp(action_name, "command") == 0)
+                else if (this_action->type == ACTION_COMMAND)
                 {
                     action_cmd_t *cmd = malloc(sizeof(action_cmd_t));
 
@@ -1126,7 +1402,7 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         config_destroy(&cfg);
                         return 0;
                     }
-                    command = str_replace(command, "%ip", (char *)cc->address);
+                    command = replace_ip(command, cc);
 
                     const placeholder_t placeholder = {
                         .info = get_replacements(command),
@@ -1155,7 +1431,7 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
 
                     this_action->object = cmd;
                 }
-                else if (strcmp(action_name, "log") == 0) {
+                else if (this_action->type == ACTION_LOG) {
                     action_log_t *action_log = calloc(1, sizeof(action_log_t));
 
                     const char* path;
@@ -1180,9 +1456,9 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         return 0;
                     }
                     placeholder_t placeholder = {
-                        .info = get_replacements(message),
-                        .raw_message = str_replace(message, "%ip", (char *)cc->address)
+                        .raw_message = replace_ip(message, cc)
                     };
+                    placeholder.info = get_replacements(placeholder.raw_message);
                     action_log->message_ph = placeholder;
 
                     // Load header
@@ -1204,12 +1480,8 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
 
                     this_action->object = action_log;
                 }
-                else if (strcmp(action_name, "influx") == 0) {
+                else if (this_action->type == ACTION_INFLUX) {
                     action_influx_t *action_influx = calloc(1, sizeof(action_influx_t));
-                    action_influx->conn_socket = -1;
-                    action_influx->conn_epoll_read_fd = -1;
-                    action_influx->conn_epoll_write_fd = -1;
-                    action_influx->flags = 0;
 
                     // load the host
                     const char* host;
@@ -1227,20 +1499,13 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         action_influx->port = 8086;
                     }
 
-                    // Store sockaddr if host is an IP
-                    action_influx->sockaddr = calloc(1, sizeof(struct sockaddr_storage));
-                    int is_ip = to_sockaddr(host, action_influx->sockaddr);
+                    // load tls
+                    int tls = 0;
+                    config_setting_lookup_bool(action, "tls", &tls);
+
+                    // all actions sending to the same server share its connections
+                    action_influx->server = http_endpoint(host, action_influx->port, tls);
 
-                    if (is_ip) {
-                        if (action_influx->sockaddr->ss_family == AF_INET) {
-                            ((struct sockaddr_in*)action_influx->sockaddr)->sin_port = htons(action_influx->port);
-                        } else {
-                            ((struct sockaddr_in6*)action_influx->sockaddr)->sin6_port = htons(action_influx->port);
-                        }
-                    } else {
-                        action_influx->flags |= FLAG_IS_HOSTNAME;
-                    }
-                    
                     // load the endpoint
                     const char* endpoint;
                     if (!config_setting_lookup_string(action, "endpoint", &endpoint))
@@ -1259,7 +1524,9 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         config_destroy(&cfg);
                         return 0;
                     }
-                    action_influx->authorization = strdup(authorization);
+                    char authorization_header[strlen(authorization) + 20];
+                    snprintf(authorization_header, sizeof(authorization_header), "Authorization: %s\r\n", authorization);
+                    action_influx->authorization = strdup(authorization_header);
 
                     // load linedata format
                     const char* linedata;
@@ -1270,9 +1537,9 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         return 0;
                     }
                     placeholder_t placeholder = {
-                        .raw_message = str_replace(linedata, "%ip", cc->address),
-                        .info = get_replacements(linedata)
+                        .raw_message = replace_ip(linedata, cc)
                     };
+                    placeholder.info = get_replacements(placeholder.raw_message);
                     action_influx->line = placeholder;
 
                     // load backup file path
@@ -1297,13 +1564,401 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
                         action_influx->timeout = 2;
                     }
 
+                    // load retries
+                    if (!config_setting_lookup_int(action, "retries", &action_influx->retries)) {
+                        action_influx->retries = 0;
+                    }
+
                     this_action->object = action_influx;
                 }
-                else
-                {
-                    print_error(logger, "%s: unknown element in configuration on line %d\n", cfg_path, action->line);
-                    config_destroy(&cfg);
-                    return 0;
+                else if (this_action->type == ACTION_WEBHOOK) {
+                    action_webhook_t *action_webhook = calloc(1, sizeof(action_webhook_t));
+                    this_action->object = action_webhook;
+
+                    // load the url
+                    const char* url;
+                    if (!config_setting_lookup_string(action, "url", &url))
+                    {
+                        print_error(logger, "%s: element is missing the url\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    char* url_replaced = str_replace(url, "%ip", cc->address);
+                    int tls;
+                    int parsed = http_parse_url(url_replaced, (char **)&action_webhook->host, &action_webhook->port, (char **)&action_webhook->path, &tls);
+                    free(url_replaced);
+                    if (!parsed) {
+                        print_error(logger, "%s: invalid url (only http[s]://host[:port]/path is supported): %s\n", cfg_path, url);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // all actions sending to the same server share its connections
+                    action_webhook->server = http_endpoint(action_webhook->host, action_webhook->port, tls);
+
+                    // load the body
+                    const char* body;
+                    if (!config_setting_lookup_string(action, "body", &body))
+                    {
+                        print_error(logger, "%s: element is missing the body\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // load the headers: the content type and further lines
+                    const char* content_type;
+                    if (!config_setting_lookup_string(action, "content_type", &content_type))
+                    {
+                        content_type = "application/json";
+                    }
+                    size_t headers_length = strlen(content_type) + 17;
+
+                    // placeholders are escaped for JSON bodies by default
+                    const char* escape;
+                    int escape_json = strstr(content_type, "json") != NULL;
+                    if (config_setting_lookup_string(action, "escape", &escape)) {
+                        if (strcmp(escape, "json") == 0) {
+                            escape_json = 1;
+                        } else if (strcmp(escape, "none") == 0) {
+                            escape_json = 0;
+                        } else {
+                            print_error(logger, "%s: escape must be \"json\" or \"none\" (line %d)\n", cfg_path, action->line);
+                            config_destroy(&cfg);
+                            return 0;
+                        }
+                    }
+
+                    placeholder_t placeholder;
+                    if (escape_json && (cc->flags & FLAG_IS_GATEWAY) == 0) {
+                        char address[6 * 256];
+                        json_escape(cc->address, address, sizeof(address));
+                        placeholder.raw_message = str_replace(body, "%ip", address);
+                    } else {
+                        placeholder.raw_message = replace_ip(body, cc);
+                    }
+                    placeholder.info = get_replacements(placeholder.raw_message);
+                    if (escape_json) {
+                        placeholder.info |= FLAG_ESCAPE_JSON;
+                    }
+                    action_webhook->body = placeholder;
+
+                    config_setting_t* headers = config_setting_get_member(action, "headers");
+                    int headers_count = headers != NULL ? config_setting_length(headers) : 0;
+                    for (int h = 0; h < headers_count; h++) {
+                        const char* header = config_setting_get_string_elem(headers, h);
+                        if (header == NULL || strchr(header, ':') == NULL || strpbrk(header, "\r\n") != NULL) {
+                            print_error(logger, "%s: headers must be strings like \"Name: value\" (line %d)\n", cfg_path, headers->line);
+                            config_destroy(&cfg);
+                            return 0;
+                        }
+                        headers_length += strlen(header) + 2;
+                    }
+
+                    char* header_lines = malloc(headers_length);
+                    int offset = snprintf(header_lines, headers_length, "Content-Type: %s\r\n", content_type);
+                    for (int h = 0; h < headers_count; h++) {
+                        offset += snprintf(header_lines + offset, headers_length - offset, "%s\r\n", config_setting_get_string_elem(headers, h));
+                    }
+                    action_webhook->headers = header_lines;
+
+                    // load timeout and retries
+                    if (!config_setting_lookup_int(action, "timeout", &action_webhook->timeout)) {
+                        action_webhook->timeout = 5;
+                    }
+                    if (!config_setting_lookup_int(action, "retries", &action_webhook->retries)) {
+                        action_webhook->retries = 3;
+                    }
+                }
+                else if (this_action->type == ACTION_MQTT) {
+                    action_mqtt_t *action_mqtt = calloc(1, sizeof(action_mqtt_t));
+                    this_action->object = action_mqtt;
+
+                    // load the broker
+                    const char* broker;
+                    if (!config_setting_lookup_string(action, "broker", &broker))
+                    {
+                        print_error(logger, "%s: element is missing the broker\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    action_mqtt->host = strdup(broker);
+
+                    if (!config_setting_lookup_int(action, "port", &action_mqtt->port)) {
+                        action_mqtt->port = MQTT_PORT;
+                    }
+
+                    // load the session: client_id (default srd-<hostname>), credentials and keepalive
+                    const char* client_id;
+                    char default_client_id[HOST_NAME_MAX + 5] = "srd-";
+                    if (!config_setting_lookup_string(action, "client_id", &client_id)) {
+                        gethostname(default_client_id + 4, HOST_NAME_MAX);
+                        default_client_id[sizeof(default_client_id) - 1] = '\0';
+                        client_id = default_client_id;
+                    }
+
+                    const char* username = NULL;
+                    const char* password = NULL;
+                    config_setting_lookup_string(action, "username", &username);
+                    config_setting_lookup_string(action, "password", &password);
+
+                    int keepalive;
+                    if (!config_setting_lookup_int(action, "keepalive", &keepalive)) {
+                        keepalive = MQTT_KEEPALIVE;
+                    }
+                    if (keepalive < 0 || keepalive > 0xFFFF) {
+                        print_error(logger, "%s: keepalive must be between 0 and 65535 seconds (line %d)\n", cfg_path, action->line);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // all actions with the same broker and client id share one connection
+                    action_mqtt->broker = mqtt_broker(logger, cfg_path, broker, action_mqtt->port, client_id, username, password, keepalive);
+                    if (action_mqtt->broker == NULL) {
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // load the topic and the message
+                    const char* topic;
+                    if (!config_setting_lookup_string(action, "topic", &topic))
+                    {
+                        print_error(logger, "%s: element is missing the topic\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    if (strpbrk(topic, "+#") != NULL) {
+                        print_error(logger, "%s: the topic must not contain wildcards (line %d)\n", cfg_path, action->line);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    placeholder_t topic_placeholder = {
+                        .raw_message = replace_ip(topic, cc)
+                    };
+                    topic_placeholder.info = get_replacements(topic_placeholder.raw_message);
+                    action_mqtt->topic = topic_placeholder;
+
+                    const char* message;
+                    if (!config_setting_lookup_string(action, "message", &message))
+                    {
+                        print_error(logger, "%s: element is missing the message\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    placeholder_t message_placeholder = {
+                        .raw_message = replace_ip(message, cc)
+                    };
+                    message_placeholder.info = get_replacements(message_placeholder.raw_message);
+                    action_mqtt->message = message_placeholder;
+
+                    // load qos and retain
+                    if (!config_setting_lookup_int(action, "qos", &action_mqtt->qos)) {
+                        action_mqtt->qos = 0;
+                    }
+                    if (action_mqtt->qos != 0 && action_mqtt->qos != 1) {
+                        print_error(logger, "%s: only qos 0 and 1 are supported (line %d)\n", cfg_path, action->line);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    if (!config_setting_lookup_bool(action, "retain", &action_mqtt->retain)) {
+                        action_mqtt->retain = 0;
+                    }
+                }
+                else if (this_action->type == ACTION_WOL) {
+                    action_wol_t *action_wol = calloc(1, sizeof(action_wol_t));
+                    this_action->object = action_wol;
+
+                    // load the MAC and build the magic packet: 6 times 0xFF, then 16 times the MAC
+                    const char* mac;
+                    uint8_t mac_bytes[6];
+                    char separator[6] = "";
+                    if (!config_setting_lookup_string(action, "mac", &mac))
+                    {
+                        print_error(logger, "%s: element is missing the mac\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    int end = 0;
+                    if (sscanf(mac, "%2hhx%c%2hhx%c%2hhx%c%2hhx%c%2hhx%c%2hhx%n",
+                               &mac_bytes[0], &separator[0], &mac_bytes[1], &separator[1], &mac_bytes[2], &separator[2],
+                               &mac_bytes[3], &separator[3], &mac_bytes[4], &separator[4], &mac_bytes[5], &end) != 11
+                        || mac[end] != '\0' || strspn(separator, ":-") != 5) {
+                        print_error(logger, "%s: invalid mac (expected aa:bb:cc:dd:ee:ff): %s\n", cfg_path, mac);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    action_wol->mac = strdup(mac);
+
+                    memset(action_wol->packet, 0xFF, 6);
+                    for (int m = 1; m <= 16; m++) {
+                        memcpy(action_wol->packet + m * 6, mac_bytes, 6);
+                    }
+
+                    // load the interface and how the packet is sent
+                    const char* interface;
+                    if (config_setting_lookup_string(action, "interface", &interface)) {
+                        action_wol->interface = strdup(interface);
+                    }
+                    config_setting_lookup_bool(action, "raw", &action_wol->raw);
+                    if (action_wol->raw && action_wol->interface == NULL) {
+                        print_error(logger, "%s: raw wol packets need an interface (line %d)\n", cfg_path, action->line);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    const char* address;
+                    if (!config_setting_lookup_string(action, "address", &address)) {
+                        address = "255.255.255.255";
+                    }
+                    if (!to_sockaddr(address, &action_wol->address)) {
+                        print_error(logger, "%s: address of wol must be an IP: %s\n", cfg_path, address);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    int port;
+                    if (!config_setting_lookup_int(action, "port", &port)) {
+                        port = 9;
+                    }
+                    set_port(&action_wol->address, port);
+
+                    // load retries and interval
+                    if (!config_setting_lookup_int(action, "retries", &action_wol->retries)) {
+                        action_wol->retries = 2;
+                    }
+                    if (!config_setting_lookup_int(action, "interval", &action_wol->interval)) {
+                        action_wol->interval = 100;
+                    }
+                }
+                else if (this_action->type == ACTION_ROUTE) {
+                    action_route_t *action_route = calloc(1, sizeof(action_route_t));
+                    this_action->object = action_route;
+
+                    // load the operation
+                    const char* operation;
+                    if (!config_setting_lookup_string(action, "operation", &operation) || strcmp(operation, "replace") == 0) {
+                        action_route->operation = ROUTE_REPLACE;
+                    } else if (strcmp(operation, "add") == 0) {
+                        action_route->operation = ROUTE_ADD;
+                    } else if (strcmp(operation, "delete") == 0) {
+                        action_route->operation = ROUTE_DELETE;
+                    } else {
+                        print_error(logger, "%s: operation of route must be replace, add or delete: %s\n", cfg_path, operation);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // load the gateway; %ip is the target, f.ex. the router of an uplink
+                    const char* gateway;
+                    if (config_setting_lookup_string(action, "gateway", &gateway)) {
+                        char* gateway_replaced = str_replace(gateway, "%ip", cc->address);
+                        int valid = to_sockaddr(gateway_replaced, &action_route->gateway);
+                        free(gateway_replaced);
+
+                        if (!valid) {
+                            print_error(logger, "%s: gateway of route must be an IP: %s\n", cfg_path, gateway);
+                            config_destroy(&cfg);
+                            return 0;
+                        }
+                    }
+
+                    const char* interface;
+                    if (config_setting_lookup_string(action, "interface", &interface)) {
+                        action_route->interface = strdup(interface);
+                    }
+                    if (action_route->operation != ROUTE_DELETE && action_route->gateway.ss_family == AF_UNSPEC && action_route->interface == NULL) {
+                        print_error(logger, "%s: route needs a gateway or an interface (line %d)\n", cfg_path, action->line);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // load the destination: "default" or an IP with an optional prefix length
+                    const char* destination;
+                    if (!config_setting_lookup_string(action, "destination", &destination)) {
+                        destination = "default";
+                    }
+                    if (strcmp(destination, "default") == 0) {
+                        action_route->destination.ss_family = action_route->gateway.ss_family == AF_INET6 ? AF_INET6 : AF_INET;
+                        action_route->prefix = 0;
+                    } else {
+                        char* address = str_replace(destination, "%ip", cc->address);
+                        char* slash = strchr(address, '/');
+                        if (slash != NULL) {
+                            *slash = '\0';
+                        }
+                        int valid = to_sockaddr(address, &action_route->destination);
+                        int max_prefix = action_route->destination.ss_family == AF_INET ? 32 : 128;
+                        char* end = NULL;
+                        action_route->prefix = slash != NULL ? (int) strtol(slash + 1, &end, 10) : max_prefix;
+                        valid = valid && (end == NULL || (end != slash + 1 && *end == '\0'));
+                        free(address);
+
+                        if (!valid || action_route->prefix < 0 || action_route->prefix > max_prefix) {
+                            print_error(logger, "%s: destination of route must be default or an IP with an optional prefix length: %s\n", cfg_path, destination);
+                            config_destroy(&cfg);
+                            return 0;
+                        }
+                    }
+                    if (action_route->gateway.ss_family != AF_UNSPEC && action_route->gateway.ss_family != action_route->destination.ss_family) {
+                        print_error(logger, "%s: destination and gateway of route must be of the same IP version (line %d)\n", cfg_path, action->line);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+
+                    // load metric and table
+                    int metric;
+                    action_route->metric = config_setting_lookup_int(action, "metric", &metric) ? metric : -1;
+
+                    int table;
+                    action_route->table = config_setting_lookup_int(action, "table", &table) ? (uint32_t) table : ROUTE_TABLE_MAIN;
+
+                    netlink_build_route(action_route);
+                }
+                else if (this_action->type == ACTION_INTERFACE_RESET) {
+                    action_interface_reset_t *action_reset = calloc(1, sizeof(action_interface_reset_t));
+                    this_action->object = action_reset;
+
+                    const char* interface;
+                    if (!config_setting_lookup_string(action, "interface", &interface))
+                    {
+                        print_error(logger, "%s: element is missing the interface\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    action_reset->interface = strdup(interface);
+
+                    // load down_time and timeout
+                    if (!config_setting_lookup_int(action, "down_time", &action_reset->down_time)) {
+                        action_reset->down_time = 0;
+                    }
+                    if (!config_setting_lookup_int(action, "timeout", &action_reset->timeout)) {
+                        action_reset->timeout = 10;
+                    }
+                }
+                else if (this_action->type == ACTION_JSONL) {
+                    action_jsonl_t *action_jsonl = calloc(1, sizeof(action_jsonl_t));
+                    this_action->object = action_jsonl;
+
+                    const char* path;
+                    if (!config_setting_lookup_string(action, "path", &path))
+                    {
+                        print_error(logger, "%s: element is missing the path\n", cfg_path);
+                        config_destroy(&cfg);
+                        return 0;
+                    }
+                    const char* username = NULL;
+                    config_setting_lookup_string(action, "user", &username);
+
+                    // all actions writing to the same path share its stream
+                    char* path_replaced = str_replace(path, "%ip", cc->address);
+                    action_jsonl->file = jsonl_file(path_replaced, username);
+                    free(path_replaced);
+
+                    // the config name is the same for all lines: escape it once
+                    size_t name_length = json_escape(cc->name, NULL, 0);
+                    action_jsonl->prefix_length = name_length + strlen("{\"config\":\"\",");
+                    action_jsonl->prefix = malloc(action_jsonl->prefix_length + 1);
+                    strcpy(action_jsonl->prefix, "{\"config\":\"");
+                    json_escape(cc->name, action_jsonl->prefix + strlen("{\"config\":\""), name_length + 1);
+                    strcat(action_jsonl->prefix, "\",");
                 }
             }
 
@@ -1313,8 +1968,8 @@ int load_config(const char *cfg_path, connectivity_check_t*** conns, int* conns_
 
             // check if we need more space in conns
             if (*conns_size >= *max_conns_size) {
-                // increase size of conns
-                *max_conns_size += 1;
+                // increase size of conns; doubled as there may be many destinations in one file
+                *max_conns_size *= 2;
                 *conns = realloc(*conns, (*max_conns_size) * sizeof(connectivity_check_t *));
 
                 if (conns == NULL) {
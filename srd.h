@@ -2,15 +2,19 @@
 #define SRD_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <time.h>
 struct timespec;
+struct route_cache_t;
 
 #include "actions.h"
 #include "printing.h"
 
 #define CLOCK CLOCK_REALTIME_COARSE
 
+/* Maximum amount of actions of one target (bits of the masks in connectivity_check_t) */
+#define MAX_ACTIONS 64
 
 /*
  * These flags are used in connectivity_check_t
@@ -19,7 +23,20 @@ struct timespec;
 #define FLAG_STARTED                0b10
 #define FLAG_STARTING_DEPENDENCY    0b100
 #define FLAG_IS_HOSTNAME            0b1000
-#define FLAG_ENDED                  0b10000
+#define FLAG_IS_GATEWAY             0b100000
+#define FLAG_IS_COLLECTED           0b1000000
+
+/*
+ * Defines when the periodic checks of a target are scheduled.
+ */
+typedef enum schedule_policy_t
+{
+    SCHEDULE_IMMEDIATE, // first check at startup, then every period (default)
+    SCHEDULE_SPREAD,    // checks with the same period are spread evenly across it
+    SCHEDULE_ALIGNED,   // checks run at wall-clock multiples of the period
+    SCHEDULE_JITTER,    // a random offset of up to `jitter` seconds is added to each check
+    SCHEDULE_INVALID,   // This should never happen
+} schedule_policy_t;
 
 /* A connectivity check is one target to which we do connectivity checks.
  * Each config file represents one such check. As Each target can have its
@@ -39,6 +56,79 @@ typedef struct connectivity_check_t
     // IP address this check depends on
     const char *depend_ip;
 
+    // The check this check depends on; NULL if it has no dependency
+    struct connectivity_check_t* dependency;
+
+    // Checks depending on this check; woken up when our state changes
+    struct connectivity_check_t** dependents;
+    uint32_t dependents_count;
+
+    // Record of this check in the state file; NULL if the state is not persisted
+    struct state_record_t* record;
+
+    // Record of this check in the shared memory state table; NULL if the state is not published
+    struct statetable_record_t* table_record;
+
+    // Results of the agents if the state is reported by them (FLAG_IS_COLLECTED)
+    struct collected_t* collected;
+
+    // Amount of agents which have to report the target DOWN so it is DOWN (FLAG_IS_COLLECTED)
+    uint16_t quorum;
+
+    // Generation of the default gateway this check pings (FLAG_IS_GATEWAY)
+    unsigned int gateway_generation;
+
+    // Index of the interface through which the target is reached; 0 if unknown
+    _Atomic int oif;
+
+    // Generation of the routes used when looking up oif
+    unsigned int route_generation;
+
+    // Is 1 if the interface oif has no carrier. Then we do not ping.
+    _Atomic int link_down;
+
+    // Probe loop this check runs on
+    struct prober_t* prober;
+
+    // Checks of other configs pinging the same address; they share one ping (NULL if none)
+    struct probe_group_t* group;
+
+    // Next check of the group awaiting the result of the ping in flight
+    struct connectivity_check_t* group_next;
+
+    // Position of this check in the timer heap of its probe loop
+    uint32_t heap_index;
+
+    // What the probe loop waits for (PROBE_* in prober.c)
+    uint8_t probe_phase;
+
+    // Amount of pings sent in the current period
+    uint8_t pings_sent;
+
+    // Set by other threads to make the probe loop handle this check right away
+    _Atomic int wake_requested;
+
+    // Next check in the mailbox of the probe loop while wake_requested is set
+    struct connectivity_check_t* wake_next;
+
+    // When the probe loop continues with this check
+    struct timespec deadline;
+
+    // Start of the current slot of the schedule
+    struct timespec next_check_time;
+
+    // Time the latest ping was sent (CLOCK_REALTIME)
+    struct timespec sent_time;
+
+    // First failed ping of the current period
+    struct timespec period_first_failed;
+
+    // Pending lookup of the hostname (FLAG_IS_HOSTNAME); NULL if none
+    struct gaicb* resolving;
+
+    // Deadline of the lookup of the hostname
+    struct timespec resolve_deadline;
+
     // Timeout in seconds
     float timeout;
 
@@ -48,14 +138,23 @@ typedef struct connectivity_check_t
     // number of times to retry sending a ping
     uint8_t num_pings;
 
+    // Defines at which points in time this target is checked
+    schedule_policy_t schedule;
+
+    // Offset to the start of the period for SCHEDULE_SPREAD
+    struct timespec phase;
+
+    // Maximum random offset in seconds for SCHEDULE_JITTER
+    float jitter;
+
+    // State of the random generator for SCHEDULE_JITTER
+    unsigned int seed;
+
     // Latency of the last ping in seconds; -1.0 if not successful
     float latency;
 
-    // previous downtime. set when up-new is triggered
-    uint32_t previous_downtime;
-
-    // Status of last ping
-    conn_state_t state;
+    // Status of last ping; read by the threads of dependent checks
+    _Atomic conn_state_t state;
 
     // Timestamp of the last successfull ping
     struct timespec timestamp_last_reply;
@@ -67,8 +166,11 @@ typedef struct connectivity_check_t
     // Timestamp of the first failing ping, set when we switch from STATE_UP to STATE_DOWN_NEW
     struct timespec timestamp_first_failed;
 
-    // Last time we sent a ping. This is used to check if tests are stalled
-    struct timespec timestamp_latest_try;
+    // Last time we sent a ping. This is used to check if tests are stalled.
+    // Read by main under a seqlock: use set_latest_try and get_latest_try
+    _Atomic uint32_t latest_try_sequence;
+    _Atomic int64_t latest_try_sec;
+    _Atomic int64_t latest_try_nsec;
 
     // Count of actions if this target is not reachable
     uint8_t actions_count;
@@ -76,50 +178,43 @@ typedef struct connectivity_check_t
     // Actions to perform (dependend on the status)
     action_t *actions;
 
-    // Socket used to ping the target
-    int socket;
+    // Actions which may run in each state; bit i stands for actions[i]
+    uint64_t actions_up;        // run_if up or always
+    uint64_t actions_down;      // run_if down or always
+    uint64_t actions_up_new;
+    uint64_t actions_down_new;
 
-    // On epoll filedescriptor for receiving from socket
-    int epoll_fd;
-
-    // buffer for sending packets
+    // buffer for sending packets. Holds the packet template for this target
+    // where only the sequence number and timestamp are patched for each ping
     char* snd_buffer;
 
-    // buffer for receiving packets
-    char* rcv_buffer;
+    // address family the template in snd_buffer was built for; 0 if not built
+    int template_family;
+
+    // sequence number of the latest ping sent to this target; unique within its probe loop
+    uint16_t sequence;
 
     // loglevel for this target 
     enum loglevel loglevel;
 
-    // Flags for this target
-    uint16_t flags;
-} connectivity_check_t;
-
-/*
- * Type of the arguments passed to each thread running for one
- * connectivity check.
- */
-typedef struct check_arguments_t
-{
-    /* All connectivity checks */
-    connectivity_check_t **connectivity_checks;
-
-    /* Index of the check this thread is responsible for */
-    int idx;
-
-    /* Sum of all checks */
-    int amount_targets;
-
-    /* Logger which should be used by this thread. */
+    // Logger with the prefix CONFIG_NAME-TARGET_IP
     logger_t logger;
-} check_arguments_t;
 
+    // Flags for this target; FLAG_STARTED and FLAG_AWAITING_DEPENDENCY are read by main
+    _Atomic uint16_t flags;
+} connectivity_check_t;
 
 /*
  * Defines if the daemon is still running.
  * Any positive value means we're running and zero means we're stopping.
  */
-extern int running;
+extern _Atomic int running;
+
+/*
+ * eventfd which becomes readable once we're stopping (it is never read).
+ * Every blocking wait also waits for it, so it ends right away.
+ */
+extern int stop_fd;
 
 /*
  * Pointer to the datetime format this application uses.
@@ -127,27 +222,48 @@ extern int running;
 extern const placeholder_t* datetime_ph;
 
 /*
- * Entry point into this service. Loads all configs and starts a thread for each
- * of them.
+ * Time this daemon was started; first_failed is set to it while a check did not fail.
+ */
+extern time_t startup_time;
+
+/*
+ * Entry point into this service. Loads all configs and runs their checks
+ * on the probe loops.
+ */
+int main(int argc, char** argv);
+
+/*
+ * Prepares the given check (and its dependency) to be run by a probe loop.
+ * Returns -1 if there is an error.
  */
-int main();
+int start_check(connectivity_check_t** ccs, const uint32_t n, const uint32_t idx);
 
 /*
- * Tries to start the given check. Returns -1 if there is an error.
+ * Called by the probe loop at the start of each period of check.
+ * Follows the gateway and the route of check, looked up in routes of the loop.
+ * Returns 1 if check is probed now, 0 if it awaits its dependency.
  */
-int start_check(pthread_t* threads, check_arguments_t* args, connectivity_check_t** ccs, const uint16_t n, const uint16_t idx);
+int begin_check(connectivity_check_t* check, struct route_cache_t* routes);
 
 /*
- * Periodically checks this target.
+ * Called by the probe loop with the result of the period of check:
+ * 1 if it was reachable, 0 if not (then first_failed is set if it was UP)
+ * and -1 if the connectivity could not be determined.
+ * Updates the state and queues the actions.
  */
-void run_check(check_arguments_t *);
+void end_check(connectivity_check_t* check, const int connected, const struct timespec first_failed);
 
 /*
- * Returns a pointer to some check with the given IP.
+ * Returns a pointer to the first check with the given IP.
  * NULL is returned if no check is found with the given IP.
  * Also sets idx to the index of the check with the given IP.
  */
-connectivity_check_t* get_dependency(connectivity_check_t **ccs, const uint16_t n, char const *ip, uint16_t* idx);
+connectivity_check_t* get_dependency(connectivity_check_t **ccs, const uint32_t n, char const *ip, uint32_t* idx);
+
+/*
+ * Sorts the addresses of all checks so get_dependency does not need to scan them.
+ */
+void index_addresses(connectivity_check_t **ccs, const uint32_t n);
 
 /*
  * Checks if the given check is available. Returns 1 if it is, else 0.
@@ -161,17 +277,6 @@ int is_available(connectivity_check_t *check, int strict);
  */
 connectivity_check_t **load(char *const directory, int *success, int *count);
 
-/*
- * Checks if we are still able to ping the target.
- * Returns 1 if the target is still reachable, else 0.
- * 
- * If the target is not reachable and it was in state STATE_UP 
- * first_failed will be set.
- * If we cannot determine connectivity a negative value
- * is returned.
- */
-int check_connectivity(const logger_t* logger, connectivity_check_t *target, struct timespec* first_failed);
-
 /* Loads the configuration file at the given path and appends
  * all found connectivity targets to conns.
  * conns_size is a pointer to the current size of the conns array
@@ -181,9 +286,30 @@ int check_connectivity(const logger_t* logger, connectivity_check_t *target, str
 int load_config(const char *cfg_path, connectivity_check_t ***conns, int *conns_size, int *max_conns_size);
 
 /*
- * Handle signals like SIGTERM to stop this program.
+ * Stops this program: sets running to 0 and makes stop_fd readable.
+ * Can be called from any thread.
  */
-void signal_handler(int);
+void stop_running();
+
+/*
+ * Reads all pending signals from signal_fd and handles them: TERM and INT
+ * stop this program, HUP reopens the files of the log actions and USR1
+ * prints the status of all checks.
+ */
+void handle_signals(const int signal_fd, connectivity_check_t** checks, const int n);
+
+/*
+ * Prints an error for each check which was not performed within its period.
+ */
+void check_stalled(connectivity_check_t** checks, const int n);
+
+/*
+ * Prints the state of all checks and the metrics of the actions.
+ */
+void print_status(connectivity_check_t** checks, const int n);
+
+/* Interval in seconds in which main checks if checks are stalled */
+#define STALL_CHECK_INTERVAL 60
 
 #define PACKETSIZE 64
 
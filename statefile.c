@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "statefile.h"
+#include "srd.h"
+#include "printing.h"
+#include "actions.h"
+
+/* mapping of the whole state file */
+static void* mapping = NULL;
+static size_t mapping_size = 0;
+
+/*
+ * Writes the key of check into key.
+ * Targets following the gateway are stored as %gw as their address changes.
+ */
+static void record_key(const connectivity_check_t* check, char* key) {
+    const char* destination = (check->flags & FLAG_IS_GATEWAY) ? "%gw" : check->address;
+
+    memset(key, 0, sizeof(((state_record_t*) 0)->key));
+    snprintf(key, sizeof(((state_record_t*) 0)->key), "%s-%s", check->name, destination);
+}
+
+/*
+ * Restores the state of check from record.
+ */
+static void restore(connectivity_check_t* check, const state_record_t* record) {
+    check->state = record->state;
+
+    check->timestamp_first_failed.tv_sec = record->first_failed_sec;
+    check->timestamp_first_failed.tv_nsec = record->first_failed_nsec;
+    check->timestamp_first_reply.tv_sec = record->first_reply_sec;
+    check->timestamp_first_reply.tv_nsec = record->first_reply_nsec;
+    check->timestamp_last_reply.tv_sec = record->last_reply_sec;
+    check->timestamp_last_reply.tv_nsec = record->last_reply_nsec;
+
+    for (int i = 0; i < check->actions_count; i++) {
+        uint16_t ran = (record->action_flags[i / 32] >> (2 * (i % 32))) & (FLAG_RAN_UP_NEW | FLAG_RAN_DOWN_NEW);
+
+        check->actions[i].flags = (check->actions[i].flags & ~(FLAG_RAN_UP_NEW | FLAG_RAN_DOWN_NEW)) | ran;
+    }
+}
+
+/*
+ * Orders records by their key.
+ */
+static int compare_records(const void* a, const void* b) {
+    const state_record_t* x = a;
+    const state_record_t* y = b;
+
+    return strncmp(x->key, y->key, sizeof(x->key));
+}
+
+/*
+ * Returns the first of the sorted records with key or NULL.
+ */
+static const state_record_t* find_record(const state_record_t* records, const uint32_t count, const char* key) {
+    uint32_t low = 0;
+    uint32_t high = count;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (strncmp(records[mid].key, key, sizeof(records[mid].key)) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < count && strncmp(records[low].key, key, sizeof(records[low].key)) == 0) {
+        return &records[low];
+    }
+
+    return NULL;
+}
+
+int statefile_open(const logger_t* logger, const char* path, connectivity_check_t** checks, const int n) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        print_error(logger, "Unable to open state file %s: %s. The state is not kept across restarts.\n", path, strerror(errno));
+        return 0;
+    }
+
+    // read the previous records
+    state_record_t* previous = NULL;
+    uint32_t previous_count = 0;
+
+    struct stat st;
+    statefile_header_t header;
+
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        memcmp(header.magic, STATEFILE_MAGIC, sizeof(header.magic)) == 0 &&
+        (header.version == STATEFILE_VERSION || header.version == 1) &&
+        header.record_size == sizeof(state_record_t) &&
+        sizeof(header) + (size_t) header.count * sizeof(state_record_t) <= (size_t) st.st_size)
+    {
+        previous_count = header.count;
+        previous = malloc(previous_count * sizeof(state_record_t));
+
+        if (pread(fd, previous, previous_count * sizeof(state_record_t), sizeof(header)) != (ssize_t) (previous_count * sizeof(state_record_t))) {
+            previous_count = 0;
+        }
+
+        // version 1 had the same layout with the flags of only 32 actions
+        for (uint32_t i = 0; header.version == 1 && i < previous_count; i++) {
+            memset(&previous[i].action_flags[1], 0, sizeof(previous[i].action_flags) - sizeof(uint64_t));
+        }
+    } else if (st.st_size > 0) {
+        print_error(logger, "State file %s is invalid. Starting with an empty state.\n", path);
+    }
+
+    // the file contains exactly the records of the current checks
+    mapping_size = sizeof(statefile_header_t) + n * sizeof(state_record_t);
+
+    if (ftruncate(fd, mapping_size) < 0) {
+        print_error(logger, "Unable to resize state file %s: %s\n", path, strerror(errno));
+        free(previous);
+        close(fd);
+        return 0;
+    }
+
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        print_error(logger, "Unable to map state file %s: %s\n", path, strerror(errno));
+        mapping = NULL;
+        free(previous);
+        return 0;
+    }
+
+    statefile_header_t* new_header = (statefile_header_t*) mapping;
+    state_record_t* records = (state_record_t*) ((char*) mapping + sizeof(statefile_header_t));
+    int restored = 0;
+
+    // look up the records by key; there may be many targets
+    qsort(previous, previous_count, sizeof(state_record_t), compare_records);
+
+    for (int i = 0; i < n; i++) {
+        connectivity_check_t* check = checks[i];
+        state_record_t* record = &records[i];
+        memset(record, 0, sizeof(state_record_t));
+
+        record_key(check, record->key);
+
+        const state_record_t* found = find_record(previous, previous_count, record->key);
+        if (found != NULL) {
+            restore(check, found);
+            restored++;
+        }
+        check->record = record;
+        statefile_update(check);
+    }
+    free(previous);
+
+    memcpy(new_header->magic, STATEFILE_MAGIC, sizeof(new_header->magic));
+    new_header->version = STATEFILE_VERSION;
+    new_header->record_size = sizeof(state_record_t);
+    new_header->count = n;
+    new_header->reserved = 0;
+
+    print_info(logger, "Restored the state of %d out of %d targets from %s\n", restored, n, path);
+
+    return 1;
+}
+
+void statefile_update(connectivity_check_t* check) {
+    state_record_t* record = check->record;
+
+    if (record == NULL) {
+        return;
+    }
+
+    record->state = check->state;
+
+    record->first_failed_sec = check->timestamp_first_failed.tv_sec;
+    record->first_failed_nsec = check->timestamp_first_failed.tv_nsec;
+    record->first_reply_sec = check->timestamp_first_reply.tv_sec;
+    record->first_reply_nsec = check->timestamp_first_reply.tv_nsec;
+    record->last_reply_sec = check->timestamp_last_reply.tv_sec;
+    record->last_reply_nsec = check->timestamp_last_reply.tv_nsec;
+
+    uint64_t action_flags[STATEFILE_MAX_ACTIONS / 32] = { 0 };
+    for (int i = 0; i < check->actions_count; i++) {
+        action_flags[i / 32] |= (uint64_t) (check->actions[i].flags & (FLAG_RAN_UP_NEW | FLAG_RAN_DOWN_NEW)) << (2 * (i % 32));
+    }
+    memcpy(record->action_flags, action_flags, sizeof(action_flags));
+}
+
+void statefile_close() {
+    if (mapping == NULL) {
+        return;
+    }
+
+    msync(mapping, mapping_size, MS_SYNC);
+    munmap(mapping, mapping_size);
+
+    mapping = NULL;
+    mapping_size = 0;
+}
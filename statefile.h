@@ -0,0 +1,87 @@
+#ifndef SRD_STATEFILE_H
+#define SRD_STATEFILE_H
+
+#include <stdint.h>
+
+#include "srd.h"
+#include "printing.h"
+
+#define STATEFILE_MAGIC "SRDSTATE"
+#define STATEFILE_VERSION 2
+
+/* Maximum amount of actions per target whose flags are stored */
+#define STATEFILE_MAX_ACTIONS 64
+
+_Static_assert(STATEFILE_MAX_ACTIONS >= MAX_ACTIONS, "the state file must keep the flags of all actions");
+
+/*
+ * Header at the start of the state file.
+ */
+typedef struct statefile_header_t
+{
+    // STATEFILE_MAGIC without null delimiter
+    char magic[8];
+
+    // STATEFILE_VERSION
+    uint32_t version;
+
+    // sizeof(state_record_t)
+    uint32_t record_size;
+
+    // amount of records following the header
+    uint32_t count;
+
+    uint32_t reserved;
+} statefile_header_t;
+
+/*
+ * The state of one target as it is stored in the state file.
+ * Has a fixed size of 256 bytes.
+ */
+typedef struct state_record_t
+{
+    // name of the config and the destination: CONFIG_NAME-DESTINATION
+    char key[160];
+
+    // conn_state_t of the target
+    uint32_t state;
+
+    // unused; the downtime follows from the timestamps
+    uint32_t unused;
+
+    int64_t first_failed_sec;
+    int64_t first_failed_nsec;
+
+    int64_t first_reply_sec;
+    int64_t first_reply_nsec;
+
+    int64_t last_reply_sec;
+    int64_t last_reply_nsec;
+
+    // two bits per action: FLAG_RAN_UP_NEW and FLAG_RAN_DOWN_NEW; 32 actions per word
+    // (version 1 had only the first word, the second was reserved and zero)
+    uint64_t action_flags[STATEFILE_MAX_ACTIONS / 32];
+
+    char reserved[24];
+} state_record_t;
+
+_Static_assert(sizeof(state_record_t) == 256, "state_record_t must have 256 bytes");
+
+/*
+ * Maps the state file at path and restores the state of all checks found in it.
+ * The file is rewritten to contain exactly the records of checks.
+ * Returns 1 on success, else 0 (then the state is not persisted).
+ */
+int statefile_open(const logger_t* logger, const char* path, connectivity_check_t** checks, const int n);
+
+/*
+ * Writes the state of check into its record. Does nothing if there is no state file.
+ */
+void statefile_update(connectivity_check_t* check);
+
+/*
+ * Syncs and unmaps the state file.
+ */
+void statefile_close();
+
+#endif
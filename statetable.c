@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "statetable.h"
+#include "srd.h"
+#include "printing.h"
+#include "util.h"
+
+/* mapping of the whole state table */
+static void* mapping = NULL;
+static size_t mapping_size = 0;
+
+/* name of the shared memory object */
+static char* table_name = NULL;
+
+/*
+ * Returns 1 if the existing state table called name is left over from an srd
+ * which is not running anymore, else 0 (then it belongs to a running srd).
+ */
+static int is_stale(const logger_t* logger, const char* name) {
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        // removed meanwhile
+        return errno == ENOENT;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(statetable_header_t)) {
+        // not even a header: the srd creating it did not get far
+        close(fd);
+        return 1;
+    }
+
+    statetable_header_t* header = mmap(NULL, sizeof(statetable_header_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (header == MAP_FAILED) {
+        print_error(logger, "Unable to map shared memory %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+
+    pid_t pid = atomic_load_explicit(&header->pid, memory_order_acquire);
+    munmap(header, sizeof(statetable_header_t));
+
+    // EPERM: the process exists but belongs to another user
+    if (pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH)) {
+        print_error(logger, "Shared memory %s is used by srd with pid %d. The state is not published.\n", name, pid);
+        return 0;
+    }
+
+    return 1;
+}
+
+int statetable_open(const logger_t* logger, const char* name, connectivity_check_t** checks, const int n) {
+    // readers map the table read-only
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (fd < 0 && errno == EEXIST) {
+        if (!is_stale(logger, name)) {
+            return 0;
+        }
+
+        // readers still mapping the old table keep their copy
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+
+    if (fd < 0) {
+        print_error(logger, "Unable to create shared memory %s: %s. The state is not published.\n", name, strerror(errno));
+        return 0;
+    }
+
+    mapping_size = sizeof(statetable_header_t) + n * sizeof(statetable_record_t);
+
+    if (ftruncate(fd, mapping_size) < 0) {
+        print_error(logger, "Unable to resize shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        print_error(logger, "Unable to map shared memory %s: %s\n", name, strerror(errno));
+        mapping = NULL;
+        shm_unlink(name);
+        return 0;
+    }
+
+    statetable_header_t* header = (statetable_header_t*) mapping;
+    statetable_record_t* records = (statetable_record_t*) ((char*) mapping + sizeof(statetable_header_t));
+
+    for (int i = 0; i < n; i++) {
+        connectivity_check_t* check = checks[i];
+        statetable_record_t* record = &records[i];
+
+        snprintf(record->name, sizeof(record->name), "%s", check->name);
+        check->table_record = record;
+        statetable_update(check);
+    }
+
+    memcpy(header->magic, STATETABLE_MAGIC, sizeof(header->magic));
+    header->version = STATETABLE_VERSION;
+    header->record_size = sizeof(statetable_record_t);
+    header->count = n;
+    header->started = time(NULL);
+
+    table_name = strdup(name);
+
+    // the table is complete once pid is set
+    atomic_store_explicit(&header->pid, getpid(), memory_order_release);
+
+    return 1;
+}
+
+void statetable_update(connectivity_check_t* check) {
+    statetable_record_t* record = check->table_record;
+
+    if (record == NULL) {
+        return;
+    }
+
+    // odd sequence: readers retry until we're done
+    uint32_t sequence = atomic_load_explicit(&record->sequence, memory_order_relaxed);
+    atomic_store_explicit(&record->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    record->state = check->state;
+    record->latency = check->latency >= 0 ? check->latency * 1e3 : -1.0;
+
+    record->last_reply_sec = check->timestamp_last_reply.tv_sec;
+    record->last_reply_nsec = check->timestamp_last_reply.tv_nsec;
+    struct timespec latest_try = get_latest_try(check);
+    record->latest_try_sec = latest_try.tv_sec;
+    record->latest_try_nsec = latest_try.tv_nsec;
+
+    // the address of the gateway may change
+    snprintf(record->address, sizeof(record->address), "%s", check->address);
+
+    atomic_store_explicit(&record->sequence, sequence + 2, memory_order_release);
+}
+
+void statetable_close() {
+    if (mapping == NULL) {
+        return;
+    }
+
+    statetable_header_t* header = (statetable_header_t*) mapping;
+    atomic_store_explicit(&header->pid, 0, memory_order_release);
+
+    munmap(mapping, mapping_size);
+    shm_unlink(table_name);
+    free(table_name);
+    table_name = NULL;
+
+    mapping = NULL;
+    mapping_size = 0;
+}
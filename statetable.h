@@ -0,0 +1,113 @@
+#ifndef SRD_STATETABLE_H
+#define SRD_STATETABLE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "srd.h"
+#include "printing.h"
+
+/* default name of the shared memory object, i.e. /dev/shm/srd */
+#define STATETABLE_NAME "/srd"
+
+#define STATETABLE_MAGIC "SRDTABLE"
+#define STATETABLE_VERSION 2
+
+/*
+ * Header at the start of the state table.
+ */
+typedef struct statetable_header_t
+{
+    // STATETABLE_MAGIC without null delimiter
+    char magic[8];
+
+    // STATETABLE_VERSION; readers must check it before reading records
+    uint32_t version;
+
+    // sizeof(statetable_record_t)
+    uint32_t record_size;
+
+    // amount of records following the header
+    uint32_t count;
+
+    // pid of srd; 0 after srd stopped
+    _Atomic uint32_t pid;
+
+    // unix timestamp of the start of srd
+    int64_t started;
+} statetable_header_t;
+
+/*
+ * The state of one target as it is published in the state table.
+ *
+ * Written by the thread of the target under a seqlock: sequence is odd while
+ * the record is written. Readers copy the record with statetable_read.
+ */
+typedef struct statetable_record_t
+{
+    // even if the record is consistent
+    _Atomic uint32_t sequence;
+
+    // conn_state_t of the target
+    uint32_t state;
+
+    // latency of the latest ping in ms; -1.0 if it failed
+    float latency;
+
+    uint32_t reserved;
+
+    int64_t last_reply_sec;
+    int64_t last_reply_nsec;
+
+    int64_t latest_try_sec;
+    int64_t latest_try_nsec;
+
+    // name of the config of the target
+    char name[64];
+
+    // target IP address or hostname
+    char address[256];
+} statetable_record_t;
+
+_Static_assert(sizeof(statetable_record_t) == 368, "statetable_record_t must have 368 bytes");
+
+/*
+ * Creates the state table called name (f.ex. /srd for /dev/shm/srd) with one record for each check.
+ * An existing table is only replaced if the srd which created it is not running anymore.
+ * Returns 1 on success, else 0 (then the state is not published).
+ */
+int statetable_open(const logger_t* logger, const char* name, connectivity_check_t** checks, const int n);
+
+/*
+ * Publishes the state of check in its record. Does nothing if there is no state table.
+ */
+void statetable_update(connectivity_check_t* check);
+
+/*
+ * Marks the state table as stopped, unmaps and removes it.
+ */
+void statetable_close();
+
+/*
+ * Copies a consistent snapshot of record into dest. Used by readers of the
+ * state table; it retries while srd writes the record.
+ */
+static inline void statetable_read(const statetable_record_t* record, statetable_record_t* dest) {
+    uint32_t before, after;
+
+    do {
+        while ((before = atomic_load_explicit(&record->sequence, memory_order_acquire)) & 1) {
+            // the record is being written
+        }
+
+        memcpy((char*) dest + sizeof(dest->sequence), (const char*) record + sizeof(record->sequence), sizeof(*record) - sizeof(record->sequence));
+
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&record->sequence, memory_order_relaxed);
+    } while (before != after);
+
+    dest->sequence = before;
+}
+
+#endif
@@ -0,0 +1,319 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#ifndef SRD_NO_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+#include "printing.h"
+#include "tls.h"
+#include "util.h"
+
+#ifndef SRD_NO_TLS
+
+struct tls_t {
+    SSL* ssl;
+    char error[256];
+};
+
+struct tls_session_t {
+    // oldest first; TLS 1.3 tickets are not resumable anymore once used
+    SSL_SESSION* sessions[TLS_SESSIONS];
+    int count;
+};
+
+static SSL_CTX* ctx = NULL;
+
+/*
+ * Keeps the session the server sent (with TLS 1.3 after the handshake, as
+ * tickets) in the tls_session_t of the connection, replacing the oldest.
+ */
+static int new_session(SSL* ssl, SSL_SESSION* session) {
+    tls_session_t* slot = SSL_get_app_data(ssl);
+    if (slot == NULL || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+
+    if (slot->count == TLS_SESSIONS) {
+        SSL_SESSION_free(slot->sessions[0]);
+        memmove(slot->sessions, slot->sessions + 1, (TLS_SESSIONS - 1) * sizeof(SSL_SESSION*));
+        slot->count--;
+    }
+    slot->sessions[slot->count++] = session;
+
+    return 1; // we keep the reference
+}
+
+/*
+ * Stores the reason of the failed call which returned ret in tls->error.
+ */
+static void set_error(tls_t* tls, int ret) {
+    int error = SSL_get_error(tls->ssl, ret);
+
+    long verified = SSL_get_verify_result(tls->ssl);
+    if (verified != X509_V_OK) {
+        snprintf(tls->error, sizeof(tls->error), "Certificate verification failed: %s",
+            X509_verify_cert_error_string(verified));
+    } else if (error == SSL_ERROR_SYSCALL) {
+        snprintf(tls->error, sizeof(tls->error), "%s", errno != 0 ? strerror(errno) : "Connection closed");
+    } else {
+        unsigned long code = ERR_peek_last_error();
+        if (code != 0) {
+            ERR_error_string_n(code, tls->error, sizeof(tls->error));
+        } else {
+            snprintf(tls->error, sizeof(tls->error), "TLS error %d", error);
+        }
+    }
+    ERR_clear_error();
+}
+
+int tls_init(const logger_t* logger, const char* ca_file) {
+    ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        sprint_error(logger, "Unable to initialize TLS: %s\n", ERR_reason_error_string(ERR_get_error()));
+        return 0;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+    // the buffer of a request may be sent in several parts
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // servers closing idle connections often skip the close notification
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    // the sessions are kept per endpoint, see new_session
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, new_session);
+
+    int loaded = ca_file != NULL ? SSL_CTX_load_verify_locations(ctx, ca_file, NULL)
+                                 : SSL_CTX_set_default_verify_paths(ctx);
+    if (!loaded) {
+        sprint_error(logger, "Unable to load the CA certificates%s%s: %s\n", ca_file != NULL ? " from " : "",
+            ca_file != NULL ? ca_file : "", ERR_reason_error_string(ERR_get_error()));
+        ERR_clear_error();
+        SSL_CTX_free(ctx);
+        ctx = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+tls_session_t* tls_session() {
+    return calloc(1, sizeof(tls_session_t));
+}
+
+tls_t* tls_connect(const logger_t* logger, int fd, const char* host, tls_session_t* session) {
+    SSL* ssl = SSL_new(ctx);
+    if (ssl == NULL) {
+        sprint_error(logger, "[HTTP]: Unable to create a TLS connection: %s\n", ERR_reason_error_string(ERR_get_error()));
+        ERR_clear_error();
+        return NULL;
+    }
+
+    struct sockaddr_storage address;
+    int ok = SSL_set_fd(ssl, fd);
+    if (to_sockaddr(host, &address)) {
+        ok = ok && X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host);
+    } else {
+        // server name indication is only sent for hostnames
+        ok = ok && SSL_set_tlsext_host_name(ssl, host) && SSL_set1_host(ssl, host);
+    }
+
+    if (!ok) {
+        sprint_error(logger, "[HTTP]: Unable to set up TLS for %s: %s\n", host, ERR_reason_error_string(ERR_get_error()));
+        ERR_clear_error();
+        SSL_free(ssl);
+        return NULL;
+    }
+
+    // resume the newest session which was not used up by another connection
+    while (session->count > 0) {
+        SSL_SESSION* latest = session->sessions[session->count - 1];
+        if (SSL_SESSION_is_resumable(latest)) {
+            SSL_set_session(ssl, latest);
+            break;
+        }
+        SSL_SESSION_free(latest);
+        session->count--;
+    }
+    SSL_set_app_data(ssl, session);
+    SSL_set_connect_state(ssl);
+
+    tls_t* tls = calloc(1, sizeof(tls_t));
+    tls->ssl = ssl;
+
+    return tls;
+}
+
+int tls_handshake(tls_t* tls, uint32_t* events) {
+    ERR_clear_error();
+    errno = 0;
+
+    int ret = SSL_do_handshake(tls->ssl);
+    if (ret == 1) {
+        return 1;
+    }
+
+    switch (SSL_get_error(tls->ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            *events = EPOLLIN;
+            return 0;
+        case SSL_ERROR_WANT_WRITE:
+            *events = EPOLLOUT;
+            return 0;
+        default:
+            set_error(tls, ret);
+            return -1;
+    }
+}
+
+int tls_resumed(const tls_t* tls) {
+    return SSL_session_reused(tls->ssl);
+}
+
+/*
+ * Maps the result of SSL_write or SSL_read to the one of send or recv.
+ */
+static ssize_t result(tls_t* tls, int ret) {
+    if (ret > 0) {
+        return ret;
+    }
+
+    switch (SSL_get_error(tls->ssl, ret)) {
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_SYSCALL:
+            if (errno != 0) {
+                // keep errno, f.ex. ECONNRESET
+                set_error(tls, ret);
+                return -1;
+            }
+            return 0;
+        default:
+            set_error(tls, ret);
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+ssize_t tls_send(tls_t* tls, const char* data, size_t length) {
+    ERR_clear_error();
+    errno = 0;
+
+    return result(tls, SSL_write(tls->ssl, data, length));
+}
+
+ssize_t tls_recv(tls_t* tls, char* buffer, size_t length) {
+    ERR_clear_error();
+    errno = 0;
+
+    return result(tls, SSL_read(tls->ssl, buffer, length));
+}
+
+const char* tls_error(const tls_t* tls) {
+    return tls->error;
+}
+
+void tls_close(tls_t* tls) {
+    if (SSL_is_init_finished(tls->ssl)) {
+        SSL_shutdown(tls->ssl);
+    }
+    ERR_clear_error();
+
+    SSL_free(tls->ssl);
+    free(tls);
+}
+
+void tls_session_free(tls_session_t* session) {
+    for (int i = 0; i < session->count; i++) {
+        SSL_SESSION_free(session->sessions[i]);
+    }
+    free(session);
+}
+
+void tls_cleanup() {
+    if (ctx != NULL) {
+        SSL_CTX_free(ctx);
+        ctx = NULL;
+    }
+}
+
+#else
+
+// built without TLS: no connection is ever started
+
+int tls_init(const logger_t* logger, const char* ca_file) {
+    (void) ca_file;
+    sprint_error(logger, "srd was built without TLS support\n");
+    return 0;
+}
+
+tls_session_t* tls_session() {
+    return NULL;
+}
+
+tls_t* tls_connect(const logger_t* logger, int fd, const char* host, tls_session_t* session) {
+    (void) logger;
+    (void) fd;
+    (void) host;
+    (void) session;
+    return NULL;
+}
+
+int tls_handshake(tls_t* tls, uint32_t* events) {
+    (void) tls;
+    (void) events;
+    return -1;
+}
+
+int tls_resumed(const tls_t* tls) {
+    (void) tls;
+    return 0;
+}
+
+ssize_t tls_send(tls_t* tls, const char* data, size_t length) {
+    (void) tls;
+    (void) data;
+    (void) length;
+    errno = EPROTO;
+    return -1;
+}
+
+ssize_t tls_recv(tls_t* tls, char* buffer, size_t length) {
+    (void) tls;
+    (void) buffer;
+    (void) length;
+    errno = EPROTO;
+    return -1;
+}
+
+const char* tls_error(const tls_t* tls) {
+    (void) tls;
+    return "TLS is not supported";
+}
+
+void tls_close(tls_t* tls) {
+    (void) tls;
+}
+
+void tls_session_free(tls_session_t* session) {
+    (void) session;
+}
+
+void tls_cleanup() {
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SRD_TLS_H
+#define SRD_TLS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "printing.h"
+
+/*
+ * TLS of the HTTP client, implemented with OpenSSL. srd is built without it
+ * if SRD_NO_TLS is defined (make TLS=none); tls_init fails then.
+ * All functions are only called by the thread of the HTTP client.
+ */
+
+/* Sessions kept per server; a TLS 1.3 ticket resumes only one connection */
+#define TLS_SESSIONS 4
+
+typedef struct tls_t tls_t;
+
+/* Sessions of the latest handshakes with a server, used to resume the next ones */
+typedef struct tls_session_t tls_session_t;
+
+/*
+ * Prepares TLS for connections verifying the certificates of the servers with
+ * the CAs in ca_file (PEM) or with the CAs of the system if it is NULL.
+ * Returns 1 on success, else 0.
+ */
+int tls_init(const logger_t* logger, const char* ca_file);
+
+/*
+ * Returns new, empty sessions.
+ */
+tls_session_t* tls_session();
+
+/*
+ * Starts TLS on the connected non-blocking socket fd to host, whose
+ * certificate must be valid for it. The handshake resumes the newest unused
+ * session in session; the new sessions received from the server are stored in it.
+ * Returns NULL on errors.
+ */
+tls_t* tls_connect(const logger_t* logger, int fd, const char* host, tls_session_t* session);
+
+/*
+ * Continues the handshake. Returns 1 once it is done, 0 if it waits for the
+ * socket to become ready for events (EPOLLIN or EPOLLOUT) and -1 if it failed
+ * (see tls_error).
+ */
+int tls_handshake(tls_t* tls, uint32_t* events);
+
+/*
+ * Returns 1 if the handshake resumed the session, else 0.
+ */
+int tls_resumed(const tls_t* tls);
+
+/*
+ * Like send and recv on a non-blocking socket: -1 with errno EAGAIN if the
+ * socket is not ready, recv returns 0 once the server closed the connection.
+ * On TLS errors errno is EPROTO (see tls_error).
+ */
+ssize_t tls_send(tls_t* tls, const char* data, size_t length);
+ssize_t tls_recv(tls_t* tls, char* buffer, size_t length);
+
+/*
+ * Returns the reason of the latest error of tls.
+ */
+const char* tls_error(const tls_t* tls);
+
+/*
+ * Sends the close notification if possible (without waiting) and frees tls.
+ * The socket is not closed.
+ */
+void tls_close(tls_t* tls);
+
+void tls_session_free(tls_session_t* session);
+
+/*
+ * Frees what tls_init prepared.
+ */
+void tls_cleanup();
+
+#endif
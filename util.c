@@ -4,15 +4,17 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <time.h>
+#include <limits.h>
 #include <math.h>
-#include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/ip_icmp.h>
 #include <netinet/icmp6.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
 #include "util.h"
@@ -32,8 +34,6 @@ struct packet6
     char msg[PACKETSIZE-sizeof(struct icmp6_hdr)];
 };
 
-_Atomic(unsigned int) icmp_msgs_count = 1; // sequence number
-
 int needs_escaping(char c)
 {
     if (!(c >= 48 && c <= 57) &&
@@ -99,6 +99,53 @@ char *escape_servicename(const char *input_name)
     return escaped_str;
 }
 
+size_t json_escape(const char* string, char* buffer, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t length = 0;
+    size_t written = 0;
+
+    for (const unsigned char* c = (const unsigned char*) string; *c != '\0'; c++) {
+        char escaped[6];
+        size_t n = 2;
+        escaped[0] = '\\';
+
+        switch (*c) {
+            case '"':  escaped[1] = '"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            default:
+                if (*c < 0x20) {
+                    // other control characters as \u00XX
+                    memcpy(escaped + 1, "u00", 3);
+                    escaped[4] = hex[*c >> 4];
+                    escaped[5] = hex[*c & 0xf];
+                    n = 6;
+                } else {
+                    // everything else, also UTF-8, is kept
+                    escaped[0] = *c;
+                    n = 1;
+                }
+        }
+
+        if (written == length && length + n < size) {
+            memcpy(buffer + length, escaped, n);
+            written += n;
+        }
+        length += n;
+    }
+
+    if (size > 0) {
+        buffer[written] = '\0';
+    }
+
+    return length;
+}
+
 int ends_with(const char *str, const char *end)
 {
     if (!str || !end)
@@ -155,52 +202,6 @@ char *str_replace(const char *string, const char *substr, const char *replacemen
     return newstr;
 }
 
-char *get_default_gw()
-{
-    long dest;
-    long gw;
-    char iface[IF_NAMESIZE];
-    char buffer[1024];
-    FILE *file;
-
-    file = fopen("/proc/net/route", "r");
-    if (!file)
-    {
-        printf("Unable to access /proc/net/route to get the default gateway\n");
-        return 0;
-    }
-
-    while (fgets(buffer, sizeof(buffer), file))
-    {
-        if (sscanf(buffer, "%s %lx %lx", iface, &dest, &gw) == 3)
-        {
-            if (dest == 0)
-            {
-                int size = INET_ADDRSTRLEN * sizeof(char);
-                char *str = malloc(size);
-
-                if (inet_ntop(AF_INET, &gw, str, INET_ADDRSTRLEN))
-                {
-                    fclose(file);
-                    return str;
-                }
-
-                printf("Unable to get the IP of the gateway: %s\n", strerror(errno));
-
-                fclose(file);
-                return NULL;
-            }
-        }
-    }
-    if (file)
-    {
-        fclose(file);
-    }
-
-    printf("Did not find the default route\n");
-    return NULL;
-}
-
 void format_time(const placeholder_t* format, char* str_time, const size_t len, const struct timespec* time) {
     struct tm tm;
     
@@ -290,11 +291,32 @@ replacement_info_t get_replacements(const char* message) {
     if (strstr(message, "%timestamp")) {
         info |= FLAG_CONTAINS_TIMESTAMP;
     }
+    if (strstr(message, "%ip")) {
+        info |= FLAG_CONTAINS_IP;
+    }
 
     return info;
 }
 
 
+/*
+ * Like str_replace, but escapes replacement for JSON if info has FLAG_ESCAPE_JSON.
+ */
+static char* replace_value(const char* message, const char* substr, const char* replacement, const replacement_info_t info) {
+    if ((info & FLAG_ESCAPE_JSON) == 0) {
+        return str_replace(message, substr, replacement);
+    }
+
+    size_t size = json_escape(replacement, NULL, 0) + 1;
+    char* escaped = malloc(size);
+    json_escape(replacement, escaped, size);
+
+    char* result = str_replace(message, substr, escaped);
+    free(escaped);
+
+    return result;
+}
+
 char* insert_placeholders(const placeholder_t* placeholder, 
                         const connectivity_check_t* check,
                         const double downtime,
@@ -305,12 +327,19 @@ char* insert_placeholders(const placeholder_t* placeholder,
 
     char temp_str[48];
 
+    // replace %ip; only left for targets following the gateway
+    if (info & FLAG_CONTAINS_IP) {
+        const char* old = message;
+        message = replace_value(message, "%ip", check->address, info);
+        free((void*)old);
+    }
+
     // replace %uptime
     if (info & FLAG_CONTAINS_UPTIME) {
         seconds_to_string((int)uptime, temp_str);
 
         const char* old = message;
-        message = str_replace(message, "%uptime", temp_str);
+        message = replace_value(message, "%uptime", temp_str, info);
         free((void*)old);
     }
 
@@ -319,7 +348,7 @@ char* insert_placeholders(const placeholder_t* placeholder,
         format_time(datetime_ph, temp_str, 48, &check->timestamp_first_failed);
 
         const char* old = message;
-        message = str_replace(message, "%sdt", temp_str);
+        message = replace_value(message, "%sdt", temp_str, info);
         free((void*)old);
     }
 
@@ -328,7 +357,7 @@ char* insert_placeholders(const placeholder_t* placeholder,
         format_time(datetime_ph, temp_str, 48, &check->timestamp_first_reply);
 
         const char* old = message;
-        message = str_replace(message, "%sut", temp_str);
+        message = replace_value(message, "%sut", temp_str, info);
         free((void*)old);
     }
 
@@ -337,7 +366,7 @@ char* insert_placeholders(const placeholder_t* placeholder,
         seconds_to_string((int)downtime, temp_str);
         
         const char* old = message;
-        message = str_replace(message, "%downtime", temp_str);
+        message = replace_value(message, "%downtime", temp_str, info);
 
         free((void*)old);
     }
@@ -356,13 +385,13 @@ char* insert_placeholders(const placeholder_t* placeholder,
             const char* old = message;
 
             snprintf(latency_str, length, "%1.2lf", check->latency * 1e3);
-            message = str_replace(message, "%lat_ms", latency_str);
+            message = replace_value(message, "%lat_ms", latency_str, info);
 
             free(latency_str);
             free((char *)old);
         } else {
             const char* old = message;
-            message = str_replace(message, "%lat_ms", "-1.0");
+            message = replace_value(message, "%lat_ms", "-1.0", info);
             free((char *)old);
         }
     }
@@ -371,9 +400,9 @@ char* insert_placeholders(const placeholder_t* placeholder,
     if (info & FLAG_CONTAINS_STATUS) {
         const char* old = message;
         if (connected) {
-            message = str_replace(message, "%status", "success");
+            message = replace_value(message, "%status", "success", info);
         } else {
-            message = str_replace(message, "%status", "failed");
+            message = replace_value(message, "%status", "failed", info);
         }
         free((char *) old);
     }
@@ -386,7 +415,7 @@ char* insert_placeholders(const placeholder_t* placeholder,
         clock_gettime(CLOCK, &now);
 
         format_time(datetime_ph, temp_str, 48, &now);
-        message = str_replace(message, "%now", temp_str);
+        message = replace_value(message, "%now", temp_str, info);
 
         free((char *) old);
     }
@@ -399,7 +428,7 @@ char* insert_placeholders(const placeholder_t* placeholder,
         char str_ts[16];
         sprintf(str_ts, "%ld", timestamp);
         
-        message = str_replace(message, "%timestamp", str_ts);
+        message = replace_value(message, "%timestamp", str_ts, info);
 
         free((void*)old);
     }
@@ -429,6 +458,35 @@ struct timespec timespec_add(const struct timespec t1, const struct timespec t2)
     return result;
 }
 
+void set_latest_try(connectivity_check_t* check, const struct timespec time) {
+    // odd sequence: readers retry until we're done
+    uint32_t sequence = atomic_load_explicit(&check->latest_try_sequence, memory_order_relaxed);
+    atomic_store_explicit(&check->latest_try_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&check->latest_try_sec, time.tv_sec, memory_order_relaxed);
+    atomic_store_explicit(&check->latest_try_nsec, time.tv_nsec, memory_order_relaxed);
+
+    atomic_store_explicit(&check->latest_try_sequence, sequence + 2, memory_order_release);
+}
+
+struct timespec get_latest_try(const connectivity_check_t* check) {
+    struct timespec time;
+    uint32_t before, after;
+
+    do {
+        before = atomic_load_explicit(&check->latest_try_sequence, memory_order_acquire);
+
+        time.tv_sec = atomic_load_explicit(&check->latest_try_sec, memory_order_relaxed);
+        time.tv_nsec = atomic_load_explicit(&check->latest_try_nsec, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&check->latest_try_sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    return time;
+}
+
 int to_sockaddr(const char* address, struct sockaddr_storage* socket_addr) {
     struct sockaddr_in* ipv4_addr = (struct sockaddr_in*) socket_addr;
     int success = inet_pton(AF_INET, address, &ipv4_addr->sin_addr);
@@ -447,85 +505,127 @@ int to_sockaddr(const char* address, struct sockaddr_storage* socket_addr) {
     return success;
 }
 
-int resolve_hostname(const logger_t* logger, const char *hostname, struct sockaddr_storage *socket_addr, float timeout_s)
-{
-    float nsec = timeout_s - (float)((int) timeout_s);
-    const struct timespec timeout = { .tv_nsec = (int)(nsec * 1e9), .tv_sec = (int) timeout_s };
-    int rv;
-
-    struct gaicb *reqs;
-
-    reqs = calloc(1, sizeof(struct gaicb));
-    reqs->ar_name = hostname;
+void set_port(struct sockaddr_storage* sockaddr, int port) {
+    if (sockaddr->ss_family == AF_INET) {
+        ((struct sockaddr_in*) sockaddr)->sin_port = htons(port);
+    } else {
+        ((struct sockaddr_in6*) sockaddr)->sin6_port = htons(port);
+    }
+}
 
-	rv = getaddrinfo_a(GAI_NOWAIT, &reqs, 1, NULL);
-	if (rv != 0) {
-		sprint_error(logger, "Unable to to get address for %s: %s", hostname, gai_strerror(rv));
+struct gaicb* resolve_start(const logger_t* logger, const char* hostname) {
+    struct gaicb* request = calloc(1, sizeof(struct gaicb));
+    request->ar_name = hostname;
 
-        if (reqs->ar_request) {
-            freeaddrinfo((struct addrinfo*) reqs->ar_request);
-        }
-        if (reqs->ar_result) {
-            freeaddrinfo(reqs->ar_result);
-        }
-        free(reqs);
+    int rv = getaddrinfo_a(GAI_NOWAIT, &request, 1, NULL);
+    if (rv != 0) {
+        sprint_error(logger, "Unable to to get address for %s: %s\n", hostname, gai_strerror(rv));
+        free(request);
 
-		return 0;
-	}
+        return NULL;
+    }
 
-	rv = gai_suspend((const struct gaicb * const*)&reqs, 1, &timeout);
+    return request;
+}
 
-    if (rv == 0 || rv == EAI_ALLDONE || rv == EAI_INTR) {
-        struct addrinfo* ainfo = reqs->ar_result;
+int resolve_result(const logger_t* logger, struct gaicb* request, struct sockaddr_storage* socket_addr) {
+    int rv = gai_error(request);
 
-        if ((rv = gai_error(reqs)) != 0) {
-            sprint_error(logger, "Unable to resolve hostname %s: %s\n", hostname, gai_strerror(rv))
+    if (rv == EAI_INPROGRESS) {
+        return -1;
+    }
 
-            freeaddrinfo((struct addrinfo *) reqs->ar_request);
-            free(reqs);
+    int success = 0;
 
-            return 0;
-        }
+    if (rv != 0) {
+        sprint_error(logger, "Unable to resolve hostname %s: %s\n", request->ar_name, gai_strerror(rv));
+    } else {
+        const struct addrinfo* ainfo = request->ar_result;
 
         // write resolved address to socket_addr
         if (ainfo->ai_family == AF_INET) {
-            memcpy(socket_addr, reqs->ar_result->ai_addr, sizeof(struct sockaddr_in));
+            memcpy(socket_addr, ainfo->ai_addr, sizeof(struct sockaddr_in));
         } else {
-            memcpy(socket_addr, reqs->ar_result->ai_addr, sizeof(struct sockaddr_in6));
+            memcpy(socket_addr, ainfo->ai_addr, sizeof(struct sockaddr_in6));
         }
-
         socket_addr->ss_family = ainfo->ai_family;
 
-        if (gai_cancel(reqs) == EAI_NOTCANCELED) {
-            sprint_info(logger, "Leaking memory\n");
+        success = 1;
+    }
 
-            return 1;
-    	}
+    if (request->ar_result) {
+        freeaddrinfo(request->ar_result);
+    }
+    free(request);
 
-        if ((struct addrinfo *) reqs->ar_request) {
-            free((struct addrinfo *) reqs->ar_request);
-        }
-        if (reqs->ar_result) {
-            freeaddrinfo(reqs->ar_result);
-        }
-        free(reqs);
+    return success;
+}
 
-        return 1;
-    } else if (rv == EAI_AGAIN) {
-        sprint_error(logger, "Timeout when resolving %s\n", hostname);
+void resolve_cancel(struct gaicb* request) {
+    // glibc still uses the request if it cannot be canceled; then it is leaked
+    if (gai_cancel(request) == EAI_NOTCANCELED) {
+        return;
+    }
+
+    if (request->ar_result) {
+        freeaddrinfo(request->ar_result);
+    }
+    free(request);
+}
+
+int wait_fd(const int fd, const short events, const int timeout_ms) {
+    struct pollfd pfds[2] = {
+        { .fd = fd, .events = events },
+        { .fd = stop_fd, .events = POLLIN },
+    };
 
-        freeaddrinfo((struct addrinfo *) reqs->ar_request);
-        free(reqs);
+    int num_ready = poll(pfds, 2, timeout_ms);
+    if (num_ready <= 0) {
+        return num_ready < 0 && errno == EINTR ? 0 : num_ready;
+    }
+
+    if (pfds[1].revents) {
+        errno = ECANCELED;
+        return -1;
+    }
 
+    return 1;
+}
+
+int start_thread(pthread_t* thread, void* (*run)(void*), void* arg) {
+    return start_pinned_thread(thread, run, arg, -1);
+}
+
+int start_pinned_thread(pthread_t* thread, void* (*run)(void*), void* arg, const int cpu) {
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) != 0) {
         return 0;
     }
 
-    sprint_error(logger, "Unable to resolve hostname %s: %s\n", hostname, gai_strerror(rv))
+    // pinned from its start, so it does not allocate its memory on another node first
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
 
-    freeaddrinfo((struct addrinfo *) reqs->ar_request);
-    free(reqs);
+        if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) != 0) {
+            pthread_attr_destroy(&attr);
+            return 0;
+        }
+    }
 
-    return 0;
+    size_t stack_size = SRD_THREAD_STACK_SIZE;
+    if (stack_size > 0 && stack_size < (size_t) PTHREAD_STACK_MIN) {
+        stack_size = PTHREAD_STACK_MIN;
+    }
+    if (stack_size > 0 && pthread_attr_setstacksize(&attr, stack_size) != 0) {
+        pthread_attr_destroy(&attr);
+        return 0;
+    }
+
+    int r = pthread_create(thread, &attr, run, arg);
+    pthread_attr_destroy(&attr);
+    return r == 0;
 }
 
 int create_socket(const logger_t* logger, const int address_family) {
@@ -538,252 +638,143 @@ int create_socket(const logger_t* logger, const int address_family) {
         domain = AF_INET6;
     }
 
-    if ((sd = socket(domain, SOCK_DGRAM | SOCK_NONBLOCK, proto)) < 0)
+    if ((sd = socket(domain, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, proto)) < 0)
     {
         sprint_error(logger, "Unable to open socket. %s\n", strerror(errno));
-        return 0;
+        return -1;
     }
 
-    // sprint_debug(logger, "Created socket with family: %d\n", address_family);
-
     return sd;
 }
 
-int create_epoll(const int fd) {
-    // epoll on socket sd
-    int epfd = epoll_create(1);
-
-    struct epoll_event event;
-
-    event.events = EPOLLIN;
-    event.data.fd = fd;
-    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
-
-    return epfd;
-}
-
 /*
- * Fills the message starting at point in the following format:
- *            `target IP`_`icmp_msgs_count`___..._
+ * Size of the timestamp at the start of the payload of each packet:
+ * 8 bytes seconds and 4 bytes nanoseconds.
  */
-void fill_message(char* point, const char* end, const char* address) {
-    char* cptr = point;
-
-    int addr_len = strlen(address);
-        
-    memcpy(cptr, address, addr_len);
-    cptr += addr_len;
-    *cptr = '_';
-    cptr++;
-
-    const size_t seq_str_len = 5; // maximum size of uint16_t as a string
-    char seq_str[seq_str_len];
+#define PAYLOAD_TIMESTAMP_SIZE 12
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-truncation"
-    snprintf(seq_str, seq_str_len, "%d", icmp_msgs_count++);
-#pragma GCC diagnostic pop
+void build_packet_template(connectivity_check_t* check) {
+    char* packet_base = check->snd_buffer;
+    const int family = check->sockaddr->ss_family;
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstringop-truncation"
-#pragma GCC diagnostic ignored "-Wstringop-overflow"
-    strncpy(cptr, seq_str, strlen(seq_str));
-#pragma GCC diagnostic pop
-
-    cptr += strlen(seq_str);
-
-    for (; cptr < end - 1; cptr += 1) {
-        *cptr = '_';
-    }
-    *cptr = 0;
-}
-
-void initialize_packet(char* packet_base, int family, const char* address) {
-    memset(packet_base, 0, 64 * sizeof(char));
+    memset(packet_base, 0, PACKETSIZE * sizeof(char));
 
     if (family == AF_INET) {
         struct packet* pptr = (struct packet*) packet_base;
 
         pptr->hdr.type = ICMP_ECHO;
-        pptr->hdr.un.echo.sequence = icmp_msgs_count++;
-
-        fill_message(pptr->msg, pptr->msg + 56, address);
     } else if (family == AF_INET6) {
         struct packet6* pptr = (struct packet6*) packet_base;
 
         pptr->hdr.icmp6_type = ICMP6_ECHO_REQUEST;
+    }
 
-        fill_message(pptr->msg, pptr->msg + 56, address);
-    } 
-}
-
-int ping(const logger_t *logger,
-         connectivity_check_t* check)
-{
-    int flags = MSG_NOSIGNAL;
-
-    // resolve hostname each ping
-    if (check->flags & FLAG_IS_HOSTNAME) {
-        // could be a hostname
-        sprint_debug(logger, "Trying as a hostname: %s\n", check->address);
-
-        MEASURE_INIT(resolve_dns);
-        MEASURE_START(resolve_dns);
-
-        if (!resolve_hostname(logger, check->address, check->sockaddr, DNS_RESOLVE_TIMEOUT)) {
-            return (-1);
-        }
-        char duration[32];
-        MEASURE_GET_SINCE_STR(resolve_dns, duration);
+    // the payload after the timestamp: `target IP`___..._
+    char* cptr = packet_base + 8 + PAYLOAD_TIMESTAMP_SIZE;
+    const char* end = packet_base + PACKETSIZE;
 
-        sprint_debug(logger, "Resolving hostname %s took: %s\n", check->address, duration);
+    size_t addr_len = strlen(check->address);
+    if (addr_len > (size_t)(end - cptr - 1)) {
+        addr_len = end - cptr - 1;
     }
+    memcpy(cptr, check->address, addr_len);
+    cptr += addr_len;
 
-#if DEBUG
-    if (check->socket > 0) {
-        close(check->socket);
-    }
-    if (check->epoll_fd > 0) {
-        close(check->epoll_fd);
+    for (; cptr < end - 1; cptr += 1) {
+        *cptr = '_';
     }
-    check->socket = create_socket(logger, check->sockaddr->ss_family);
-    check->epoll_fd = create_epoll(check->socket);
-#endif
+    *cptr = 0;
 
-    struct timespec sent_time;
-    struct timespec rcvd_time;
+    check->template_family = family;
+}
 
-    // construct packet and send
-    memset(check->rcv_buffer, 0, PACKETSIZE);
+/*
+ * Sets the sequence number and the timestamp sent_time inside
+ * the packet template of check.
+ */
+static inline void patch_packet(connectivity_check_t* check, const struct timespec* sent_time) {
+    uint16_t sequence = htons(check->sequence);
 
-    initialize_packet(check->snd_buffer, check->sockaddr->ss_family, check->address);
+    if (check->template_family == AF_INET) {
+        ((struct packet*) check->snd_buffer)->hdr.un.echo.sequence = sequence;
+    } else {
+        ((struct packet6*) check->snd_buffer)->hdr.icmp6_seq = sequence;
+    }
 
-    // Send the message
-#if DEBUG
-    sprint_debug(logger, "Message sent: %s\n", check->snd_buffer + 8);
-#endif
+    uint64_t sec = sent_time->tv_sec;
+    uint32_t nsec = sent_time->tv_nsec;
+
+    memcpy(check->snd_buffer + 8, &sec, sizeof(sec));
+    memcpy(check->snd_buffer + 8 + sizeof(sec), &nsec, sizeof(nsec));
+}
 
-    if (check->socket < 0 || check->epoll_fd < 0) {
-        check->socket = create_socket(logger, check->sockaddr->ss_family);
-        check->epoll_fd = create_epoll(check->socket);
+int send_ping(const logger_t *logger, connectivity_check_t* check, const int sd)
+{
+    // (re)build the template if the address family changed (hostnames, gateways)
+    if (check->template_family != check->sockaddr->ss_family) {
+        build_packet_template(check);
     }
 
     // Start the clock. Uses CLOCK_REALTIME to get an
     // accurate measure of the latency
-    clock_gettime(CLOCK_REALTIME, &sent_time);
-
-    int bytes_sent = 0;
-    int tries = 0;
-
-    do {
-        if (check->sockaddr->ss_family == AF_INET) {
-            bytes_sent = sendto(check->socket, check->snd_buffer, PACKETSIZE, flags, (struct sockaddr *)check->sockaddr, sizeof(struct sockaddr_in));
-        } else {
-            bytes_sent = sendto(check->socket, check->snd_buffer, PACKETSIZE, flags, (struct sockaddr*)check->sockaddr, sizeof(struct sockaddr_in6));
-        }
-
-        if (tries >= 3) {
-            sprint_error(logger, "Unable to send ping: %s\n", strerror(errno));
-
-            close(check->socket);
-            close(check->epoll_fd);
-
-            check->socket = create_socket(logger, check->sockaddr->ss_family);
-            check->epoll_fd = create_epoll(check->socket);
-
-            return (-1);
-        }
+    clock_gettime(CLOCK_REALTIME, &check->sent_time);
 
-        if (bytes_sent < 0) { // error
-            close(check->socket);
-            close(check->epoll_fd);
-            
-            check->socket = create_socket(logger, check->sockaddr->ss_family);
-            check->epoll_fd = create_epoll(check->socket);
-
-            sprint_debug(logger, "Created new socket for %s\n", check->address);
-        } else { // this holds: bytes >= 0
-            if (bytes_sent == 64) break;
-            sprint_error(logger, "Only sent %d out of 64 bytes.\n", bytes_sent);
-
-            return (-1);
-        }
-        tries++;
-    } while(1);
-
-    // receive
-    struct epoll_event events[1];
-    
-    int num_ready = epoll_wait(check->epoll_fd, events, 1, check->timeout * 1e3);
+    // only the sequence number and timestamp change between pings
+    patch_packet(check, &check->sent_time);
 
-    if (num_ready < 0) {
-        // Do not print if we got interrupted
-        if (errno != EINTR) {
-            sprint_debug(logger, "Unable to receive: %s\n", strerror(errno));
-        } else {
-            // TODO: maybe return that an interrupt occured
-        }
+#if DEBUG
+    sprint_debug(logger, "Message sent: %s (sequence %d)\n", check->snd_buffer + 8 + PAYLOAD_TIMESTAMP_SIZE, check->sequence);
+#endif
 
-        check->timeout = -1.0;
-        
-        close(check->socket);
-        close(check->epoll_fd);
-        check->socket = -1;
-        check->epoll_fd = -1;
+    socklen_t addr_len = check->sockaddr->ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+    ssize_t bytes_sent;
 
-        return 0;
-    } else if (num_ready == 0) { // timeout
-        clock_gettime(CLOCK_REALTIME, &rcvd_time);
+    while ((bytes_sent = sendto(sd, check->snd_buffer, PACKETSIZE, MSG_NOSIGNAL, (struct sockaddr *)check->sockaddr, addr_len)) < 0 &&
+        errno == EINTR);
 
-        double diff = calculate_difference(sent_time, rcvd_time);
+    if (bytes_sent < 0) {
+        sprint_error(logger, "Unable to send ping: %s\n", strerror(errno));
 
-        sprint_debug(logger, "Timeout after %1.2fms\n", diff * 1e3);
+        return (-1);
+    } else if (bytes_sent != PACKETSIZE) {
+        sprint_error(logger, "Only sent %zd out of %d bytes.\n", bytes_sent, PACKETSIZE);
 
-        check->latency = -1.0;
+        return (-1);
+    }
 
-        close(check->socket);
-        close(check->epoll_fd);
-        check->socket = -1;
-        check->epoll_fd = -1;
+    return 1;
+}
 
+int parse_reply(const char* buffer, const ssize_t len, const int family, uint16_t* sequence, struct timespec* sent_time) {
+    if (len != PACKETSIZE) {
         return 0;
     }
 
-    if(events[0].events & EPOLLIN) {
-#if DEBUG
-        sprint_debug(logger, "Socket %d got some data\n", events[0].data.fd);
-#endif
-        size_t bytes_rcved = recv(check->socket, check->rcv_buffer, PACKETSIZE, 0);
-        
-        if (bytes_rcved != 64) {
-            sprint_debug(logger, "just received: %zd bytes: %s\n", bytes_rcved, check->rcv_buffer);
+    if (family == AF_INET) {
+        const struct icmphdr* hdr = (const struct icmphdr*) buffer;
 
-            return (-1);
+        if (hdr->type != ICMP_ECHOREPLY) {
+            return 0;
         }
-    }
+        *sequence = ntohs(hdr->un.echo.sequence);
+    } else {
+        const struct icmp6_hdr* hdr = (const struct icmp6_hdr*) buffer;
 
-    clock_gettime(CLOCK_REALTIME, &rcvd_time);
+        if (hdr->icmp6_type != ICMP6_ECHO_REPLY) {
+            return 0;
+        }
+        *sequence = ntohs(hdr->icmp6_seq);
+    }
 
-    // check if the message matches
-    int difference = memcmp(check->snd_buffer + 8, check->rcv_buffer + 8, PACKETSIZE - 8);
-    int is_exact_match = difference == 0; 
+    // the reply echoes our payload: it starts with the time the request was sent
+    uint64_t sec;
+    uint32_t nsec;
 
-    if (!is_exact_match) {
-        sprint_debug(logger, "Difference: %d\n", difference);
-        sprint_debug(logger, "Expected %s\n", check->snd_buffer + 8);
-        sprint_debug(logger, "Got      %s\n", check->rcv_buffer + 8);
-    }
+    memcpy(&sec, buffer + 8, sizeof(sec));
+    memcpy(&nsec, buffer + 8 + sizeof(sec), sizeof(nsec));
 
-    if (is_exact_match) {
-        check->latency = calculate_difference(sent_time, rcvd_time);
-    } else {
-        check->latency = -1.0;
-        
-        close(check->socket);
-        close(check->epoll_fd);
-        check->socket = -1;
-        check->epoll_fd = -1;
-    }
+    sent_time->tv_sec = sec;
+    sent_time->tv_nsec = nsec;
 
-    return is_exact_match;
+    return 1;
 }
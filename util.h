@@ -2,6 +2,7 @@
 #define SRD_UTIL_H
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <time.h>
 
 #include "srd.h"
@@ -9,6 +10,7 @@
 #include "actions.h"
 struct timespec;
 struct sockaddr_storage;
+struct gaicb;
 
 #define FLAG_CONTAINS_MS         0b1
 #define FLAG_CONTAINS_NOW        0b10
@@ -19,9 +21,21 @@ struct sockaddr_storage;
 #define FLAG_CONTAINS_LAT_MS     0b1000000
 #define FLAG_CONTAINS_STATUS     0b10000000
 #define FLAG_CONTAINS_TIMESTAMP  0b100000000
+#define FLAG_CONTAINS_IP         0b1000000000
+
+/* not a placeholder: the values are inserted escaped for a JSON string */
+#define FLAG_ESCAPE_JSON         0b10000000000
 
 #define DNS_RESOLVE_TIMEOUT 2
 
+/* Interval in which a pending lookup of a hostname is polled */
+#define RESOLVE_POLL_MS 20
+
+/* Stack size of the threads started by srd, 0 keeps the default of the libc */
+#ifndef SRD_THREAD_STACK_SIZE
+#define SRD_THREAD_STACK_SIZE 0
+#endif
+
 /*
  * Returns 1 if the given character needs to be escaped.
  */
@@ -34,6 +48,13 @@ int needs_escaping(char c);
  */
 char *escape_servicename(const char *);
 
+/*
+ * Writes string escaped for a JSON string (without the quotes) into buffer of
+ * size bytes; it is cut off (always at a whole escape sequence) if it does not
+ * fit. Returns the length of the escaped string like snprintf.
+ */
+size_t json_escape(const char* string, char* buffer, size_t size);
+
 /*
  * Checks if the string 'str' ends with 'end'
  */
@@ -45,12 +66,6 @@ int ends_with(const char *str, const char *end);
  */
 char *str_replace(const char *string, const char *substr, const char *replacement);
 
-/*
- * Returns a pointer to the string of the IP of the gateway.
- * Returns NULL if an error occurs.
- */
-char *get_default_gw();
-
 /*
  * Converts seconds to a string in the following format:
  * [%d days] %h:%m:%s. Where %d is only contained if it's
@@ -77,6 +92,7 @@ replacement_info_t get_replacements(const char* message);
 
 /*
  * Replaces all placeholders inside raw_message and returns a pointer to the updated string (which must be free'd).
+ * The values are escaped for JSON if info has FLAG_ESCAPE_JSON.
  */
 char* insert_placeholders(const placeholder_t* placeholder,
                         const connectivity_check_t* check,
@@ -99,24 +115,44 @@ int32_t calculate_difference_ms(const struct timespec old, const struct timespec
  */
 struct timespec timespec_add(const struct timespec t1, const struct timespec t2);
 
+/*
+ * Publishes time as the latest try of check. Only called by the thread of check.
+ */
+void set_latest_try(connectivity_check_t* check, const struct timespec time);
 
 /*
- * Creates a default socket used for pinging. 
+ * Returns a consistent copy of the latest try of check. May be called by any thread.
+ */
+struct timespec get_latest_try(const connectivity_check_t* check);
+
+
+/*
+ * Creates a non-blocking socket used for pinging. Returns -1 on error.
  */
 int create_socket(const logger_t* logger, const int address_family);
 
 /*
-* Pings the given address and updates latency_s.
-* Returns 1 if the ping was successfully returned. 
-* If nothing was returned 0 is returned. Errors are
-* indicated by any negative value.
-*/
-int ping(const logger_t *logger, connectivity_check_t* check);
+ * Builds the ICMP echo request template for check inside its snd_buffer.
+ * The payload has the following format:
+ *            `timestamp (12 bytes)``target IP`_____..._
+ * where only the timestamp and the sequence number in the header
+ * are updated for each ping.
+ */
+void build_packet_template(connectivity_check_t* check);
+
+/*
+ * Sends a ping with the sequence of check through the ping socket sd
+ * and sets the sent_time of check.
+ * Returns 1 on success, a negative value on errors.
+ */
+int send_ping(const logger_t *logger, connectivity_check_t* check, const int sd);
 
 /*
- * Creates an epoll fd used to get notified when a message was received on the fd.
+ * Parses the packet of length len received on a ping socket of family.
+ * Returns 1 if it is an echo reply and sets its sequence and the time its
+ * request was sent (from the payload), else 0.
  */
-int create_epoll(const int fd);
+int parse_reply(const char* buffer, const ssize_t len, const int family, uint16_t* sequence, struct timespec* sent_time);
 
 /*
  * Converts the address as string into a sockaddr_in.
@@ -127,9 +163,44 @@ int create_epoll(const int fd);
 int to_sockaddr(const char* address, struct sockaddr_storage* socket_addr);
 
 /*
- * Tries to resolve hostname into an IP inside socket_addr.
+ * Sets the port of the IPv4 or IPv6 address in socket_addr.
+ */
+void set_port(struct sockaddr_storage* socket_addr, int port);
+
+/*
+ * Starts resolving hostname in the background (hostname must stay valid).
+ * Returns the request for resolve_result, NULL on errors.
+ */
+struct gaicb* resolve_start(const logger_t* logger, const char* hostname);
+
+/*
+ * Returns -1 while request is in progress. Otherwise it is freed and 1 is
+ * returned if hostname was resolved into socket_addr, 0 if not.
+ */
+int resolve_result(const logger_t* logger, struct gaicb* request, struct sockaddr_storage* socket_addr);
+
+/*
+ * Cancels and frees request.
+ */
+void resolve_cancel(struct gaicb* request);
+
+/*
+ * Waits up to timeout_ms (-1 for ever) until fd has one of the poll events.
+ * Ends right away once we're stopping (see stop_fd); fd may be -1 to only sleep.
+ * Returns 1 if fd is ready, 0 on timeout and -1 if we're stopping or on error.
+ */
+int wait_fd(const int fd, const short events, const int timeout_ms);
+
+/*
+ * Starts run(arg) in a new thread with a stack of SRD_THREAD_STACK_SIZE bytes.
  * Returns 1 on success, else 0.
  */
-int resolve_hostname(const logger_t* logger, const char *hostname, struct sockaddr_storage *socket_addr, float timeout_s);
+int start_thread(pthread_t* thread, void* (*run)(void*), void* arg);
+
+/*
+ * Like start_thread, but the thread runs only on cpu (if it is not -1) from
+ * its start. Returns 1 on success, else 0 (f.ex. if we may not run on cpu).
+ */
+int start_pinned_thread(pthread_t* thread, void* (*run)(void*), void* arg, const int cpu);
 
 #endif